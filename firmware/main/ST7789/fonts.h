@@ -14,21 +14,7 @@ extern FontDef Font_7x10;
 extern FontDef Font_11x18;
 extern FontDef Font_16x26;
 
-//16-bit(RGB565) Image lib.
-/*******************************************
- *             CAUTION:
- *   If the MCU onchip flash cannot
- *  store such huge image data,please
- *           do not use it.
- * These pics are for test purpose only.
- *******************************************/
-
-/* 128x128 pixel RGB565 image */
-extern const uint16_t saber[][128];
-extern const uint8_t gattino[320*240*2];
-/* 240x240 pixel RGB565 image 
-extern const uint16_t knky[][240];
-extern const uint16_t tek[][240];
-extern const uint16_t adi1[][240];
-*/
+/* The test pictures are in firmware/assets, packed into the asset bundle:
+ * saber, knky, tek, adi1, gattino and peregrine. Draw them with
+ * ST7789_Asset_Draw() once the bundle is mounted. */
 #endif
@@ -10,85 +10,348 @@
 
 #include <stdio.h>
 #include <string.h>
-#include "driver/spi_master.h"
-#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 #include "st7789.h"
+#include "st7789_internal.h"
+
+#if CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS <= ST7789_TLS_INDEX
+#error "CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS must be above ST7789_TLS_INDEX"
+#endif
 
 const char * TAG = "ST7789";
 
-typedef struct {
-	spi_device_handle_t hspi;
+static st7789_ctx_t st7789_main;	// Display of ST7789_Init, drawn to by tasks that did not pick one
+
+/**
+ * SPI bus shared by the displays
+ */
+static struct {
+	uint8_t panels;		// Devices added to the bus
+	uint8_t ids;		// Displays set up so far, numbers them in the trace
+	st7789_ctx_t *displays;	// Displays set up, linked by next
+}st7789_bus;
+
+/**
+ * @brief State of the display the calling task draws to
+ * @note  Pure for the compiler: a task only changes its display between
+ *        driver calls.
+ * @return display of ST7789_Display_Use, the display of ST7789_Init by default
+ */
+st7789_ctx_t *ST7789_Ctx(void)
+{
+	st7789_ctx_t *ctx = pvTaskGetThreadLocalStoragePointer(NULL, ST7789_TLS_INDEX);
+
+	return ctx ? ctx : &st7789_main;
+}
+
+/**
+ * @brief Take the shared bus for the display, other panels wait their turn
+ * @param ctx -> display
+ * @return none
+ */
+static void spi_AcquireBus(st7789_ctx_t *ctx)
+{
+	int64_t t = ST7789_Port_Time();
+
+	ST7789_Port_AcquireBus(ctx);
+	ctx->stats.bus_wait_us += ST7789_Port_Time() - t;
+	ctx->bus_owned = 1;
+	ctx->bus_trans = 0;
+}
+
+/**
+ * @brief Let the other panels use the bus
+ * @note  Transactions still queued are sent before the bus changes hands.
+ * @param ctx -> display
+ * @return none
+ */
+static void spi_ReleaseBus(st7789_ctx_t *ctx)
+{
+	ctx->bus_owned = 0;
+	ST7789_Port_ReleaseBus(ctx);
+}
+
+/**
+ * @brief Reclaim the oldest queued transaction, waiting for it if still on the wire
+ * @param ctx -> display
+ * @return none
+ */
+static void spi_Reclaim(st7789_ctx_t *ctx)
+{
+	int64_t t = ST7789_Port_Time();
 
-	uint16_t width;			// Width of display
-	uint16_t height;		// Height of display
-	st7789_rot_t rotation;	// Rotation of display
+	ST7789_Port_Reclaim(ctx);
+	ctx->stats.queue_wait_us += ST7789_Port_Time() - t;
+	ctx->trans_pending--;
+}
 
-	uint16_t *disp_buf;	// Buffer for DMA transfer
-}st7789_ctx_t;
+/**
+ * @brief Get the next free transaction of the pool
+ * @note  Blocks only when all ST7789_DMA_QUEUE_SIZE transactions are in flight
+ * @param ctx -> display
+ * @return index of the transaction
+ */
+static uint8_t spi_GetTrans(st7789_ctx_t *ctx)
+{
+	if (ctx->trans_pending == ST7789_DMA_QUEUE_SIZE)
+		spi_Reclaim(ctx);
+	return ctx->trans_head;
+}
+
+/**
+ * @brief Queue a transaction obtained by spi_GetTrans
+ * @param ctx -> display
+ * @param idx -> index of the transaction
+ * @param buf -> data to send, must be DMA capable and untouched until sent
+ * @param len -> number of bytes
+ * @param dc -> level of the DC line, 0 command, 1 data
+ * @return none
+ */
+static void spi_QueueTrans(st7789_ctx_t *ctx, uint8_t idx, const void *buf, size_t len, uint8_t dc)
+{
+	if (st7789_bus.panels > 1 && !ctx->bus_owned)
+		spi_AcquireBus(ctx);
+	ST7789_Port_Queue(ctx, idx, buf, len, dc);
+
+	ctx->trans_head = (idx + 1) % ST7789_DMA_QUEUE_SIZE;
+	ctx->trans_pending++;
+	ctx->trans_seq++;
+	ctx->stats.transactions++;
+	ctx->stats.bytes += len;
+
+	if (ctx->bus_owned && ++ctx->bus_trans >= ST7789_BUS_SLICE) {
+		/* A long transfer gives the other panels a turn now and then,
+		   the next transaction takes the bus again */
+		spi_ReleaseBus(ctx);
+	}
+}
 
+/**
+ * @brief Let the other panels use the bus until the next transaction is queued
+ * @note  Call before waiting on anything but the wire, or before rendering
+ *        for long, so a panel only holds the bus while it queues.
+ * @return none
+ */
+void ST7789_BusYield(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
 
-st7789_ctx_t st7789_ctx;
+	if (ctx->bus_owned)
+		spi_ReleaseBus(ctx);
+}
 
 /**
  * @brief Scrivo un registro 
- * 
- * @param dev_handle 
- * @param reg 
- * @param recv 
- * @param len 
+ * @note  Data is copied in DMA buffers of ST7789_DMA_BUF_SIZE bytes, so the caller
+ *        can reuse buf on return while the previous chunks are still on the wire.
+ * @param ctx -> display
+ * @param buf -> data to send
+ * @param len -> number of bytes
+ * @param dc -> level of the DC line, 0 command, 1 data
+ * @return none
+ */
+static void spi_WriteReg(st7789_ctx_t *ctx, const uint8_t *buf, size_t len, uint8_t dc)
+{
+	while (len) {
+		size_t chunk = len < ST7789_DMA_BUF_SIZE ? len : ST7789_DMA_BUF_SIZE;
+		uint8_t idx = spi_GetTrans(ctx);
+
+		if (chunk > ST7789_PORT_INLINE) {
+			memcpy(ctx->dma_buf[idx], buf, chunk);
+			spi_QueueTrans(ctx, idx, ctx->dma_buf[idx], chunk, dc);
+		}
+		else
+			spi_QueueTrans(ctx, idx, buf, chunk, dc);
+		buf += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * @brief Take the driver lock of the display
+ * @note  The lock is recursive. Every function using the bus or the driver
+ *        state holds it, so tasks drawing at the same time are serialized
+ *        call by call. Hold it around several calls that must not be
+ *        interleaved with another task. With several panels on the bus, the
+ *        bus is taken by the first transaction queued and given back by the
+ *        outermost unlock; do not switch displays while holding the lock.
+ * @return none
+ */
+void ST7789_Lock(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if (ctx->lock == NULL)
+		return;
+	xSemaphoreTakeRecursive(ctx->lock, portMAX_DELAY);
+	if (ctx->lock_depth++ == 0)
+		ST7789_Trace_Begin(ctx);
+}
+
+/**
+ * @brief Release the driver lock of the display
+ * @return none
+ */
+void ST7789_Unlock(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if (ctx->lock == NULL)
+		return;
+	if (ctx->lock_depth == 1)
+		ST7789_Trace_End(ctx);
+	if (--ctx->lock_depth == 0 && ctx->bus_owned)
+		spi_ReleaseBus(ctx);
+	xSemaphoreGiveRecursive(ctx->lock);
+}
+
+/**
+ * @brief Wait until every queued transaction has been sent
+ * @return none
  */
-void spi_WriteReg(spi_device_handle_t dev_handle, uint8_t* buf, uint16_t len)
-{    
-    // spi_device_acquire_bus(dev_handle, portMAX_DELAY);
-    spi_transaction_t SpiTransaction;
-    memset(&SpiTransaction, 0, sizeof(SpiTransaction));			//Zero out the transaction ready to use
-    SpiTransaction.length = len * 8;								//Transaction length is in bits
-    SpiTransaction.tx_buffer = buf;	                        //Set the tx data buffer
-    SpiTransaction.flags = 0;					
-    spi_device_polling_transmit(dev_handle, &SpiTransaction);		//Waits until the transfer is complete
-    // spi_device_release_bus(dev_handle);
+void ST7789_WaitIdle(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	while (ctx->trans_pending)
+		spi_Reclaim(ctx);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Wait until every display has sent its queued transactions
+ * @note  For data shared by all the displays, e.g. before it is unmapped.
+ *        Not while holding the lock of a display.
+ * @return none
+ */
+void ST7789_WaitIdleAll(void)
+{
+	for (st7789_ctx_t *ctx = __atomic_load_n(&st7789_bus.displays, __ATOMIC_ACQUIRE); ctx; ctx = ctx->next) {
+		xSemaphoreTakeRecursive(ctx->lock, portMAX_DELAY);
+		while (ctx->trans_pending)
+			spi_Reclaim(ctx);
+		xSemaphoreGiveRecursive(ctx->lock);
+	}
+}
+
+/**
+ * @brief Wait until the transactions queued up to a sequence number have been sent
+ * @param seq -> value returned by ST7789_QueueBuffer
+ * @return none
+ */
+void ST7789_WaitSeq(uint32_t seq)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	while ((int32_t)(ctx->trans_seq - ctx->trans_pending - seq) < 0)
+		spi_Reclaim(ctx);
+}
+
+/**
+ * @brief Queue pixel data without copying it
+ * @param buf -> DMA capable buffer, left untouched until ST7789_WaitSeq returns
+ * @param len -> number of bytes
+ * @return sequence number of the last transaction reading buf
+ */
+uint32_t ST7789_QueueBuffer(const void *buf, size_t len)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	const uint8_t *p = buf;
+
+	ctx->win_pos += len / 2;
+	ctx->power_pixels += len / 2;
+
+	while (len) {
+		size_t chunk = len < ST7789_DMA_BUF_SIZE ? len : ST7789_DMA_BUF_SIZE;
+		spi_QueueTrans(ctx, spi_GetTrans(ctx), p, chunk, 1);
+		p += chunk;
+		len -= chunk;
+	}
+	return ctx->trans_seq;
+}
+
+/**
+ * @brief Get the DMA buffer of the next transaction, to render pixels in place
+ * @note  Fill it and queue it with ST7789_QueuePixels before any other
+ *        transport call. Saves the copy of a RAM staging buffer.
+ * @return buffer of ST7789_DMA_BUF_SIZE / 2 pixels
+ */
+uint16_t *ST7789_PixelBuf(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	return (uint16_t *)ctx->dma_buf[spi_GetTrans(ctx)];
+}
+
+/**
+ * @brief Queue the pixels rendered in the buffer of ST7789_PixelBuf
+ * @param count -> pixels, panel byte order, at most ST7789_DMA_BUF_SIZE / 2
+ * @return none
+ */
+void ST7789_QueuePixels(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint8_t idx = spi_GetTrans(ctx);	// Still free, the same as ST7789_PixelBuf
+
+	ctx->win_pos += count;
+	ctx->power_pixels += count;
+	spi_QueueTrans(ctx, idx, ctx->dma_buf[idx], count * 2, 1);
 }
 
 /**
  * @brief Write command to ST7789 controller
+ * @param ctx -> display
  * @param cmd -> command to write
  * @return none
  */
-static void ST7789_WriteCommand(uint8_t * cmd, uint16_t size)
+static void ST7789_WriteCommand(st7789_ctx_t *ctx, uint8_t * cmd, uint16_t size)
 {
-	ST7789_DC_Clr();
-	spi_WriteReg(st7789_ctx.hspi, cmd, size);
+	ctx->win_stream = 0;
+	spi_WriteReg(ctx, cmd, size, 0);
 }
 
 /**
  * @brief Write data to ST7789 controller
+ * @param ctx -> display
  * @param buff -> pointer of data buffer
  * @param buff_size -> size of the data buffer
  * @return none
  */
-static void ST7789_WriteData(uint8_t *buff, size_t buff_size)
+static void ST7789_WriteData(st7789_ctx_t *ctx, uint8_t *buff, size_t buff_size)
 {
-	ST7789_DC_Set();
-	spi_WriteReg(st7789_ctx.hspi, buff, buff_size);
-	ST7789_DC_Clr();
-
+	spi_WriteReg(ctx, buff, buff_size, 1);
 }
 
 /**
  * @brief Write data to ST7789 controller, simplify for 8bit data.
+ * @param ctx -> display
  * data -> data to write
  * @return none
  */
-static void ST7789_WriteSmallData(uint8_t data)
+static void ST7789_WriteSmallData(st7789_ctx_t *ctx, uint8_t data)
 {
 	ST7789_Select();
-	ST7789_DC_Set();
-	spi_WriteReg(st7789_ctx.hspi, &data, sizeof(data));
+	spi_WriteReg(ctx, &data, sizeof(data), 1);
 	ST7789_UnSelect();
 }
 
+/**
+ * @brief Let the queued commands reach the panel, then wait
+ * @param ticks -> delay after the queue is empty
+ * @return none
+ */
+static void ST7789_Delay(TickType_t ticks)
+{
+	ST7789_WaitIdle();
+	ST7789_BusYield();	// The other panels may use the bus meanwhile
+	vTaskDelay(ticks);
+}
+
 /**
  * @brief Write command to ST7789 controller
  * @param reg Register to read
@@ -117,11 +380,111 @@ static void ST7789_WriteSmallData(uint8_t data)
 // 	// st7789_ctx.hspi->Instance->CR1 |= pres;
 // }
 
+/**
+ * @brief Pattern fill a pixel buffer
+ * @note  Stores two pixels per 32 bit word, eight pixels per iteration
+ * @param buf -> buffer to fill
+ * @param data -> pixel value
+ * @param size -> number of pixels
+ * @return none
+ */
 void MemsetBuffer(uint16_t *buf, uint16_t data, uint32_t size)
 {
-	while(size--)
+	if (((uintptr_t)buf & 3) && size) {
 		*(buf++) = data;
+		size--;
+	}
+
+	uint32_t pattern = ((uint32_t)data << 16) | data;
+	uint32_t *p = (uint32_t *)buf;
+	uint32_t n = size >> 1;
+
+	while (n >= 4) {
+		p[0] = pattern;
+		p[1] = pattern;
+		p[2] = pattern;
+		p[3] = pattern;
+		p += 4;
+		n -= 4;
+	}
+	while (n--)
+		*(p++) = pattern;
+	if (size & 1)
+		*(uint16_t *)p = data;
+}
+
+/**
+ * @brief Stream the same color for count pixels in the current window
+ * @note  The color is expanded once in fill_buf, every chunk of the fill is a
+ *        transaction pointing to it. A new color waits only for the
+ *        transactions still reading the buffer.
+ * @param ctx -> display
+ * @param color -> RGB565 color
+ * @param count -> number of pixels
+ * @return none
+ */
+static void ST7789_WriteColor(st7789_ctx_t *ctx, uint16_t color, uint32_t count)
+{
+	uint16_t swapped = (color >> 8) | (color << 8);
+
+	if (swapped != ctx->fill_color) {
+		ST7789_WaitSeq(ctx->fill_seq);
+		MemsetBuffer(ctx->fill_buf, swapped, ST7789_DMA_BUF_SIZE / 2);
+		ctx->fill_color = swapped;
+	}
+
+	while (count) {
+		uint32_t n = count < ST7789_DMA_BUF_SIZE / 2 ? count : ST7789_DMA_BUF_SIZE / 2;
+		ctx->fill_seq = ST7789_QueueBuffer(ctx->fill_buf, n * 2);
+		count -= n;
+	}
+}
 
+/**
+ * @brief Stream a block of pixels in the current window
+ * @note  Rows are packed back to back in the DMA buffers, so a block cut out of
+ *        a wider buffer costs the same number of transactions as a contiguous one.
+ * @param src -> first pixel, panel byte order
+ * @param w&h -> size of the block in pixels
+ * @param stride -> pixels between two rows of src
+ * @return none
+ */
+void ST7789_WriteRect(const void *src, uint16_t w, uint16_t h, uint16_t stride)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	const uint8_t *row = src;
+	size_t row_size = (size_t)w * 2;
+	size_t used = 0;
+	uint8_t idx;
+
+	ctx->win_pos += (uint32_t)w * h;
+	ctx->power_pixels += (uint32_t)w * h;
+	if (w == stride) {
+		spi_WriteReg(ctx, row, row_size * h, 1);
+		return;
+	}
+
+	idx = spi_GetTrans(ctx);
+	while (h--) {
+		const uint8_t *p = row;
+		size_t left = row_size;
+
+		while (left) {
+			size_t n = left < ST7789_DMA_BUF_SIZE - used ? left : ST7789_DMA_BUF_SIZE - used;
+			memcpy(ctx->dma_buf[idx] + used, p, n);
+			used += n;
+			p += n;
+			left -= n;
+			if (used == ST7789_DMA_BUF_SIZE) {
+				spi_QueueTrans(ctx, idx, ctx->dma_buf[idx], used, 1);
+				idx = spi_GetTrans(ctx);
+				used = 0;
+			}
+		}
+		row += (size_t)stride * 2;
+	}
+	if (used)
+		spi_QueueTrans(ctx, idx, ctx->dma_buf[idx], used, 1);
 }
 
 /**
@@ -131,227 +494,619 @@ void MemsetBuffer(uint16_t *buf, uint16_t data, uint32_t size)
  */
 void ST7789_SetRotation(uint8_t m)
 {
+	st7789_ctx_t *ctx = ST7789_Ctx();
 	uint8_t reg = ST7789_MADCTL;
-	ST7789_WriteCommand(&reg, 1);	// MADCTL
+
+	ST7789_Select();
+	ST7789_InvalidateWindow();	// Addresses change meaning
+	if (ctx->scroll_len)
+		ST7789_Scroll_Reset();	// The area was defined for the previous axis
+	ST7789_WriteCommand(ctx, &reg, 1);	// MADCTL
 	switch (m) {
 	case 0:
-		ST7789_WriteSmallData(ST7789_MADCTL_MX | ST7789_MADCTL_MY | ST7789_MADCTL_RGB);
+		ST7789_WriteSmallData(ctx, ST7789_MADCTL_MX | ST7789_MADCTL_MY | ST7789_MADCTL_RGB);
 		break;
 	case 1:
-		ST7789_WriteSmallData(ST7789_MADCTL_MY | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
+		ST7789_WriteSmallData(ctx, ST7789_MADCTL_MY | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
 		break;
 	case 2:
-		ST7789_WriteSmallData(ST7789_MADCTL_RGB);
+		ST7789_WriteSmallData(ctx, ST7789_MADCTL_RGB);
 		break;
 	case 3:
-		ST7789_WriteSmallData(ST7789_MADCTL_MX | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
+		ST7789_WriteSmallData(ctx, ST7789_MADCTL_MX | ST7789_MADCTL_MV | ST7789_MADCTL_RGB);
 		break;
 	default:
 		break;
 	}
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Forget the cached address window, the next one is sent in full
+ * @return none
+ */
+void ST7789_InvalidateWindow(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ctx->win_cols_valid = 0;
+	ctx->win_rows_valid = 0;
+	ctx->win_pos_valid = 0;
+	ctx->win_stream = 0;
 }
 
 /**
  * @brief Set address of DisplayWindow
+ * @note  The window programmed in the controller is cached: CASET and RASET are
+ *        only sent when they change. When the requested window is the rest of
+ *        the cached one, from a row where the memory pointer already is, the
+ *        pixels just continue: with no command at all if only pixels were sent
+ *        since RAMWR, with a single RAMWRC otherwise.
  * @param xi&yi -> coordinates of window
  * @return none
  */
-static void ST7789_SetAddressWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+void ST7789_SetAddressWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_rect_t *win = &ctx->win;
+	uint8_t same_cols = ctx->win_cols_valid && x0 == win->x0 && x1 == win->x1;
+	uint8_t same_rows = ctx->win_rows_valid && y0 == win->y0 && y1 == win->y1;
+	uint8_t reg;
+
 	ST7789_Select();
-	uint16_t x_start = x0 , x_end = x1;
-	uint16_t y_start = y0 , y_end = y1;
-	
-	uint8_t reg = ST7789_CASET;
+	if (ctx->power_state == ST7789_POWER_IDLE)
+		ST7789_Power_Wake();	// Pixels are coming, show them in full
+	if (same_cols && ctx->win_rows_valid && ctx->win_pos_valid &&
+		y0 >= win->y0 && y1 <= win->y1 &&
+		ctx->win_pos == (uint32_t)(y0 - win->y0) * (x1 - x0 + 1)) {
+		/* Memory pointer is at the start of row y0 of the cached window */
+		if (!ctx->win_stream) {
+			reg = ST7789_WRITE_MEM_CONTINUE;
+			ST7789_WriteCommand(ctx, &reg, 1);
+			ctx->win_stream = 1;
+		}
+		ctx->stats.windows_kept++;
+		ST7789_UnSelect();
+		return;
+	}
 
 	/* Column Address set */
-	ST7789_WriteCommand(&reg, 1);
-	{
-		uint8_t data[] = {x_start >> 8, x_start & 0xFF, x_end >> 8, x_end & 0xFF};
-		ST7789_WriteData(data, sizeof(data));
+	if (!same_cols) {
+		uint8_t data[] = {x0 >> 8, x0 & 0xFF, x1 >> 8, x1 & 0xFF};
+		reg = ST7789_CASET;
+		ST7789_WriteCommand(ctx, &reg, 1);
+		ST7789_WriteData(ctx, data, sizeof(data));
+		win->x0 = x0;
+		win->x1 = x1;
+		ctx->win_cols_valid = 1;
 	}
 
 	/* Row Address set */
-	reg = ST7789_RASET;
-	ST7789_WriteCommand(&reg, 1);
-	{
-		uint8_t data[] = {y_start >> 8, y_start & 0xFF, y_end >> 8, y_end & 0xFF};
-		ST7789_WriteData(data, sizeof(data));
+	if (!same_rows) {
+		uint8_t data[] = {y0 >> 8, y0 & 0xFF, y1 >> 8, y1 & 0xFF};
+		reg = ST7789_RASET;
+		ST7789_WriteCommand(ctx, &reg, 1);
+		ST7789_WriteData(ctx, data, sizeof(data));
+		win->y0 = y0;
+		win->y1 = y1;
+		ctx->win_rows_valid = 1;
 	}
+
 	/* Write to RAM */
 	reg = ST7789_RAMWR;
-	ST7789_WriteCommand(&reg, 1);
+	ST7789_WriteCommand(ctx, &reg, 1);
+	ctx->win_stream = 1;
+	ctx->win_pos = 0;
+	ctx->win_pos_valid = 1;
+	ctx->stats.windows++;
 	ST7789_UnSelect();
 }
 
 /**
- * @brief Initialize ST7789 controller
- * @param height Display height as you see
- * @param width Display width as you see
- * @param rot Displat orientation, landscape ore portrait
+ * @brief Clip a rectangle to the current render target and clip rectangle
+ * @param r -> rectangle to clip, updated in place
+ * @return 1 if something is left to draw, 0 otherwise
+ */
+uint8_t ST7789_ClipToTarget(st7789_rect_t *r)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s = ctx->target;
+	int16_t cx0 = 0, cy0 = 0;
+	int16_t cx1 = ctx->width - 1, cy1 = ctx->height - 1;
+
+	if (s) {
+		if (s->x > cx0) cx0 = s->x;
+		if (s->y > cy0) cy0 = s->y;
+		if (s->x + s->w - 1 < cx1) cx1 = s->x + s->w - 1;
+		if (s->y + s->h - 1 < cy1) cy1 = s->y + s->h - 1;
+	}
+	if (ctx->clip) {
+		const st7789_rect_t *c = ctx->clip;
+		if (c->x0 > cx0) cx0 = c->x0;
+		if (c->y0 > cy0) cy0 = c->y0;
+		if (c->x1 < cx1) cx1 = c->x1;
+		if (c->y1 < cy1) cy1 = c->y1;
+	}
+	if (r->x0 < cx0) r->x0 = cx0;
+	if (r->y0 < cy0) r->y0 = cy0;
+	if (r->x1 > cx1) r->x1 = cx1;
+	if (r->y1 > cy1) r->y1 = cy1;
+
+	return (r->x0 <= r->x1) && (r->y0 <= r->y1);
+}
+
+/**
+ * @brief Fill an area of the render target with a single color
+ * @note  Every primitive ends here or in ST7789_BlitArea, so they all follow the
+ *        render target: the panel, the framebuffer or another RAM surface.
+ * @param x0&y0 -> top left corner
+ * @param x1&y1 -> bottom right corner, inclusive
+ * @param color -> RGB565 color
  * @return none
  */
-void ST7789_Init(uint16_t height, uint16_t width, uint8_t rot)
+void ST7789_FillArea(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
 {
-	//Init spi
-	gpio_config_t io_output_conf = {};
-    io_output_conf.intr_type = GPIO_INTR_DISABLE;
-    io_output_conf.mode = GPIO_MODE_OUTPUT;
-    io_output_conf.pin_bit_mask = (1ULL<<ST7789_DC_PIN);
-    io_output_conf.pull_up_en = 0;
-
-    gpio_config(&io_output_conf);
-
-    spi_bus_config_t buscfg = {
-        .miso_io_num = NULL,
-        .mosi_io_num = ST7789_SDA_PIN,
-        .sclk_io_num = ST7789_SCL_PIN,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 32,
-    };
-    //Initialize the SPI bus
-	
-    uint32_t ret = spi_bus_initialize(SPI_HOST, &buscfg, SPI_DMA_DISABLED);
-    ESP_ERROR_CHECK(ret);
-
-    spi_device_interface_config_t SpiDeviceCfg = {
-		.clock_speed_hz = SPI_BUS_SPEED,				//Clock out at 10 MHz
-		.mode = 0,								//<<< SPI mode 0
-		.spics_io_num = ST7789_CS_PIN,			        //<<< CS pin number
-		.queue_size = 1,						//<<< Number of transactions we want to be able to queue at a time using spi_device_queue_trans()
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	st7789_rect_t r = {x0, y0, x1, y1};
+
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_FILL);
+	s = ctx->target;
+	if (!ST7789_ClipToTarget(&r)) {
+		ST7789_UnSelect();
+		return;
+	}
+
+	if (s == NULL) {
+		ST7789_SetAddressWindow(r.x0, r.y0, r.x1, r.y1);
+		ST7789_WriteColor(ctx, color, (uint32_t)(r.x1 - r.x0 + 1) * (r.y1 - r.y0 + 1));
+		ST7789_UnSelect();
+		return;
+	}
+
+	uint16_t swapped = (color >> 8) | (color << 8);
+	uint16_t *row = s->buf + (size_t)(r.y0 - s->y) * s->stride + (r.x0 - s->x);
+	for (int16_t y = r.y0; y <= r.y1; y++) {
+		MemsetBuffer(row, swapped, r.x1 - r.x0 + 1);
+		row += s->stride;
+	}
+	if (s == &ctx->fb)
+		ST7789_FB_MarkDirty(r.x0, r.y0, r.x1, r.y1);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Copy a block of pixels to the render target, clipping it
+ * @param x&y -> screen position of the block
+ * @param w&h -> size of the block
+ * @param data -> pixels in panel byte order, w per row
+ * @return none
+ */
+void ST7789_BlitArea(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	st7789_rect_t r = {x, y, x + w - 1, y + h - 1};
+
+	if (!w || !h)
+		return;
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_BLIT);
+	s = ctx->target;
+	if (!ST7789_ClipToTarget(&r)) {
+		ST7789_UnSelect();
+		return;
+	}
+
+	data += ((size_t)(r.y0 - y) * w + (r.x0 - x)) * 2;
+	uint16_t cw = r.x1 - r.x0 + 1;
+	uint16_t ch = r.y1 - r.y0 + 1;
+
+	if (s == NULL) {
+		ST7789_SetAddressWindow(r.x0, r.y0, r.x1, r.y1);
+		ST7789_WriteRect(data, cw, ch, w);
+		ST7789_UnSelect();
+		return;
+	}
+
+	uint16_t *row = s->buf + (size_t)(r.y0 - s->y) * s->stride + (r.x0 - s->x);
+	while (ch--) {
+		memcpy(row, data, (size_t)cw * 2);
+		row += s->stride;
+		data += (size_t)w * 2;
+	}
+	if (s == &ctx->fb)
+		ST7789_FB_MarkDirty(r.x0, r.y0, r.x1, r.y1);
+	ST7789_UnSelect();
+}
+
+static uint32_t RectArea(const st7789_rect_t *r)
+{
+	return (uint32_t)(r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1);
+}
+
+static st7789_rect_t RectUnion(const st7789_rect_t *a, const st7789_rect_t *b)
+{
+	st7789_rect_t u = {
+		a->x0 < b->x0 ? a->x0 : b->x0,
+		a->y0 < b->y0 ? a->y0 : b->y0,
+		a->x1 > b->x1 ? a->x1 : b->x1,
+		a->y1 > b->y1 ? a->y1 : b->y1,
 	};
-	spi_bus_add_device(SPI_HOST, &SpiDeviceCfg, &st7789_ctx.hspi);		//<<<You can use ESP_ERROR_CHECK() on this call if you are having issues
-	
+	return u;
+}
+
+/**
+ * @brief Clean pixels a merge of two rectangles would send again
+ * @note  Zero when one contains the other or when they are adjacent and
+ *        aligned, i.e. the union is exactly the covered area.
+ * @param a&b -> rectangles to merge
+ * @return number of wasted pixels
+ */
+static uint32_t RectMergeWaste(const st7789_rect_t *a, const st7789_rect_t *b)
+{
+	st7789_rect_t u = RectUnion(a, b);
+	st7789_rect_t i = {
+		a->x0 > b->x0 ? a->x0 : b->x0,
+		a->y0 > b->y0 ? a->y0 : b->y0,
+		a->x1 < b->x1 ? a->x1 : b->x1,
+		a->y1 < b->y1 ? a->y1 : b->y1,
+	};
+	uint32_t overlap = (i.x0 <= i.x1 && i.y0 <= i.y1) ? RectArea(&i) : 0;
+
+	return RectArea(&u) - (RectArea(a) + RectArea(b) - overlap);
+}
+
+/**
+ * @brief Add a rectangle to a list of disjoint-ish areas to redraw
+ * @note  The rectangle is merged with every one of the list it can join for at
+ *        most ST7789_DIRTY_MERGE_SLACK clean pixels, which covers overlapping,
+ *        contained and adjacent aligned rectangles. When the list is full it is
+ *        merged with the one that wastes the least.
+ * @param list -> rectangles
+ * @param count -> rectangles in the list
+ * @param max -> capacity of the list
+ * @param rect -> rectangle to add
+ * @return new number of rectangles in the list
+ */
+uint8_t ST7789_RectListAdd(st7789_rect_t *list, uint8_t count, uint8_t max, const st7789_rect_t *rect)
+{
+	st7789_rect_t r = *rect;
+
+	for (;;) {
+		int8_t best = -1;
+		uint32_t best_waste = UINT32_MAX;
+
+		for (uint8_t i = 0; i < count; i++) {
+			uint32_t waste = RectMergeWaste(&list[i], &r);
+			if ((waste <= ST7789_DIRTY_MERGE_SLACK || count == max) && waste < best_waste) {
+				best = i;
+				best_waste = waste;
+			}
+		}
+		if (best < 0)
+			break;
+
+		r = RectUnion(&r, &list[best]);
+		list[best] = list[--count];
+	}
+	list[count++] = r;
+	return count;
+}
+
+/**
+ * @brief Set up the display of the calling task: SPI device, buffers, and
+ *        the init sequence of the controller
+ * @param ctx -> display of the calling task
+ * @param cfg -> pins and geometry
+ * @return ESP_OK, ESP_ERR_NO_MEM, or an error of the SPI driver
+ */
+static esp_err_t ST7789_Display_Init(st7789_ctx_t *ctx, const st7789_config_t *cfg)
+{
+	esp_err_t err;
+
+	if (ctx->lock == NULL) {
+		ctx->lock = xSemaphoreCreateRecursiveMutexStatic(&ctx->lock_buf);
+		ctx->glyphs.budget = ST7789_GLYPH_CACHE_BUDGET;
+		ctx->id = st7789_bus.ids++;
+	}
+	ctx->dc_pin = cfg->dc_pin;
+
+	err = ST7789_Port_Open(ctx, cfg);
+	if (err != ESP_OK)
+		return err;
+	ctx->port_open = 1;
+	st7789_bus.panels++;
+
+	/* Allocate one DMA buffer per transaction */
+	for (uint8_t i = 0; i < ST7789_DMA_QUEUE_SIZE; i++) {
+		ctx->dma_buf[i] = heap_caps_malloc(ST7789_DMA_BUF_SIZE, MALLOC_CAP_DMA);
+		if (ctx->dma_buf[i] == NULL)
+			return ESP_ERR_NO_MEM;
+	}
+	ctx->trans_head = 0;
+	ctx->trans_pending = 0;
+	ctx->trans_seq = 0;
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	ctx->frame_us = 0;
+
+	ctx->fill_buf = heap_caps_malloc(ST7789_DMA_BUF_SIZE, MALLOC_CAP_DMA);
+	if (ctx->fill_buf == NULL)
+		return ESP_ERR_NO_MEM;
+	ctx->fill_color = 0;
+	MemsetBuffer(ctx->fill_buf, 0, ST7789_DMA_BUF_SIZE / 2);
+	ctx->fill_seq = 0;
 
+	ST7789_InvalidateWindow();
 
 	//Probe device
     // uint8_t recv[] = {0,0,0,0};
     // ST7789_ReadData(ST7789_RDDID, recv, 4);
 	// printf("ST7789 ID: %02X %02X %02X %02X\r\n", recv[0], recv[1], recv[2], recv[3]);
 
-	/* Select dimension */
-	st7789_ctx.width = width;
-	st7789_ctx.height = height;
-	st7789_ctx.rotation = rot;
+	/* The bus is shared from here, a panel of it may be drawing */
+	ST7789_Select();
 
-	if(st7789_ctx.rotation == ROT_PORTRAIT_180 || st7789_ctx.rotation == ROT_PORTRAIT)
-	{
-		st7789_ctx.width = height;
-		st7789_ctx.height = width;
+	if (cfg->rst_pin >= 0) {
+		ST7789_Port_SetPin(ctx, cfg->rst_pin, 0);
+		ST7789_Delay(pdMS_TO_TICKS(10));
+		ST7789_Port_SetPin(ctx, cfg->rst_pin, 1);
+		ST7789_Delay(pdMS_TO_TICKS(120));
 	}
 
+	/* Select dimension */
+	ctx->width = cfg->width;
+	ctx->height = cfg->height;
+	ctx->rotation = cfg->rotation;
 
-	#ifdef USE_DMA
-		/* Allocate buffer for DMA transfer */
-		st7789_ctx.disp_buf = (uint16_t *)calloc(st7789_ctx.width * st7789_ctx.height, sizeof(uint16_t));
-		if(st7789_ctx.disp_buf == NULL)
-			Error_Handler();
-	#endif
+	if(ctx->rotation == ROT_PORTRAIT_180 || ctx->rotation == ROT_PORTRAIT)
+	{
+		ctx->width = cfg->height;
+		ctx->height = cfg->width;
+	}
 
-	
 
     uint8_t reg = ST7789_RAMWR;
 
-    ST7789_WriteCommand(&reg, 1);
-    vTaskDelay(10);
+    ST7789_WriteCommand(ctx, &reg, 1);
+    ST7789_Delay(10);
 
     reg = ST7789_SWRESET;
-    ST7789_WriteCommand(&reg, 1);
-    vTaskDelay(20);
+    ST7789_WriteCommand(ctx, &reg, 1);
+    ST7789_Delay(20);
 
     reg = ST7789_SLPOUT;
-    ST7789_WriteCommand(&reg, 1);
-    vTaskDelay(120);
+    ST7789_WriteCommand(ctx, &reg, 1);
+    ST7789_Delay(120);
 
     reg = ST7789_DISPON;
-  	ST7789_WriteCommand (&reg, 1);	//	Main screen turned on
-	vTaskDelay(10);
+  	ST7789_WriteCommand (ctx, &reg, 1);	//	Main screen turned on
+	ST7789_Delay(10);
 
     reg = ST7789_NORON;
-    ST7789_WriteCommand (&reg, 1);		//	Normal Display on
-    vTaskDelay(10);
+    ST7789_WriteCommand (ctx, &reg, 1);		//	Normal Display on
+    ST7789_Delay(10);
 
     reg = ST7789_RAM_CTRL;
-    ST7789_WriteCommand(&reg, 1);
-    ST7789_WriteSmallData(0x00);
-    ST7789_WriteSmallData(0xF0); //F8 per big endian
+    ST7789_WriteCommand(ctx, &reg, 1);
+    ST7789_WriteSmallData(ctx, 0x00);
+    ST7789_WriteSmallData(ctx, 0xF0); //F8 per big endian
 
-	ST7789_SetRotation(st7789_ctx.rotation);	//	MADCTL (Display Rotation)
+	ST7789_SetRotation(ctx->rotation);	//	MADCTL (Display Rotation)
 
 	reg = ST7789_COLMOD;
-    ST7789_WriteCommand(&reg, 1);		//	Set color mode
-    ST7789_WriteSmallData(ST7789_COLOR_MODE_16bit);
+    ST7789_WriteCommand(ctx, &reg, 1);		//	Set color mode
+    ST7789_WriteSmallData(ctx, ST7789_COLOR_MODE_16bit);
+
+	ctx->power_cfg = (st7789_power_cfg_t){
+		.active_rate = ST7789_POWER_RATE_ACTIVE,
+		.static_rate = ST7789_POWER_RATE_STATIC,
+		.static_ms = ST7789_POWER_STATIC_MS,
+		.busy_pixels = ST7789_POWER_BUSY_PIXELS,
+	};
+	ctx->power_state = ST7789_POWER_ACTIVE;
+	ctx->power_pixels = 0;
+	ctx->power_tick = ctx->power_busy = xTaskGetTickCount();
 
     reg = ST7789_FRAME_RATE_CTRL2;
-	ST7789_WriteCommand (&reg, 1);				//	Frame rate control in normal mode
-	ST7789_WriteSmallData (0x0F);			//	Default value (60HZ)
+	ST7789_WriteCommand (ctx, &reg, 1);				//	Frame rate control in normal mode
+	ST7789_WriteSmallData (ctx, ST7789_POWER_RATE_ACTIVE);
 
 	reg = ST7789_PORCH_CTRL;
-  	ST7789_WriteCommand(&reg, 1);				//	Porch control
+  	ST7789_WriteCommand(ctx, &reg, 1);				//	Porch control
 	{
 		uint8_t data[] = {0x0C, 0x0C, 0x00, 0x33, 0x33};
-		ST7789_WriteData(data, sizeof(data));
+		ST7789_WriteData(ctx, data, sizeof(data));
 	}
 	
 	/* Internal LCD Voltage generator settings */
 	reg = ST7789_GATE_CTRL;
-    ST7789_WriteCommand(&reg , 1);				//	Gate Control
-    ST7789_WriteSmallData(0x35);			//	Default value
+    ST7789_WriteCommand(ctx, &reg , 1);				//	Gate Control
+    ST7789_WriteSmallData(ctx, 0x35);			//	Default value
     reg = ST7789_VCOM_SET;
-    ST7789_WriteCommand(&reg, 1);				//	VCOM setting
-    ST7789_WriteSmallData(0x1F);			//0x19	0.725v (default 0.75v for 0x20)
+    ST7789_WriteCommand(ctx, &reg, 1);				//	VCOM setting
+    ST7789_WriteSmallData(ctx, 0x1F);			//0x19	0.725v (default 0.75v for 0x20)
     reg = ST7789_LCM_CTRL;
-    ST7789_WriteCommand(&reg, 1);				//	LCMCTRL
-    ST7789_WriteSmallData (0x2C);			//	Default value
+    ST7789_WriteCommand(ctx, &reg, 1);				//	LCMCTRL
+    ST7789_WriteSmallData (ctx, 0x2C);			//	Default value
 
     reg = ST7789_VDV_VRH_EN;
-    ST7789_WriteCommand (&reg, 1);				//	VDV and VRH command Enable
+    ST7789_WriteCommand (ctx, &reg, 1);				//	VDV and VRH command Enable
     {
         	uint8_t data[] = {0x01, 0xC3}; //LITTLE ENDIAN
-        	ST7789_WriteData(data, sizeof(data));
+        	ST7789_WriteData(ctx, data, sizeof(data));
     }
 
 //    ST7789_WriteCommand (ST7789_VRH_SET);				//	VRH set
 //    ST7789_WriteSmallData (0x12);			//	+-4.45v (defalut +-4.1v for 0x0B)
     reg = ST7789_VDV_SET;
-    ST7789_WriteCommand (&reg, 1);				//	VDV set
-    ST7789_WriteSmallData (0x20);			//	Default value
+    ST7789_WriteCommand (ctx, &reg, 1);				//	VDV set
+    ST7789_WriteSmallData (ctx, 0x20);			//	Default value
 
     reg = ST7789_POWER_CTRL;
-    ST7789_WriteCommand (&reg, 1);				//	Power control
-    ST7789_WriteSmallData (0xA4);			//	Default value
-    ST7789_WriteSmallData (0xA1);			//	Default value
+    ST7789_WriteCommand (ctx, &reg, 1);				//	Power control
+    ST7789_WriteSmallData (ctx, 0xA4);			//	Default value
+    ST7789_WriteSmallData (ctx, 0xA1);			//	Default value
 	/**************** Division line ****************/
 
     reg = ST7789_PV_GAMMA_CTRL;
-	ST7789_WriteCommand(&reg, 1);
+	ST7789_WriteCommand(ctx, &reg, 1);
 	{
 		uint8_t data[] = {0xD0, 0x04, 0x0D, 0x11, 0x13, 0x2B, 0x3F, 0x54, 0x4C, 0x18, 0x0D, 0x0B, 0x1F, 0x23};
 //		uint8_t data[] = {0xD0, 0x08, 0x11, 0x08, 0x0C, 0x15, 0x39, 0x33, 0x50, 0x36, 0x13, 0x14, 0x29, 0x2D};
-		ST7789_WriteData(data, sizeof(data));
+		ST7789_WriteData(ctx, data, sizeof(data));
 	}
 
 	reg = ST7789_NV_GAMMA_CTRL;
-    ST7789_WriteCommand(&reg, 1);
+    ST7789_WriteCommand(ctx, &reg, 1);
 	{
 		uint8_t data[] = {0xD0, 0x04, 0x0C, 0x11, 0x13, 0x2C, 0x3F, 0x44, 0x51, 0x2F, 0x1F, 0x1F, 0x20, 0x23};
 //    	uint8_t data[] = {0xD0, 0x08, 0x10, 0x08, 0x06, 0x06, 0x39, 0x44, 0x51, 0x0B, 0x16, 0x14, 0x2F, 0x31};
-		ST7789_WriteData(data, sizeof(data));
+		ST7789_WriteData(ctx, data, sizeof(data));
 	}
 
 	reg = ST7789_INVON;
-    ST7789_WriteCommand (&reg, 1);		//	Inversion ON
+    ST7789_WriteCommand (ctx, &reg, 1);		//	Inversion ON
 
 	reg = ST7789_TEON;
-	ST7789_WriteCommand (&reg, 1);		//	Tear effect ON
-	ST7789_WriteSmallData(0x00);
+	ST7789_WriteCommand (ctx, &reg, 1);		//	Tear effect ON
+	ST7789_WriteSmallData(ctx, 0x00);
 
     reg = ST7789_DISPON;
-  	ST7789_WriteCommand (&reg, 1);	//	Main screen turned on
-	vTaskDelay(100);
+  	ST7789_WriteCommand (ctx, &reg, 1);	//	Main screen turned on
+	ST7789_Delay(100);
+
+    ST7789_Fill_Color(BLACK);				//	Fill with Black.
+	if (cfg->bl_pin >= 0) {
+		ST7789_WaitIdle();
+		ST7789_Port_SetPin(ctx, cfg->bl_pin, 1);
+	}
+
+	ST7789_UnSelect();
+	return ESP_OK;
+}
+
+/**
+ * @brief Free what ST7789_Display_Init allocated for the display of the
+ *        calling task
+ * @param ctx -> display of the calling task
+ * @return none
+ */
+static void ST7789_Display_Free(st7789_ctx_t *ctx)
+{
+	if (ctx->port_open) {
+		ST7789_Port_Close(ctx);
+		st7789_bus.panels--;
+	}
+	for (uint8_t i = 0; i < ST7789_DMA_QUEUE_SIZE; i++)
+		heap_caps_free(ctx->dma_buf[i]);
+	heap_caps_free(ctx->fill_buf);
+	if (ctx->lock)
+		vSemaphoreDelete(ctx->lock);
+}
+
+/**
+ * @brief Run ST7789_Display_Init for a display
+ * @param ctx -> display state
+ * @param cfg -> pins and geometry
+ * @return ESP_OK or an error of ST7789_Display_Init
+ */
+static esp_err_t ST7789_Display_Setup(st7789_ctx_t *ctx, const st7789_config_t *cfg)
+{
+	st7789_handle_t prev = pvTaskGetThreadLocalStoragePointer(NULL, ST7789_TLS_INDEX);
+	esp_err_t err;
+
+	vTaskSetThreadLocalStoragePointer(NULL, ST7789_TLS_INDEX, ctx);
+	err = ST7789_Display_Init(ctx, cfg);
+	if (err != ESP_OK && ctx != &st7789_main)
+		ST7789_Display_Free(ctx);
+	else if (err == ESP_OK) {
+		/* Linked once, ST7789_Init may set the main display up again */
+		st7789_ctx_t *d = st7789_bus.displays;
+
+		while (d && d != ctx)
+			d = d->next;
+		if (d == NULL) {
+			ctx->next = st7789_bus.displays;
+			__atomic_store_n(&st7789_bus.displays, ctx, __ATOMIC_RELEASE);
+		}
+	}
+	vTaskSetThreadLocalStoragePointer(NULL, ST7789_TLS_INDEX, prev);
+	return err;
+}
+
+/**
+ * @brief Initialize ST7789 controller
+ * @note  Sets up the display tasks draw to until they pick another one with
+ *        ST7789_Display_Use, with the pins defined in st7789.h.
+ * @param height Display height as you see
+ * @param width Display width as you see
+ * @param rot Displat orientation, landscape ore portrait
+ * @return none
+ */
+void ST7789_Init(uint16_t height, uint16_t width, uint8_t rot)
+{
+	st7789_config_t cfg = {
+		.cs_pin = ST7789_CS_PIN,
+		.dc_pin = ST7789_DC_PIN,
+		.rst_pin = -1,			// Reset and backlight are not driven
+		.bl_pin = -1,
+		.clock_hz = SPI_BUS_SPEED,
+		.height = height,
+		.width = width,
+		.rotation = rot,
+	};
+
+	ESP_ERROR_CHECK(ST7789_Display_Setup(&st7789_main, &cfg));
+}
+
+/**
+ * @brief Add a panel on the SPI bus of the driver
+ * @note  The panel gets its own state: render target, framebuffer, scroll
+ *        and power settings, glyph cache and lock. Draw to it from a task
+ *        after ST7789_Display_Use. Panels on the same bus take turns every
+ *        ST7789_BUS_SLICE transactions, so a long blit on one does not hold
+ *        up a small update on the other.
+ * @param cfg -> pins and geometry of the panel
+ * @param disp -> handle of the display
+ * @return ESP_OK, ESP_ERR_NO_MEM, or an error of the SPI driver
+ */
+esp_err_t ST7789_Display_Add(const st7789_config_t *cfg, st7789_handle_t *disp)
+{
+	st7789_ctx_t *ctx = heap_caps_calloc(1, sizeof(*ctx), MALLOC_CAP_8BIT);
+	esp_err_t err;
+
+	if (ctx == NULL)
+		return ESP_ERR_NO_MEM;
+	err = ST7789_Display_Setup(ctx, cfg);
+	if (err != ESP_OK) {
+		heap_caps_free(ctx);
+		return err;
+	}
+	*disp = ctx;
+	return ESP_OK;
+}
+
+/**
+ * @brief Choose the display the calling task draws to
+ * @note  Every task starts on the display of ST7789_Init. Not while holding
+ *        the lock of a display, see ST7789_Lock.
+ * @param disp -> display handle, NULL for the display of ST7789_Init
+ * @return none
+ */
+void ST7789_Display_Use(st7789_handle_t disp)
+{
+	vTaskSetThreadLocalStoragePointer(NULL, ST7789_TLS_INDEX, disp);
+}
 
-    ST7789_Fill_Color(BLACK);				//	Fill with Black.
+/**
+ * @brief Display the calling task draws to
+ * @return display handle
+ */
+st7789_handle_t ST7789_Display_Current(void)
+{
+	return ST7789_Ctx();
 }
 
 /**
@@ -361,21 +1116,9 @@ void ST7789_Init(uint16_t height, uint16_t width, uint8_t rot)
  */
 void ST7789_Fill_Color(uint16_t color)
 {
-	ST7789_SetAddressWindow(0, 0, st7789_ctx.width, st7789_ctx.height);
-	ST7789_Select();
+	st7789_ctx_t *ctx = ST7789_Ctx();
 
-	#ifdef USE_DMA //Usa un unico trasferimento nel caso di DMA
-		MemsetBuffer(st7789_ctx.disp_buf, color, sizeof(st7789_ctx.disp_buf)/2);
-		ST7789_WriteData((uint8_t*)st7789_ctx.disp_buf, sizeof(st7789_ctx.disp_buf));
-	#else
-		uint16_t j=0,i=0;
-		for (i = 0; i < st7789_ctx.width; i++)
-				for (j = 0; j < st7789_ctx.height; j++) {
-					uint8_t data[] = {color >> 8, color & 0xFF};
-					ST7789_WriteData(data, sizeof(data));
-				}
-	#endif
-	ST7789_UnSelect();
+	ST7789_FillArea(0, 0, ctx->width - 1, ctx->height - 1, color);
 }
 
 /**
@@ -386,14 +1129,12 @@ void ST7789_Fill_Color(uint16_t color)
  */
 void ST7789_DrawPixel(uint16_t x, uint16_t y, uint16_t color)
 {
-	if ((x >= st7789_ctx.width) || (y >= st7789_ctx.height))	
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if ((x >= ctx->width) || (y >= ctx->height))	
 		return;
 	
-	ST7789_SetAddressWindow(x, y, x, y);
-	uint8_t data[] = {color >> 8, color & 0xFF};
-	ST7789_Select();
-	ST7789_WriteData(data, sizeof(data));
-	ST7789_UnSelect();
+	ST7789_FillArea(x, y, x, y, color);
 }
 
 /**
@@ -405,17 +1146,11 @@ void ST7789_DrawPixel(uint16_t x, uint16_t y, uint16_t color)
  */
 void ST7789_Fill(uint16_t xSta, uint16_t ySta, uint16_t xEnd, uint16_t yEnd, uint16_t color)
 {
-	if ((xEnd >= st7789_ctx.width) || (yEnd >= st7789_ctx.height))	
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if ((xEnd >= ctx->width) || (yEnd >= ctx->height))	
 		return;
-	ST7789_Select();
-	uint16_t i, j;
-	ST7789_SetAddressWindow(xSta, ySta, xEnd, yEnd);
-	for (i = ySta; i <= yEnd; i++)
-		for (j = xSta; j <= xEnd; j++) {
-			uint8_t data[] = {color >> 8, color & 0xFF};
-			ST7789_WriteData(data, sizeof(data));
-		}
-	ST7789_UnSelect();
+	ST7789_FillArea(xSta, ySta, xEnd, yEnd, color);
 }
 
 /**
@@ -426,73 +1161,111 @@ void ST7789_Fill(uint16_t xSta, uint16_t ySta, uint16_t xEnd, uint16_t yEnd, uin
  */
 void ST7789_DrawPixel_4px(uint16_t x, uint16_t y, uint16_t color)
 {
-	if ((x <= 0) || (x > st7789_ctx.width) ||
-		 (y <= 0) || (y > st7789_ctx.height))	return;
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if ((x <= 0) || (x > ctx->width) ||
+		 (y <= 0) || (y > ctx->height))	return;
 	ST7789_Select();
 	ST7789_Fill(x - 1, y - 1, x + 1, y + 1, color);
 	ST7789_UnSelect();
 }
 
 /**
- * @brief Draw a line with single color
- * @param x1&y1 -> coordinate of the start point
- * @param x2&y2 -> coordinate of the end point
- * @param color -> color of the line to Draw
+ * @brief Walk a line with Bresenham, one run of pixels at a time
+ * @note  Pixels are the same ST7789_DrawLine always plotted, grouped in
+ *        horizontal runs for x-major lines and vertical runs for steep ones.
+ * @param x0&y0 -> coordinate of the start point
+ * @param x1&y1 -> coordinate of the end point
+ * @param run -> called with the inclusive ends of every run
+ * @param arg -> passed to run
  * @return none
  */
-void ST7789_DrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1,
-        uint16_t color) {
-	uint16_t swap;
-    uint16_t steep = ABS(y1 - y0) > ABS(x1 - x0);
-    if (steep) {
-		swap = x0;
-		x0 = y0;
-		y0 = swap;
-
-		swap = x1;
-		x1 = y1;
-		y1 = swap;
-        //_swap_int16_t(x0, y0);
-        //_swap_int16_t(x1, y1);
-    }
+static void ST7789_WalkLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+		void (*run)(int32_t xa, int32_t ya, int32_t xb, int32_t yb, void *arg), void *arg)
+{
+	int32_t swap;
+	uint8_t steep = ABS(y1 - y0) > ABS(x1 - x0);
 
-    if (x0 > x1) {
-		swap = x0;
-		x0 = x1;
-		x1 = swap;
+	if (steep) {
+		swap = x0; x0 = y0; y0 = swap;
+		swap = x1; x1 = y1; y1 = swap;
+	}
+	if (x0 > x1) {
+		swap = x0; x0 = x1; x1 = swap;
+		swap = y0; y0 = y1; y1 = swap;
+	}
 
-		swap = y0;
-		y0 = y1;
-		y1 = swap;
-        //_swap_int16_t(x0, x1);
-        //_swap_int16_t(y0, y1);
-    }
+	int32_t dx = x1 - x0;
+	int32_t dy = ABS(y1 - y0);
+	int32_t err = dx / 2;
+	int32_t ystep = (y0 < y1) ? 1 : -1;
+	int32_t start = x0;
+
+	for (int32_t x = x0; x <= x1; x++) {
+		err -= dy;
+		if (err < 0 || x == x1) {
+			if (steep)
+				run(y0, start, y0, x, arg);
+			else
+				run(start, y0, x, y0, arg);
+			y0 += ystep;
+			err += dx;
+			start = x + 1;
+		}
+	}
+}
 
-    int16_t dx, dy;
-    dx = x1 - x0;
-    dy = ABS(y1 - y0);
+static void ST7789_SpanEdge(int32_t xa, int32_t ya, int32_t xb, int32_t yb, void *arg)
+{
+	st7789_spans_t *sp = arg;
+
+	for (int32_t y = ya; y <= yb; y++) {
+		if (y < 0 || y >= sp->rows)
+			continue;
+		if (y < sp->ymin) sp->ymin = y;
+		if (y > sp->ymax) sp->ymax = y;
+		if (xa < sp->xmin[y]) sp->xmin[y] = xa < INT16_MIN ? INT16_MIN : xa;
+		if (xb > sp->xmax[y]) sp->xmax[y] = xb > INT16_MAX ? INT16_MAX : xb;
+	}
+}
 
-    int16_t err = dx / 2;
-    int16_t ystep;
+static void ST7789_FillRun(int32_t xa, int32_t ya, int32_t xb, int32_t yb, void *arg)
+{
+	ST7789_FillArea(xa, ya, xb, yb, *(uint16_t *)arg);
+}
 
-    if (y0 < y1) {
-        ystep = 1;
-    } else {
-        ystep = -1;
-    }
+/**
+ * @brief Draw a line with single color
+ * @note  The part outside the render target is clipped, a line entirely
+ *        outside is not walked at all.
+ * @param x1&y1 -> coordinate of the start point
+ * @param x2&y2 -> coordinate of the end point
+ * @param color -> color of the line to Draw
+ * @return none
+ */
+void ST7789_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+        uint16_t color) {
+	st7789_rect_t r = {
+		x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+		x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0,
+	};
 
-    for (; x0<=x1; x0++) {
-        if (steep) {
-            ST7789_DrawPixel(y0, x0, color);
-        } else {
-            ST7789_DrawPixel(x0, y0, color);
-        }
-        err -= dy;
-        if (err < 0) {
-            y0 += ystep;
-            err += dx;
-        }
-    }
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_LINE);
+	if (!ST7789_ClipToTarget(&r)) {
+		ST7789_UnSelect();
+		return;
+	}
+	if (x0 == x1 || y0 == y1) {
+		/* Axis aligned, a single window */
+		ST7789_FillArea(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+				x0 < x1 ? x1 : x0, y0 < y1 ? y1 : y0, color);
+	}
+	else {
+		/* One window per horizontal or vertical run */
+		ST7789_WalkLine(x0, y0, x1, y1, ST7789_FillRun, &color);
+	}
+	ST7789_UnSelect();
 }
 
 /**
@@ -501,9 +1274,10 @@ void ST7789_DrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1,
  * @param color -> color of the Rectangle line
  * @return none
  */
-void ST7789_DrawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color)
+void ST7789_DrawRectangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
 {
 	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_RECT);
 	ST7789_DrawLine(x1, y1, x2, y1, color);
 	ST7789_DrawLine(x1, y1, x1, y2, color);
 	ST7789_DrawLine(x1, y2, x2, y2, color);
@@ -511,6 +1285,21 @@ void ST7789_DrawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ui
 	ST7789_UnSelect();
 }
 
+static void ST7789_CircleRuns(int16_t x0, int16_t y0, int16_t xs, int16_t xe, int16_t y, uint16_t color)
+{
+	/* Octants stepping along x, horizontal runs */
+	ST7789_FillArea(x0 + xs, y0 + y, x0 + xe, y0 + y, color);
+	ST7789_FillArea(x0 - xe, y0 + y, x0 - xs, y0 + y, color);
+	ST7789_FillArea(x0 + xs, y0 - y, x0 + xe, y0 - y, color);
+	ST7789_FillArea(x0 - xe, y0 - y, x0 - xs, y0 - y, color);
+
+	/* Octants stepping along y, vertical runs */
+	ST7789_FillArea(x0 + y, y0 + xs, x0 + y, y0 + xe, color);
+	ST7789_FillArea(x0 - y, y0 + xs, x0 - y, y0 + xe, color);
+	ST7789_FillArea(x0 + y, y0 - xe, x0 + y, y0 - xs, color);
+	ST7789_FillArea(x0 - y, y0 - xe, x0 - y, y0 - xs, color);
+}
+
 /** 
  * @brief Draw a circle with single color
  * @param x0&y0 -> coordinate of circle center
@@ -518,22 +1307,21 @@ void ST7789_DrawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ui
  * @param color -> color of circle line
  * @return  none
  */
-void ST7789_DrawCircle(uint16_t x0, uint16_t y0, uint8_t r, uint16_t color)
+void ST7789_DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
 {
 	int16_t f = 1 - r;
 	int16_t ddF_x = 1;
 	int16_t ddF_y = -2 * r;
 	int16_t x = 0;
 	int16_t y = r;
+	int16_t xs = 0;		// First x of the run at the current y
 
 	ST7789_Select();
-	ST7789_DrawPixel(x0, y0 + r, color);
-	ST7789_DrawPixel(x0, y0 - r, color);
-	ST7789_DrawPixel(x0 + r, y0, color);
-	ST7789_DrawPixel(x0 - r, y0, color);
-
+	ST7789_Trace_Call(ST7789_TRACE_CIRCLE);
 	while (x < y) {
 		if (f >= 0) {
+			ST7789_CircleRuns(x0, y0, xs, x, y, color);
+			xs = x + 1;
 			y--;
 			ddF_y += 2;
 			f += ddF_y;
@@ -541,40 +1329,22 @@ void ST7789_DrawCircle(uint16_t x0, uint16_t y0, uint8_t r, uint16_t color)
 		x++;
 		ddF_x += 2;
 		f += ddF_x;
-
-		ST7789_DrawPixel(x0 + x, y0 + y, color);
-		ST7789_DrawPixel(x0 - x, y0 + y, color);
-		ST7789_DrawPixel(x0 + x, y0 - y, color);
-		ST7789_DrawPixel(x0 - x, y0 - y, color);
-
-		ST7789_DrawPixel(x0 + y, y0 + x, color);
-		ST7789_DrawPixel(x0 - y, y0 + x, color);
-		ST7789_DrawPixel(x0 + y, y0 - x, color);
-		ST7789_DrawPixel(x0 - y, y0 - x, color);
 	}
+	ST7789_CircleRuns(x0, y0, xs, x, y, color);
 	ST7789_UnSelect();
 }
 
 /**
  * @brief Draw an Image on the screen
+ * @note  The part outside the render target is clipped.
  * @param x&y -> start point of the Image
  * @param w&h -> width & height of the Image to Draw
  * @param data -> pointer of the Image array
  * @return none
  */
-void ST7789_DrawImage(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+void ST7789_DrawImage(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data)
 {
-	if ((x >= st7789_ctx.width) || (y >= st7789_ctx.height))
-		return;
-	if ((x + w - 1) >= st7789_ctx.width)
-		return;
-	if ((y + h - 1) >= st7789_ctx.height)
-		return;
-
-	ST7789_Select();
-	ST7789_SetAddressWindow(x, y, x + w - 1, y + h - 1);
-	ST7789_WriteData((uint8_t *)data, 2 * w * h);
-	ST7789_UnSelect();
+	ST7789_BlitArea(x, y, w, h, data);
 }
 
 /**
@@ -584,9 +1354,11 @@ void ST7789_DrawImage(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint
  */
 void ST7789_InvertColors(uint8_t invert)
 {
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
 	ST7789_Select();
 	uint8_t reg = invert ? 0x21 /* INVON */ : 0x20 /* INVOFF */;
-	ST7789_WriteCommand(&reg, 1);
+	ST7789_WriteCommand(ctx, &reg, 1);
 	ST7789_UnSelect();
 }
 
@@ -599,30 +1371,81 @@ void ST7789_InvertColors(uint8_t invert)
  * @param bgcolor -> background color of the char
  * @return  none
  */
-void ST7789_WriteChar(uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor)
+void ST7789_WriteChar(int16_t x, int16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor)
 {
-	uint32_t i, b, j;
-	ST7789_Select();
-	ST7789_SetAddressWindow(x, y, x + font.width - 1, y + font.height - 1);
-
-	for (i = 0; i < font.height; i++) {
-		b = font.data[(ch - 32) * font.height + i];
-		for (j = 0; j < font.width; j++) {
-			if ((b << j) & 0x8000) {
-				uint8_t data[] = {color >> 8, color & 0xFF};
-				ST7789_WriteData(data, sizeof(data));
-			}
-			else {
-				uint8_t data[] = {bgcolor >> 8, bgcolor & 0xFF};
-				ST7789_WriteData(data, sizeof(data));
-			}
+	uint16_t scratch[16 * 26];	// Largest FontDef is 16x26
+	const uint16_t *glyph;
+
+	if ((uint32_t)font.width * font.height > sizeof(scratch) / sizeof(scratch[0]))
+		return;
+
+	ST7789_Select();	// The glyph may live in the shared cache
+	ST7789_Trace_Call(ST7789_TRACE_TEXT);
+	glyph = ST7789_Glyph_Get(&font, ch, color, bgcolor, scratch);
+	ST7789_BlitArea(x, y, font.width, font.height, (const uint8_t *)glyph);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Get the text strip, large enough for a line of glyphs
+ * @param pixels -> pixels the strip must hold
+ * @return the strip, NULL if it cannot be allocated
+ */
+uint16_t *ST7789_TextStrip(uint32_t pixels)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if (pixels <= ctx->text_len)
+		return ctx->text_buf;
+
+	heap_caps_free(ctx->text_buf);
+	ctx->text_buf = heap_caps_malloc(pixels * 2, MALLOC_CAP_8BIT);
+	ctx->text_len = ctx->text_buf ? pixels : 0;
+	return ctx->text_buf;
+}
+
+/**
+ * @brief Write the chars of a string that fit on one line, in a single block
+ * @param  x&y -> cursor of the start point.
+ * @param str -> chars to write
+ * @param n -> number of chars
+ * @param font -> fontstyle of the string
+ * @param color -> color of the string
+ * @param bgcolor -> background color of the string
+ * @return  none
+ */
+static void ST7789_WriteLine(int16_t x, int16_t y, const char *str, uint16_t n, FontDef *font, uint16_t color, uint16_t bgcolor)
+{
+	uint16_t scratch[16 * 26];	// Largest FontDef is 16x26
+	uint16_t w = n * font->width;
+	uint16_t *strip;
+
+	if ((uint32_t)font->width * font->height > sizeof(scratch) / sizeof(scratch[0]))
+		return;
+
+	strip = ST7789_TextStrip((uint32_t)w * font->height);
+	if (strip == NULL) {
+		for (uint16_t i = 0; i < n; i++)
+			ST7789_WriteChar(x + i * font->width, y, str[i], *font, color, bgcolor);
+		return;
+	}
+
+	for (uint16_t i = 0; i < n; i++) {
+		const uint16_t *glyph = ST7789_Glyph_Get(font, str[i], color, bgcolor, scratch);
+		uint16_t *dst = strip + i * font->width;
+		for (uint8_t row = 0; row < font->height; row++) {
+			memcpy(dst, glyph, font->width * 2);
+			glyph += font->width;
+			dst += w;
 		}
 	}
-	ST7789_UnSelect();
+	ST7789_BlitArea(x, y, w, font->height, (const uint8_t *)strip);
 }
 
 /** 
  * @brief Write a string 
+ * @note  The chars of each line are composed from cached glyphs and sent in a
+ *        single address window.
  * @param  x&y -> cursor of the start point.
  * @param str -> string to write
  * @param font -> fontstyle of the string
@@ -630,14 +1453,17 @@ void ST7789_WriteChar(uint16_t x, uint16_t y, char ch, FontDef font, uint16_t co
  * @param bgcolor -> background color of the string
  * @return  none
  */
-void ST7789_WriteString(uint16_t x, uint16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor)
+void ST7789_WriteString(int16_t x, int16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor)
 {
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
 	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_TEXT);
 	while (*str) {
-		if (x + font.width >= st7789_ctx.width) {
+		if (x + font.width >= ctx->width) {
 			x = 0;
 			y += font.height;
-			if (y + font.height >= st7789_ctx.height) {
+			if (y + font.height >= ctx->height) {
 				break;
 			}
 
@@ -647,46 +1473,34 @@ void ST7789_WriteString(uint16_t x, uint16_t y, const char *str, FontDef font, u
 				continue;
 			}
 		}
-		ST7789_WriteChar(x, y, *str, font, color, bgcolor);
-		x += font.width;
-		str++;
+
+		/* Chars written before the line wraps */
+		uint16_t n = 0;
+		while (str[n] && x + (n + 1) * font.width < ctx->width)
+			n++;
+		if (n == 0)
+			continue;
+
+		ST7789_WriteLine(x, y, str, n, &font, color, bgcolor);
+		x += n * font.width;
+		str += n;
 	}
 	ST7789_UnSelect();
 }
 
 /** 
  * @brief Draw a filled Rectangle with single color
+ * @note  The part outside the render target is clipped.
  * @param  x&y -> coordinates of the starting point
  * @param w&h -> width & height of the Rectangle
  * @param color -> color of the Rectangle
  * @return  none
  */
-void ST7789_DrawFilledRectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+void ST7789_DrawFilledRectangle(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t color)
 {
-	ST7789_Select();
-	uint8_t i;
-
-	/* Check input parameters */
-	if (x >= st7789_ctx.width ||
-		y >= st7789_ctx.height) {
-		/* Return error */
-		return;
-	}
-
-	/* Check width and height */
-	if ((x + w) >= st7789_ctx.width) {
-		w = st7789_ctx.width - x;
-	}
-	if ((y + h) >= st7789_ctx.height) {
-		h = st7789_ctx.height - y;
-	}
-
-	/* Draw lines */
-	for (i = 0; i <= h; i++) {
-		/* Draw lines */
-		ST7789_DrawLine(x, y + i, x + w, y + i, color);
-	}
-	ST7789_UnSelect();
+	/* One window for the whole box, covering w + 1 columns and h + 1 rows */
+	ST7789_FillArea(x, y, (int32_t)x + w > INT16_MAX ? INT16_MAX : x + w,
+			(int32_t)y + h > INT16_MAX ? INT16_MAX : y + h, color);
 }
 
 /** 
@@ -695,9 +1509,10 @@ void ST7789_DrawFilledRectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
  * @param color ->color of the lines
  * @return  none
  */
-void ST7789_DrawTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3, uint16_t color)
+void ST7789_DrawTriangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color)
 {
 	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_TRIANGLE);
 	/* Draw lines */
 	ST7789_DrawLine(x1, y1, x2, y2, color);
 	ST7789_DrawLine(x2, y2, x3, y3, color);
@@ -711,65 +1526,29 @@ void ST7789_DrawTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uin
  * @param color ->color of the triangle
  * @return  none
  */
-void ST7789_DrawFilledTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3, uint16_t color)
+void ST7789_DrawFilledTriangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color)
 {
-	ST7789_Select();
-	int16_t deltax = 0, deltay = 0, x = 0, y = 0, xinc1 = 0, xinc2 = 0,
-			yinc1 = 0, yinc2 = 0, den = 0, num = 0, numadd = 0, numpixels = 0,
-			curpixel = 0;
-
-	deltax = ABS(x2 - x1);
-	deltay = ABS(y2 - y1);
-	x = x1;
-	y = y1;
-
-	if (x2 >= x1) {
-		xinc1 = 1;
-		xinc2 = 1;
-	}
-	else {
-		xinc1 = -1;
-		xinc2 = -1;
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_spans_t *sp;
+
+	ST7789_Select();	// The span table belongs to the display
+	ST7789_Trace_Call(ST7789_TRACE_FILLED_TRIANGLE);
+	sp = &ctx->spans;
+	sp->rows = ctx->height;
+	for (uint16_t i = 0; i < sp->rows; i++) {
+		sp->xmin[i] = INT16_MAX;
+		sp->xmax[i] = INT16_MIN;
 	}
+	sp->ymin = INT16_MAX;
+	sp->ymax = INT16_MIN;
 
-	if (y2 >= y1) {
-		yinc1 = 1;
-		yinc2 = 1;
-	}
-	else {
-		yinc1 = -1;
-		yinc2 = -1;
-	}
+	/* Rows span between the outermost pixels of the three edges */
+	ST7789_WalkLine(x1, y1, x2, y2, ST7789_SpanEdge, sp);
+	ST7789_WalkLine(x2, y2, x3, y3, ST7789_SpanEdge, sp);
+	ST7789_WalkLine(x3, y3, x1, y1, ST7789_SpanEdge, sp);
 
-	if (deltax >= deltay) {
-		xinc1 = 0;
-		yinc2 = 0;
-		den = deltax;
-		num = deltax / 2;
-		numadd = deltay;
-		numpixels = deltax;
-	}
-	else {
-		xinc2 = 0;
-		yinc1 = 0;
-		den = deltay;
-		num = deltay / 2;
-		numadd = deltax;
-		numpixels = deltay;
-	}
-
-	for (curpixel = 0; curpixel <= numpixels; curpixel++) {
-		ST7789_DrawLine(x, y, x3, y3, color);
-
-		num += numadd;
-		if (num >= den) {
-			num -= den;
-			x += xinc1;
-			y += yinc1;
-		}
-		x += xinc2;
-		y += yinc2;
-	}
+	for (int16_t y = sp->ymin; y <= sp->ymax; y++)
+		ST7789_FillArea(sp->xmin[y], y, sp->xmax[y], y, color);
 	ST7789_UnSelect();
 }
 
@@ -783,17 +1562,14 @@ void ST7789_DrawFilledTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y
 void ST7789_DrawFilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
 {
 	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_FILLED_CIRCLE);
 	int16_t f = 1 - r;
 	int16_t ddF_x = 1;
 	int16_t ddF_y = -2 * r;
 	int16_t x = 0;
 	int16_t y = r;
 
-	ST7789_DrawPixel(x0, y0 + r, color);
-	ST7789_DrawPixel(x0, y0 - r, color);
-	ST7789_DrawPixel(x0 + r, y0, color);
-	ST7789_DrawPixel(x0 - r, y0, color);
-	ST7789_DrawLine(x0 - r, y0, x0 + r, y0, color);
+	ST7789_FillArea(x0 - r, y0, x0 + r, y0, color);
 
 	while (x < y) {
 		if (f >= 0) {
@@ -804,17 +1580,25 @@ void ST7789_DrawFilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
 		x++;
 		ddF_x += 2;
 		f += ddF_x;
-
-		ST7789_DrawLine(x0 - x, y0 + y, x0 + x, y0 + y, color);
-		ST7789_DrawLine(x0 + x, y0 - y, x0 - x, y0 - y, color);
-
-		ST7789_DrawLine(x0 + y, y0 + x, x0 - y, y0 + x, color);
-		ST7789_DrawLine(x0 + y, y0 - x, x0 - y, y0 - x, color);
+		/* Crossed the diagonal, the last step filled these rows already,
+		 * unless this is the first: then rows y0 +- y are the center row */
+		if (x > y && x > 1)
+			break;
+
+		/* Rows y0 +- y get their widest span when y is about to change */
+		if ((f >= 0 || x >= y) && x <= y) {
+			ST7789_FillArea(x0 - x, y0 + y, x0 + x, y0 + y, color);
+			ST7789_FillArea(x0 - x, y0 - y, x0 + x, y0 - y, color);
+		}
+		/* Rows y0 +- x are visited once */
+		if (x != y) {
+			ST7789_FillArea(x0 - y, y0 + x, x0 + y, y0 + x, color);
+			ST7789_FillArea(x0 - y, y0 - x, x0 + y, y0 - x, color);
+		}
 	}
 	ST7789_UnSelect();
 }
 
-
 /**
  * @brief Open/Close tearing effect line
  * @param tear -> Whether to tear
@@ -822,104 +1606,383 @@ void ST7789_DrawFilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
  */
 void ST7789_TearEffect(uint8_t tear)
 {
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
 	ST7789_Select();
 	uint8_t reg = tear ? 0x35 /* TEON */ : 0x34 /* TEOFF */;
-	ST7789_WriteCommand(&reg ,1);
+	ST7789_WriteCommand(ctx, &reg ,1);
 	ST7789_UnSelect();
 }
 
 /**
- *
+ * @brief Scroll axis of the current rotation
+ * @param ctx -> display
+ * @return 1 when the hardware scrolls screen columns (landscape), 0 for rows
+ */
+static uint8_t ST7789_Scroll_AxisX(st7789_ctx_t *ctx)
+{
+	return ctx->rotation == ROT_LANDSCAPE || ctx->rotation == ROT_LANDSCAPE_180;
+}
+
+/**
+ * @brief Direction of the controller lines for the current rotation
+ * @note  VSCRDEF, VSCRSADD and PTLAR count the 320 lines of the controller
+ *        memory, whatever MADCTL does. Rotations that mirror the scroll axis
+ *        map the screen to the end of the memory, in reverse.
+ * @param ctx -> display
+ * @return 1 when the first line of the screen is the last controller line
+ */
+static uint8_t ST7789_LinesMirrored(st7789_ctx_t *ctx)
+{
+	return ctx->rotation == ROT_PORTRAIT || ctx->rotation == ROT_LANDSCAPE_180;
+}
+
+/**
+ * @brief First controller line of the scrolling area
+ * @param ctx -> display
+ * @return line
+ */
+static uint16_t ST7789_Scroll_FirstLine(st7789_ctx_t *ctx)
+{
+	uint16_t size = ST7789_Scroll_AxisX(ctx) ? ctx->width : ctx->height;
+	uint16_t bottom = size - ctx->scroll_top - ctx->scroll_len;
+
+	if (ST7789_LinesMirrored(ctx))
+		return ST7789_GRAM_HEIGHT - size + bottom;
+	return ctx->scroll_top;
+}
+
+/**
+ * @brief Send the scrolling area and start line to the controller
+ * @param ctx -> display
+ * @param tfa&vsa -> fixed lines before the area and lines of the area, in
+ *        controller lines
+ * @param ssa -> controller line shown first in the area
+ * @return none
  */
-void ST7789_VerticalScroll(uint16_t pixel)
+static void ST7789_Scroll_Send(st7789_ctx_t *ctx, uint16_t tfa, uint16_t vsa, uint16_t ssa)
 {
+	uint16_t bfa = ST7789_GRAM_HEIGHT - tfa - vsa;
+	uint8_t def[] = {tfa >> 8, tfa & 0xFF, vsa >> 8, vsa & 0xFF, bfa >> 8, bfa & 0xFF};
 	uint8_t reg = ST7789_VSCRDEF;
-	ST7789_WriteCommand(&reg ,1);
-	ST7789_WriteSmallData (0x00);
-	ST7789_WriteSmallData (0x00);
-	ST7789_WriteSmallData (0x01);
-	ST7789_WriteSmallData (0x40);
-	ST7789_WriteSmallData (0x00);
-	ST7789_WriteSmallData (0x00);
 
+	ST7789_Select();
+	ST7789_WriteCommand(ctx, &reg, 1);
+	ST7789_WriteData(ctx, def, sizeof(def));
 	reg = ST7789_VSCRSADD;
-	ST7789_WriteCommand(&reg , 1);
-	pixel = ( 319 - 10 ) - pixel;
-	ST7789_WriteSmallData (pixel >> 8);
-	ST7789_WriteSmallData (pixel);
+	ST7789_WriteCommand(ctx, &reg, 1);
+	ST7789_WriteSmallData(ctx, ssa >> 8);
+	ST7789_WriteSmallData(ctx, ssa & 0xFF);
+	ST7789_UnSelect();
 }
 
+/**
+ * @brief Define the area moved by hardware scrolling
+ * @note  The area spans the screen between top and bottom fixed lines: rows
+ *        in portrait, columns in landscape, where the controller scrolls
+ *        sideways. It starts unscrolled. Scrolling moves what the panel shows,
+ *        not the memory: draw in the area at the positions given by
+ *        ST7789_Scroll_Map().
+ * @param top -> fixed lines at the start of the scroll axis
+ * @param bottom -> fixed lines at its end
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if no line is left to scroll
+ */
+esp_err_t ST7789_Scroll_SetRegion(uint16_t top, uint16_t bottom)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint16_t size = ST7789_Scroll_AxisX(ctx) ? ctx->width : ctx->height;
+	uint16_t first;
+
+	if ((uint32_t)top + bottom >= size)
+		return ESP_ERR_INVALID_ARG;
 
-/** 
- * @brief A Simple test function for ST7789
- * @param  none
- * @return  none
+	ST7789_Select();
+	ctx->scroll_top = top;
+	ctx->scroll_len = size - top - bottom;
+	ctx->scroll_off = 0;
+	first = ST7789_Scroll_FirstLine(ctx);
+	ST7789_Scroll_Send(ctx, first, ctx->scroll_len, first);
+	ST7789_UnSelect();
+	return ESP_OK;
+}
+
+/**
+ * @brief Scroll the content of the area
+ * @note  Only the start line is sent. The lines leaving the area come back
+ *        at its other end, where they should be redrawn with new content.
+ * @param lines -> lines moved towards the top (left in landscape), negative
+ *        to move the other way
+ * @return none
+ */
+void ST7789_Scroll_By(int16_t lines)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint16_t len, ssa;
+	int32_t off;
+	uint8_t reg = ST7789_VSCRSADD;
+
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_SCROLL);
+	len = ctx->scroll_len;
+	if (len == 0) {
+		ST7789_UnSelect();
+		return;
+	}
+	off = ((int32_t)ctx->scroll_off + lines) % len;
+	if (off < 0)
+		off += len;
+	ctx->scroll_off = off;
+
+	ssa = ST7789_Scroll_FirstLine(ctx);
+	if (ST7789_LinesMirrored(ctx))
+		ssa += (len - off) % len;	// Mirrored axis, the memory moves the other way
+	else
+		ssa += off;
+
+	ST7789_WriteCommand(ctx, &reg, 1);
+	ST7789_WriteSmallData(ctx, ssa >> 8);
+	ST7789_WriteSmallData(ctx, ssa & 0xFF);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Position to draw at for a line shown at a screen position
+ * @param pos -> screen row (column in landscape)
+ * @return drawing position, pos itself outside the scrolling area
+ */
+int16_t ST7789_Scroll_Map(int16_t pos)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	int16_t top = ctx->scroll_top;
+
+	if (ctx->scroll_len == 0 || pos < top || pos >= top + ctx->scroll_len)
+		return pos;
+	return top + (pos - top + ctx->scroll_off) % ctx->scroll_len;
+}
+
+/**
+ * @brief Stop scrolling, the panel shows the memory as drawn
+ * @return none
+ */
+void ST7789_Scroll_Reset(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	ctx->scroll_top = 0;
+	ctx->scroll_len = 0;
+	ctx->scroll_off = 0;
+	ST7789_Scroll_Send(ctx, 0, ST7789_GRAM_HEIGHT, 0);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Append a line of text at the bottom of the scrolling area
+ * @note  The area scrolls up by one font height and only the new line is
+ *        drawn, whatever the size of the area: a log or ticker costs one line
+ *        per update instead of the whole view. Chars past the right edge are
+ *        dropped. With the framebuffer, flush right after so the line comes
+ *        with the scroll.
+ * @param x -> column of the first char
+ * @param str -> chars to write
+ * @param font -> fontstyle of the string
+ * @param color -> color of the string
+ * @param bgcolor -> background color of the line
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without a scrolling area or in
+ *         landscape, ESP_ERR_INVALID_ARG if the font is taller than the area
+ */
+esp_err_t ST7789_Scroll_WriteLine(uint16_t x, const char *str, FontDef font, uint16_t color, uint16_t bgcolor)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	int16_t top, end, right, y;
+	st7789_rect_t area;
+	const st7789_rect_t *saved_clip;
+	uint16_t n = 0;
+
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_TEXT);
+	if (ctx->scroll_len == 0 || ST7789_Scroll_AxisX(ctx)) {
+		ST7789_UnSelect();
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (font.height > ctx->scroll_len) {
+		ST7789_UnSelect();
+		return ESP_ERR_INVALID_ARG;
+	}
+	top = ctx->scroll_top;
+	end = top + ctx->scroll_len;
+	right = ctx->width - 1;
+	area = (st7789_rect_t){0, top, right, end - 1};
+
+	while (str[n] && x + (n + 1) * font.width <= ctx->width)
+		n++;
+
+	ST7789_Scroll_By(font.height);
+	y = ST7789_Scroll_Map(end - font.height);
+
+	/* The line may wrap around the end of the area memory, the second pass
+	   draws the part continuing at its top */
+	saved_clip = ctx->clip;
+	ctx->clip = &area;
+	for (uint8_t pass = 0; pass < 2; pass++, y -= ctx->scroll_len) {
+		if (x > 0)
+			ST7789_FillArea(0, y, x - 1, y + font.height - 1, bgcolor);
+		if (n)
+			ST7789_WriteLine(x, y, str, n, &font, color, bgcolor);
+		if (x + n * font.width <= right)
+			ST7789_FillArea(x + n * font.width, y, right, y + font.height - 1, bgcolor);
+		if (y + font.height <= end)
+			break;
+	}
+	ctx->clip = saved_clip;
+	ST7789_UnSelect();
+	return ESP_OK;
+}
+
+/**
+ * @brief Set the frame rate of normal mode
+ * @param ctx -> display
+ * @param rtna -> FRCTRL2 RTNA, 0x00 119 Hz to 0x1F 39 Hz
+ * @return none
+ */
+static void ST7789_Power_SetRate(st7789_ctx_t *ctx, uint8_t rtna)
+{
+	uint8_t reg = ST7789_FRAME_RATE_CTRL2;
+
+	ST7789_Select();
+	ST7789_WriteCommand(ctx, &reg, 1);
+	ST7789_WriteSmallData(ctx, rtna & 0x1F);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Move the panel to a power state
+ * @param ctx -> display
+ * @param state -> new state
+ * @return none
+ */
+static void ST7789_Power_Enter(st7789_ctx_t *ctx, st7789_power_state_t state)
+{
+	st7789_power_cfg_t *cfg = &ctx->power_cfg;
+	st7789_power_state_t old = ctx->power_state;
+	uint8_t reg;
+
+	if (state == old)
+		return;
+	ctx->power_state = state;
+
+	ST7789_Select();
+	if (old == ST7789_POWER_IDLE) {
+		if (cfg->idle_colors) {
+			reg = ST7789_IDMOFF;
+			ST7789_WriteCommand(ctx, &reg, 1);
+		}
+		if (cfg->partial) {
+			reg = ST7789_NORON;
+			ST7789_WriteCommand(ctx, &reg, 1);
+		}
+	}
+	if (state == ST7789_POWER_ACTIVE)
+		ST7789_Power_SetRate(ctx, cfg->active_rate);
+	else if (old == ST7789_POWER_ACTIVE)
+		ST7789_Power_SetRate(ctx, cfg->static_rate);
+	if (state == ST7789_POWER_IDLE) {
+		if (cfg->partial) {
+			uint16_t start = cfg->partial_start, end = cfg->partial_end;
+			if (ST7789_LinesMirrored(ctx)) {
+				start = ST7789_GRAM_HEIGHT - 1 - cfg->partial_end;
+				end = ST7789_GRAM_HEIGHT - 1 - cfg->partial_start;
+			}
+			uint8_t data[] = {start >> 8, start & 0xFF, end >> 8, end & 0xFF};
+			reg = ST7789_PTLAR;
+			ST7789_WriteCommand(ctx, &reg, 1);
+			ST7789_WriteData(ctx, data, sizeof(data));
+			reg = ST7789_PTLON;
+			ST7789_WriteCommand(ctx, &reg, 1);
+		}
+		if (cfg->idle_colors) {
+			reg = ST7789_IDMON;
+			ST7789_WriteCommand(ctx, &reg, 1);
+		}
+	}
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Set the power policy
+ * @note  The panel goes back to full power and the quiet time restarts. The
+ *        default policy, set by ST7789_Init, only lowers the frame rate.
+ * @param cfg -> policy; idle_ms is ignored without idle_colors nor partial
+ * @return none
+ */
+void ST7789_Power_Config(const st7789_power_cfg_t *cfg)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	ST7789_Power_Wake();
+	ctx->power_cfg = *cfg;
+	ST7789_Power_SetRate(ctx, cfg->active_rate);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Step the panel power from the amount of drawing
+ * @note  The pixels sent are counted over windows of ST7789_POWER_WINDOW_MS.
+ *        A window above busy_pixels per second brings back the full frame
+ *        rate, then quiet time lowers it and enters idle mode or partial
+ *        display. Any drawing leaves idle at once, since it changes what the
+ *        panel shows. Call it from the drawing task, e.g. once per frame;
+ *        ST7789_Flush and the animation player do.
+ * @return none
+ */
+void ST7789_Power_Update(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_power_cfg_t *cfg = &ctx->power_cfg;
+	TickType_t now = xTaskGetTickCount();
+	uint32_t ms, quiet;
+
+	ST7789_Select();
+	ms = pdTICKS_TO_MS(now - ctx->power_tick);
+	if (ms < ST7789_POWER_WINDOW_MS) {
+		ST7789_UnSelect();
+		return;
+	}
+	if ((uint64_t)ctx->power_pixels * 1000 >= (uint64_t)cfg->busy_pixels * ms) {
+		ctx->power_busy = now;
+		ST7789_Power_Enter(ctx, ST7789_POWER_ACTIVE);
+	}
+	ctx->power_pixels = 0;
+	ctx->power_tick = now;
+
+	quiet = pdTICKS_TO_MS(now - ctx->power_busy);
+	if (cfg->idle_ms && quiet >= cfg->idle_ms && (cfg->idle_colors || cfg->partial))
+		ST7789_Power_Enter(ctx, ST7789_POWER_IDLE);
+	else if (cfg->static_ms && quiet >= cfg->static_ms && ctx->power_state == ST7789_POWER_ACTIVE)
+		ST7789_Power_Enter(ctx, ST7789_POWER_STATIC);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Go back to full power now, e.g. on user input before drawing
+ * @return none
  */
-void ST7789_Test(void)
-{
-	ST7789_Fill_Color(WHITE);
-	vTaskDelay(1000);
-	ST7789_WriteString(10, 20, "Speed Test", Font_11x18, RED, WHITE);
-	vTaskDelay(1000);
-	ST7789_Fill_Color(CYAN);
-    vTaskDelay(500);
-	ST7789_Fill_Color(RED);
-    vTaskDelay(500);
-	ST7789_Fill_Color(BLUE);
-    vTaskDelay(500);
-	ST7789_Fill_Color(GREEN);
-    vTaskDelay(500);
-	ST7789_Fill_Color(YELLOW);
-    vTaskDelay(500);
-	ST7789_Fill_Color(BROWN);
-    vTaskDelay(500);
-	ST7789_Fill_Color(DARKBLUE);
-    vTaskDelay(500);
-	ST7789_Fill_Color(MAGENTA);
-    vTaskDelay(500);
-	ST7789_Fill_Color(LIGHTGREEN);
-    vTaskDelay(500);
-	ST7789_Fill_Color(LGRAY);
-    vTaskDelay(500);
-	ST7789_Fill_Color(LBBLUE);
-    vTaskDelay(500);
-	ST7789_Fill_Color(WHITE);
-	vTaskDelay(500);
-
-	ST7789_WriteString(10, 10, "Font test.", Font_16x26, GBLUE, WHITE);
-	ST7789_WriteString(10, 50, "Hello!", Font_7x10, RED, WHITE);
-	ST7789_WriteString(10, 75, "Hello!", Font_11x18, YELLOW, WHITE);
-	ST7789_WriteString(10, 100, "Hello!", Font_16x26, MAGENTA, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Rect./Line.", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawRectangle(30, 30, 100, 100, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Filled Rect.", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawFilledRectangle(30, 30, 50, 50, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Circle.", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawCircle(60, 60, 25, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Filled Cir.", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawFilledCircle(60, 60, 25, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Triangle", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawTriangle(30, 30, 30, 70, 60, 40, WHITE);
-	vTaskDelay(1000);
-
-	ST7789_Fill_Color(RED);
-	ST7789_WriteString(10, 10, "Filled Tri", Font_11x18, YELLOW, BLACK);
-	ST7789_DrawFilledTriangle(30, 30, 30, 70, 60, 40, WHITE);
-	vTaskDelay(1000);
+void ST7789_Power_Wake(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	ctx->power_busy = xTaskGetTickCount();
+	ST7789_Power_Enter(ctx, ST7789_POWER_ACTIVE);
+	ST7789_UnSelect();
+}
 
+/**
+ * @brief Current power state of the panel
+ * @return state
+ */
+st7789_power_state_t ST7789_Power_State(void)
+{
+	return ST7789_Ctx()->power_state;
 }
@@ -12,24 +12,78 @@
 #ifndef __ST7789_H
 #define __ST7789_H
 
+#include "esp_err.h"
+
 #include "fonts.h"
 
 
-// #define USE_DMA
 //#define CFG_NO_CS
-// #define DMA_MIN_SIZE 16
 
-/* Pin connection*/
-#define ST7789_BL_PIN   8  // Backlight pin
-#define ST7789_DC_PIN   4  //DC/RS
-#define ST7789_RST_PIN  15 //Reset 
+/* DMA transport */
+#define ST7789_DMA_BUF_SIZE    4096 // Bytes per DMA transaction (also the SPI max_transfer_sz)
+#define ST7789_DMA_QUEUE_SIZE  4    // Transactions in flight on the SPI queue, each with its own DMA buffer
+
+/* Framebuffer */
+#define ST7789_DIRTY_MAX          8   // Dirty rectangles tracked between two flushes
+#define ST7789_DIRTY_MERGE_SLACK  256 // Clean pixels worth resending to save one address window
+
+/* Band renderer */
+#define ST7789_BAND_HEIGHT  20  // Rows of a full width strip, two strips are allocated
+
+/* Scene */
+#define ST7789_SCENE_DAMAGE_MAX  8  // Damaged rectangles tracked between two scene renders
+
+/* Text */
+#define ST7789_GLYPH_CACHE_BUDGET  8192 // Bytes of expanded glyphs kept for reuse, 0 disables the cache
+
+/* JPEG */
+#define ST7789_JPEG_STRIPES     3    // MCU rows in flight between the decoder and the display task
+#define ST7789_JPEG_TASK_STACK  4096 // Stack of the decoder task, bytes
+
+/* Animation */
+#define ST7789_ANIM_TASK_STACK  3072 // Stack of the player task, bytes
+
+/* Display task */
+#define ST7789_TASK_STACK         4096 // Stack of the display task, bytes, CALL callbacks run on it
+#define ST7789_TASK_QUEUE_SIZE    32   // Commands the ring holds, a power of two
+#define ST7789_TASK_BATCH         8    // Commands coalesced and drawn together
+#define ST7789_TASK_TEXT_MAX      32   // Strings shorter than this are copied in the command
+#define ST7789_TASK_POST_WAIT_MS  20   // Time a post waits for room in a full ring
+
+/* Power */
+#define ST7789_POWER_RATE_ACTIVE  0x0F // Frame rate while drawing, FRCTRL2 RTNA: 0x00 119 Hz, 0x0F 60 Hz, 0x1F 39 Hz
+#define ST7789_POWER_RATE_STATIC  0x1F // Frame rate once the content is static
+#define ST7789_POWER_STATIC_MS    500  // Time under the busy rate before the static frame rate, 0 never
+#define ST7789_POWER_BUSY_PIXELS  4096 // Pixels sent per second that count as drawing
+#define ST7789_POWER_WINDOW_MS    100  // Time over which the pixels sent are counted
+
+/* Instrumentation */
+#define ST7789_TRACE_EVENTS   256  // Driver calls kept by the trace ring, 0 leaves the trace out
+#define ST7789_STATS_IDLE_MS  1000 // Time between two frames counted as idle, not as a frame time
+
+/* Displays */
+#define ST7789_BUS_SLICE  8  // Transactions a panel sends before the other panels of the bus get a turn
+#define ST7789_TLS_INDEX  1  // Thread local storage pointer holding the display of a task, 0 is used by pthread
+
+/* Asset store */
+#define ST7789_ASSET_PARTITION  "assets" // Partition holding the asset bundle
+
+/* Pin connection, the SPI bus is shared by all the displays */
 #define ST7789_SCL_PIN  6  // SPI clock pin
 #define ST7789_SDA_PIN  7  // SPI data pin
+#define SPI_HOST	    SPI2_HOST
 
+/* Pins of the display set up by ST7789_Init, see st7789_config_t for the others */
+#define ST7789_BL_PIN   8  // Backlight pin
+#define ST7789_DC_PIN   4  //DC/RS
+#define ST7789_RST_PIN  15 //Reset 
 #define ST7789_CS_PIN   5
-#define SPI_HOST	    SPI2_HOST
 #define SPI_BUS_SPEED  1000000 // SPI bus speed in Hz
 
+/* Controller memory */
+#define ST7789_GRAM_WIDTH   240
+#define ST7789_GRAM_HEIGHT  320
+
 /**
  * Definition of display rotation
  */
@@ -40,6 +94,67 @@ typedef enum {
 	ROT_LANDSCAPE_180
 }st7789_rot_t;
 
+/**
+ * Inclusive screen rectangle
+ */
+typedef struct {
+	int16_t x0;
+	int16_t y0;
+	int16_t x1;
+	int16_t y1;
+}st7789_rect_t;
+
+/**
+ * Sampling of scaled and rotated images
+ */
+typedef enum {
+	ST7789_FILTER_NEAREST = 0,
+	ST7789_FILTER_BILINEAR
+}st7789_filter_t;
+
+/**
+ * Panel power states, from the most to the least power
+ */
+typedef enum {
+	ST7789_POWER_ACTIVE = 0,	// Full frame rate
+	ST7789_POWER_STATIC,		// Low frame rate
+	ST7789_POWER_IDLE			// Low frame rate, idle colors and/or partial display
+}st7789_power_state_t;
+
+/**
+ * Power policy, the quiet time counts from the last window busy with drawing
+ */
+typedef struct {
+	uint8_t active_rate;	// FRCTRL2 RTNA while drawing
+	uint8_t static_rate;	// FRCTRL2 RTNA once static
+	uint16_t static_ms;		// Quiet time before ST7789_POWER_STATIC, 0 never
+	uint16_t idle_ms;		// Quiet time before ST7789_POWER_IDLE, 0 never
+	uint8_t idle_colors;	// Idle mode in ST7789_POWER_IDLE, 8 colors
+	uint8_t partial;		// Partial display in ST7789_POWER_IDLE, the rest is blanked
+	uint16_t partial_start;	// First line kept, along the scroll axis
+	uint16_t partial_end;	// Last line kept
+	uint32_t busy_pixels;	// Pixels sent per second that count as drawing
+}st7789_power_cfg_t;
+
+/**
+ * Panel added with ST7789_Display_Add, pins are -1 when not connected
+ */
+typedef struct {
+	int8_t cs_pin;			// Chip select, one per panel of the bus
+	int8_t dc_pin;			// Data/command, may be shared by the panels
+	int8_t rst_pin;			// Reset, pulsed before the init sequence
+	int8_t bl_pin;			// Backlight, turned on after the init sequence
+	uint32_t clock_hz;		// SPI clock of the panel
+	uint16_t height;		// Size as seen in portrait, as ST7789_Init
+	uint16_t width;
+	st7789_rot_t rotation;
+}st7789_config_t;
+
+/**
+ * Display handle, each display has its own state, render target and lock
+ */
+typedef struct st7789_display *st7789_handle_t;
+
 /**
  *Color of pen
  *If you want to use another color, you can choose one in RGB565 format.
@@ -197,47 +312,72 @@ typedef enum {
 #define ST7789_RST_Clr()                       asm("nop")
 #define ST7789_RST_Set()                       asm("nop")
 
-/* Chip Select macro definition */
-#define ST7789_Select()                        asm("nop")
-#define ST7789_UnSelect()                      asm("nop")
-
-/* Data/Command macro definition */
-#define ST7789_DC_Set()                        gpio_set_level(ST7789_DC_PIN, 1) //GPIO_PIN_SET
-#define ST7789_DC_Clr()                        gpio_set_level(ST7789_DC_PIN, 0) //GPIO_PIN_RESET
+/* Chip Select macro definition, CS is driven by the SPI driver: the pair
+   brackets access to the driver with its recursive lock */
+#define ST7789_Select()                        ST7789_Lock()
+#define ST7789_UnSelect()                      ST7789_Unlock()
 
 #define ABS(x) ((x) > 0 ? (x) : -(x))
 
 /* Basic functions. */
 void ST7789_Init(uint16_t height, uint16_t width, uint8_t rot);
+void ST7789_Lock(void);
+void ST7789_Unlock(void);
 void ST7789_SetRotation(uint8_t m);
 void ST7789_Fill_Color(uint16_t color);
 void ST7789_DrawPixel(uint16_t x, uint16_t y, uint16_t color);
 void ST7789_Fill(uint16_t xSta, uint16_t ySta, uint16_t xEnd, uint16_t yEnd, uint16_t color);
 void ST7789_DrawPixel_4px(uint16_t x, uint16_t y, uint16_t color);
+void ST7789_WaitIdle(void);
 
 /* Graphical functions. */
-void ST7789_DrawLine(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
-void ST7789_DrawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
-void ST7789_DrawCircle(uint16_t x0, uint16_t y0, uint8_t r, uint16_t color);
-void ST7789_DrawImage(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data);
+void ST7789_DrawLine(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+void ST7789_DrawRectangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+void ST7789_DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+void ST7789_DrawImage(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data);
 void ST7789_InvertColors(uint8_t invert);
 
 /* Text functions. */
-void ST7789_WriteChar(uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor);
-void ST7789_WriteString(uint16_t x, uint16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor);
+void ST7789_WriteChar(int16_t x, int16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor);
+void ST7789_WriteString(int16_t x, int16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor);
+void ST7789_GlyphCache_SetBudget(uint32_t bytes);
+void ST7789_GlyphCache_Clear(void);
 
 /* Extented Graphical functions. */
-void ST7789_DrawFilledRectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
-void ST7789_DrawTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3, uint16_t color);
-void ST7789_DrawFilledTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3, uint16_t color);
+void ST7789_DrawFilledRectangle(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t color);
+void ST7789_DrawTriangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color);
+void ST7789_DrawFilledTriangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color);
 void ST7789_DrawFilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
 
+/* Transformed image functions. */
+void ST7789_DrawImageScaled(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data, uint16_t dw, uint16_t dh, st7789_filter_t filter);
+void ST7789_DrawImageRotated(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data, int16_t px, int16_t py, int16_t angle, uint16_t scale, st7789_filter_t filter);
+
+/* Framebuffer functions. */
+esp_err_t ST7789_FB_Enable(void);
+void ST7789_FB_Disable(void);
+void ST7789_Flush(void);
+
 /* Command functions */
 void ST7789_TearEffect(uint8_t tear);
-void ST7789_VerticalScroll(uint16_t pixel);
 
-/* Simple test function. */
-void ST7789_Test(void);
+/* Hardware scrolling functions. */
+esp_err_t ST7789_Scroll_SetRegion(uint16_t top, uint16_t bottom);
+void ST7789_Scroll_By(int16_t lines);
+int16_t ST7789_Scroll_Map(int16_t pos);
+void ST7789_Scroll_Reset(void);
+esp_err_t ST7789_Scroll_WriteLine(uint16_t x, const char *str, FontDef font, uint16_t color, uint16_t bgcolor);
+
+/* Power functions. */
+void ST7789_Power_Config(const st7789_power_cfg_t *cfg);
+void ST7789_Power_Update(void);
+void ST7789_Power_Wake(void);
+st7789_power_state_t ST7789_Power_State(void);
+
+/* Display functions. */
+esp_err_t ST7789_Display_Add(const st7789_config_t *cfg, st7789_handle_t *disp);
+void ST7789_Display_Use(st7789_handle_t disp);
+st7789_handle_t ST7789_Display_Current(void);
 
 
 #endif
@@ -0,0 +1,254 @@
+/**
+ * @file    st7789_anim.c
+ * @brief   Delta encoded animations for the ST7789 driver
+ * @details Each frame only sends the windows that changed, so the bus time of
+ * 		a frame follows the size of the motion rather than of the animation.
+ * 		The player task keeps a fixed frame rate with xTaskDelayUntil and
+ * 		counts the frames the transport could not send in time.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_anim.h"
+#include "st7789_image.h"
+#include "st7789_internal.h"
+
+#define ANIM_ALIGN(n)	(((n) + 3) & ~(size_t)3)
+
+/**
+ * @brief Bytes taken by an image in an animation, padding included
+ * @param p -> image
+ * @param end -> end of the animation
+ * @return bytes, 0 if the image does not fit
+ */
+static size_t ST7789_Anim_ImageSize(const uint8_t *p, const uint8_t *end)
+{
+	const st7789_image_header_t *hdr = (const st7789_image_header_t *)p;
+
+	if (end - p < (ptrdiff_t)sizeof(*hdr) || (size_t)(end - p) - sizeof(*hdr) < hdr->size)
+		return 0;
+	return ANIM_ALIGN(sizeof(*hdr) + hdr->size);
+}
+
+/**
+ * @brief Start playing an animation
+ * @note  The frame headers are checked here, the images when drawn.
+ * @param anim -> animation to initialize
+ * @param data -> animation file contents, 4 bytes aligned
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if data is not an animation,
+ *         ESP_ERR_INVALID_VERSION for an unknown version,
+ *         ESP_ERR_INVALID_SIZE if data is truncated
+ */
+esp_err_t ST7789_Anim_Open(st7789_anim_t *anim, const void *data, size_t size)
+{
+	const st7789_anim_header_t *hdr = data;
+	const uint8_t *p, *end;
+	size_t len;
+
+	memset(anim, 0, sizeof(*anim));
+	if (size < sizeof(*hdr) || memcmp(hdr->magic, ST7789_ANIM_MAGIC, 4) != 0)
+		return ESP_ERR_INVALID_ARG;
+	if (hdr->version != ST7789_ANIM_VERSION)
+		return ESP_ERR_INVALID_VERSION;
+	if (hdr->frames == 0)
+		return ESP_ERR_INVALID_ARG;
+	if (size - sizeof(*hdr) < hdr->size)
+		return ESP_ERR_INVALID_SIZE;
+
+	p = (const uint8_t *)data + sizeof(*hdr);
+	end = p + hdr->size;
+	len = ST7789_Anim_ImageSize(p, end);
+	if (len == 0)
+		return ESP_ERR_INVALID_SIZE;
+	anim->key = p;
+	anim->first = p + len;
+
+	p = anim->first;
+	for (uint16_t i = 0; i < hdr->frames; i++) {
+		const st7789_anim_frame_t *frame = (const st7789_anim_frame_t *)p;
+		if (end - p < (ptrdiff_t)sizeof(*frame) || (size_t)(end - p) - sizeof(*frame) < frame->size)
+			return ESP_ERR_INVALID_SIZE;
+		p += sizeof(*frame) + ANIM_ALIGN(frame->size);
+	}
+
+	anim->end = p;	// Padding after the last frame is not a frame
+	anim->frames = hdr->frames;
+	anim->width = hdr->width;
+	anim->height = hdr->height;
+	anim->period = hdr->period;
+	return ESP_OK;
+}
+
+/**
+ * @brief Go back to the key frame, e.g. after the screen was cleared
+ * @param anim -> animation
+ * @return none
+ */
+void ST7789_Anim_Rewind(st7789_anim_t *anim)
+{
+	anim->next = NULL;
+	anim->frame = 0;
+}
+
+/**
+ * @brief Draw the next frame of an animation
+ * @note  The key frame is drawn first, then only the rectangles that changed,
+ *        so the area must not be drawn over between two frames.
+ * @param anim -> animation
+ * @param x&y -> top left corner of the animation
+ * @return ESP_OK, or an error of ST7789_Image_Draw. A corrupt frame gives
+ *         ESP_ERR_INVALID_SIZE, its rectangles before are drawn.
+ */
+esp_err_t ST7789_Anim_DrawFrame(st7789_anim_t *anim, int16_t x, int16_t y)
+{
+	const st7789_anim_frame_t *frame;
+	const uint8_t *p, *end;
+	esp_err_t err = ESP_OK;
+
+	if (anim->next == NULL) {
+		anim->next = anim->first;
+		anim->frame = anim->frames > 1;
+		return ST7789_Image_Draw(x, y, anim->key, anim->first - anim->key);
+	}
+
+	/* Rectangles of a frame are drawn together */
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_ANIM);
+
+	frame = (const st7789_anim_frame_t *)anim->next;
+	p = anim->next + sizeof(*frame);
+	end = p + frame->size;
+	for (uint16_t i = 0; i < frame->rects && err == ESP_OK; i++) {
+		const st7789_anim_rect_t *rect = (const st7789_anim_rect_t *)p;
+		size_t len = 0;
+
+		if (end - p > (ptrdiff_t)sizeof(*rect))
+			len = ST7789_Anim_ImageSize(p + sizeof(*rect), end);
+		if (len == 0) {
+			err = ESP_ERR_INVALID_SIZE;
+			break;
+		}
+		err = ST7789_Image_Draw(x + rect->x, y + rect->y, p + sizeof(*rect), len);
+		p += sizeof(*rect) + len;
+	}
+	ST7789_Trace_Frame();
+	ST7789_UnSelect();
+
+	anim->next = anim->next + sizeof(*frame) + ANIM_ALIGN(frame->size);
+	if (anim->next >= anim->end)
+		anim->next = anim->first;
+	anim->frame = anim->frame + 1 < anim->frames ? anim->frame + 1 : 0;
+	return err;
+}
+
+/**
+ * @brief Player task, draws a frame every period until stopped
+ * @note  A frame drawn after its deadline is counted as dropped and the
+ *        schedule restarts from it, rather than rushing the next frames.
+ */
+static void ST7789_Anim_Task(void *arg)
+{
+	st7789_anim_player_t *player = arg;
+	TickType_t period = pdMS_TO_TICKS(player->anim.period);
+	TickType_t wake = xTaskGetTickCount();
+	TaskHandle_t waiter;
+
+	if (period == 0)
+		period = 1;
+	ST7789_Display_Use(player->display);
+
+	while (!__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE)) {
+		if (player->done) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+
+		esp_err_t err = ST7789_Anim_DrawFrame(&player->anim, player->x, player->y);
+		player->shown++;
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "Animation frame %u: %s", player->anim.frame, esp_err_to_name(err));
+			player->done = 1;
+			continue;
+		}
+		ST7789_Power_Update();
+		/* Frame is now the one after the frame drawn */
+		if (player->anim.frame == 0 && player->loops && --player->loops == 0) {
+			player->done = 1;
+			continue;
+		}
+
+		if (xTaskDelayUntil(&wake, period) == pdFALSE) {
+			player->dropped++;
+			ESP_LOGD(TAG, "Animation frame late, %lu dropped", (unsigned long)player->dropped);
+			wake = xTaskGetTickCount();
+		}
+	}
+
+	/* The player may be freed as soon as the waiter runs */
+	waiter = player->waiter;
+	__atomic_store_n(&player->task, NULL, __ATOMIC_RELEASE);
+	xTaskNotifyGive(waiter);
+	vTaskDelete(NULL);
+}
+
+/**
+ * @brief Play an animation on a task of its own
+ * @note  The task has the priority of the caller and draws to its display.
+ *        Each frame holds the driver lock, other tasks may draw outside the
+ *        animation meanwhile.
+ * @param player -> zero initialized or stopped player, must stay valid until
+ *        ST7789_Anim_Stop
+ * @param x&y -> top left corner of the animation
+ * @param data -> animation file contents, 4 bytes aligned
+ * @param size -> bytes of data
+ * @param loops -> times to play the animation, 0 to play it until stopped
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the player is playing,
+ *         ESP_ERR_NO_MEM, or an error of ST7789_Anim_Open
+ */
+esp_err_t ST7789_Anim_Play(st7789_anim_player_t *player, int16_t x, int16_t y, const void *data, size_t size, uint32_t loops)
+{
+	esp_err_t err;
+
+	if (__atomic_load_n(&player->task, __ATOMIC_ACQUIRE) != NULL)
+		return ESP_ERR_INVALID_STATE;
+
+	memset(player, 0, sizeof(*player));
+	err = ST7789_Anim_Open(&player->anim, data, size);
+	if (err != ESP_OK)
+		return err;
+	player->x = x;
+	player->y = y;
+	player->display = ST7789_Display_Current();
+	player->loops = loops;
+
+	if (xTaskCreate(ST7789_Anim_Task, "st7789_anim", ST7789_ANIM_TASK_STACK, player,
+			uxTaskPriorityGet(NULL), &player->task) != pdPASS) {
+		player->task = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief Stop an animation, waiting for the frame being drawn
+ * @note  The notification of the calling task is used to wait.
+ * @param player -> player
+ * @return none
+ */
+void ST7789_Anim_Stop(st7789_anim_player_t *player)
+{
+	TaskHandle_t task = __atomic_load_n(&player->task, __ATOMIC_ACQUIRE);
+
+	if (task == NULL)
+		return;
+	player->waiter = xTaskGetCurrentTaskHandle();
+	__atomic_store_n(&player->stop, 1, __ATOMIC_RELEASE);
+	xTaskNotifyGive(task);
+	while (__atomic_load_n(&player->task, __ATOMIC_ACQUIRE) != NULL)
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file    st7789_anim.h
+ * @brief   Delta encoded animations for the ST7789 driver.
+ * @note    Animations are made by tools/mkanim.py. A key frame holds the
+ *     first frame, then every frame only holds the rectangles that changed
+ *     since the previous one, each as an image of st7789_image.h. The last
+ *     delta goes from the last frame back to the first, so a loop never
+ *     redraws the key frame.
+ *
+ *     Layout, little endian, every part 4 bytes aligned:
+ *         st7789_anim_header_t
+ *         key frame image
+ *         frames times:
+ *             st7789_anim_frame_t
+ *             rects times: st7789_anim_rect_t, then an image
+ */
+
+#ifndef __ST7789_ANIM_H
+#define __ST7789_ANIM_H
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_ANIM_MAGIC    "S7AN"
+#define ST7789_ANIM_VERSION  1
+
+typedef struct {
+	uint8_t magic[4];		// ST7789_ANIM_MAGIC
+	uint8_t version;		// ST7789_ANIM_VERSION
+	uint8_t reserved;
+	uint16_t frames;
+	uint16_t width;
+	uint16_t height;
+	uint16_t period;		// Milliseconds between two frames
+	uint16_t reserved2;
+	uint32_t size;			// Bytes after the header
+}st7789_anim_header_t;
+
+typedef struct {
+	uint16_t rects;			// Changed rectangles
+	uint16_t reserved;
+	uint32_t size;			// Bytes of the rectangles after this
+}st7789_anim_frame_t;
+
+typedef struct {
+	int16_t x, y;			// Position in the animation
+}st7789_anim_rect_t;
+
+/**
+ * Animation being played frame by frame
+ */
+typedef struct {
+	const uint8_t *key;		// Key frame image
+	const uint8_t *first;	// First delta frame
+	const uint8_t *next;	// Next delta frame, NULL before the key frame
+	const uint8_t *end;
+	uint16_t frames;
+	uint16_t frame;			// Index of the next frame
+	uint16_t width;
+	uint16_t height;
+	uint16_t period;
+}st7789_anim_t;
+
+/**
+ * Animation played by a task of its own
+ */
+typedef struct {
+	st7789_anim_t anim;
+	int16_t x, y;
+	st7789_handle_t display;	// Display of the task that started the player
+	uint32_t loops;			// Loops left, 0 to play forever
+	TaskHandle_t task;		// Player task, NULL when stopped
+	TaskHandle_t waiter;	// Task waiting in ST7789_Anim_Stop
+	uint8_t stop;
+	volatile uint8_t done;	// All loops were played, or a frame is corrupt
+	volatile uint32_t shown;	// Frames drawn
+	volatile uint32_t dropped;	// Frames drawn after their deadline
+}st7789_anim_player_t;
+
+/* Animation functions. */
+esp_err_t ST7789_Anim_Open(st7789_anim_t *anim, const void *data, size_t size);
+void ST7789_Anim_Rewind(st7789_anim_t *anim);
+esp_err_t ST7789_Anim_DrawFrame(st7789_anim_t *anim, int16_t x, int16_t y);
+
+/* Player functions. */
+esp_err_t ST7789_Anim_Play(st7789_anim_player_t *player, int16_t x, int16_t y, const void *data, size_t size, uint32_t loops);
+void ST7789_Anim_Stop(st7789_anim_player_t *player);
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * @file    st7789_asset.c
+ * @brief   Asset store memory mapped from flash for the ST7789 driver
+ * @details The bundle is mapped once in the data address space. Lookups hash
+ * 		the name and probe the index, and drawing reads the pixels through the
+ * 		flash cache straight into the SPI transaction buffers.
+ */
+
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_asset.h"
+#include "st7789_image.h"
+#include "st7789_internal.h"
+
+static struct {
+	const uint8_t *base;					// Mapped bundle, NULL when not mounted
+	const st7789_asset_header_t *header;
+	const st7789_asset_entry_t *index;
+	esp_partition_mmap_handle_t handle;
+}asset_store;
+
+/**
+ * @brief FNV-1a hash of an asset name
+ * @param name -> asset name
+ * @return hash, never 0
+ */
+static uint32_t ST7789_Asset_Hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+	return h ? h : 1;
+}
+
+/**
+ * @brief Map the asset bundle of a flash partition
+ * @param label -> partition label, NULL for ST7789_ASSET_PARTITION
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without the partition,
+ *         ESP_ERR_INVALID_ARG if the partition holds no bundle,
+ *         ESP_ERR_INVALID_VERSION for an unknown version,
+ *         ESP_ERR_INVALID_SIZE for a bundle larger than the partition,
+ *         or an error of esp_partition_mmap
+ */
+esp_err_t ST7789_Asset_Mount(const char *label)
+{
+	const esp_partition_t *part;
+	st7789_asset_header_t hdr;
+	const void *ptr;
+	esp_err_t err;
+
+	ST7789_Asset_Unmount();
+	if (label == NULL)
+		label = ST7789_ASSET_PARTITION;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+	if (part == NULL) {
+		ESP_LOGE(TAG, "No %s partition", label);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	/* Check the header before mapping just the bundle, not the whole partition */
+	err = esp_partition_read(part, 0, &hdr, sizeof(hdr));
+	if (err != ESP_OK)
+		return err;
+	if (memcmp(hdr.magic, ST7789_ASSET_MAGIC, 4) != 0) {
+		ESP_LOGE(TAG, "No asset bundle in %s", label);
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (hdr.version != ST7789_ASSET_VERSION)
+		return ESP_ERR_INVALID_VERSION;
+	if (hdr.buckets == 0 || (hdr.buckets & (hdr.buckets - 1)) != 0)
+		return ESP_ERR_INVALID_ARG;
+	if (hdr.size > part->size || sizeof(hdr) + (uint64_t)hdr.buckets * sizeof(st7789_asset_entry_t) > hdr.size)
+		return ESP_ERR_INVALID_SIZE;
+
+	err = esp_partition_mmap(part, 0, hdr.size, ESP_PARTITION_MMAP_DATA, &ptr, &asset_store.handle);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Cannot map %s: %s", label, esp_err_to_name(err));
+		return err;
+	}
+
+	asset_store.base = ptr;
+	asset_store.header = ptr;
+	asset_store.index = (const st7789_asset_entry_t *)(asset_store.base + sizeof(hdr));
+	ESP_LOGI(TAG, "%lu assets mapped from %s", (unsigned long)hdr.count, label);
+	return ESP_OK;
+}
+
+/**
+ * @brief Unmap the asset bundle, pointers returned by ST7789_Asset_Find
+ *        become invalid
+ * @note  Waits for the transactions of every display. Not while holding
+ *        the lock of a display.
+ * @return none
+ */
+void ST7789_Asset_Unmount(void)
+{
+	if (asset_store.base == NULL)
+		return;
+	/* Transactions of any display may still be reading mapped pixels */
+	ST7789_WaitIdleAll();
+	esp_partition_munmap(asset_store.handle);
+	memset(&asset_store, 0, sizeof(asset_store));
+}
+
+/**
+ * @brief Find an asset by name
+ * @param name -> asset name
+ * @param size -> bytes of the asset, may be NULL
+ * @return asset data in mapped flash, NULL if not found or not mounted
+ */
+const void *ST7789_Asset_Find(const char *name, size_t *size)
+{
+	const st7789_asset_header_t *hdr = asset_store.header;
+	uint32_t h, mask;
+
+	if (hdr == NULL)
+		return NULL;
+
+	h = ST7789_Asset_Hash(name);
+	mask = hdr->buckets - 1;
+	for (uint32_t i = 0, slot = h & mask; i < hdr->buckets; i++, slot = (slot + 1) & mask) {
+		const st7789_asset_entry_t *e = &asset_store.index[slot];
+		if (e->hash == 0)
+			break;
+		if (e->hash != h || e->name >= hdr->size ||
+			strncmp((const char *)asset_store.base + e->name, name, hdr->size - e->name) != 0)
+			continue;
+		if (e->offset > hdr->size || e->size > hdr->size - e->offset)
+			return NULL;
+		if (size)
+			*size = e->size;
+		return asset_store.base + e->offset;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Draw an image asset
+ * @param x&y -> top left corner of the image
+ * @param name -> asset name
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, or an error of ST7789_Image_Draw
+ */
+esp_err_t ST7789_Asset_Draw(int16_t x, int16_t y, const char *name)
+{
+	size_t size;
+	const void *data = ST7789_Asset_Find(name, &size);
+
+	if (data == NULL)
+		return ESP_ERR_NOT_FOUND;
+	return ST7789_Image_Draw(x, y, data, size);
+}
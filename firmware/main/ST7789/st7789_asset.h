@@ -0,0 +1,49 @@
+/**
+ * @file    st7789_asset.h
+ * @brief   Asset store memory mapped from flash for the ST7789 driver.
+ * @note    Assets are packed by tools/mkbundle.py into a bundle written to the
+ *     assets partition. The index is a hash table with linear probing, so a
+ *     name is found in O(1) without reading any file system. Asset data is
+ *     read in place through the flash cache, never copied to the heap.
+ *
+ *     Bundle layout, little endian, offsets from the start of the bundle:
+ *         st7789_asset_header_t
+ *         st7789_asset_entry_t[buckets]
+ *         NUL terminated names
+ *         asset data, each asset 4 bytes aligned
+ */
+
+#ifndef __ST7789_ASSET_H
+#define __ST7789_ASSET_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_ASSET_MAGIC    "S7AB"
+#define ST7789_ASSET_VERSION  1
+
+typedef struct {
+	uint8_t magic[4];		// ST7789_ASSET_MAGIC
+	uint8_t version;		// ST7789_ASSET_VERSION
+	uint8_t reserved[3];
+	uint32_t buckets;		// Index entries, a power of 2
+	uint32_t count;			// Assets in the bundle
+	uint32_t size;			// Bytes of the whole bundle
+}st7789_asset_header_t;
+
+typedef struct {
+	uint32_t hash;			// FNV-1a of the name, 0 for an empty entry
+	uint32_t name;			// Offset of the name
+	uint32_t offset;		// Offset of the data
+	uint32_t size;			// Bytes of data
+}st7789_asset_entry_t;
+
+/* Asset store functions. */
+esp_err_t ST7789_Asset_Mount(const char *label);
+void ST7789_Asset_Unmount(void);
+const void *ST7789_Asset_Find(const char *name, size_t *size);
+esp_err_t ST7789_Asset_Draw(int16_t x, int16_t y, const char *name);
+
+#endif
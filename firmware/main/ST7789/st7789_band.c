@@ -0,0 +1,148 @@
+/**
+ * @file    st7789_band.c
+ * @brief   Band renderer for the ST7789 driver
+ * @details The area to draw is cut in horizontal strips. Each strip is
+ * 		rendered in RAM by replaying a display list, then queued to the SPI
+ * 		bus without copying it. Two strips are used in turn, so the CPU draws
+ * 		one while DMA sends the other. RAM cost is two strips instead of a
+ * 		full 240x240 framebuffer.
+ */
+
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_dl.h"
+#include "st7789_internal.h"
+
+/**
+ * @brief Allocate the two strips of the band renderer
+ * @note  Each strip holds ST7789_BAND_HEIGHT full width rows.
+ * @return ESP_OK, ESP_ERR_NO_MEM if the strips cannot be allocated
+ */
+esp_err_t ST7789_Band_Init(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	size_t size = (size_t)ctx->width * ST7789_BAND_HEIGHT * 2;
+
+	ST7789_Select();
+	for (uint8_t i = 0; i < 2; i++) {
+		if (ctx->band_buf[i])
+			continue;
+		ctx->band_buf[i] = heap_caps_malloc(size, MALLOC_CAP_DMA);
+		if (ctx->band_buf[i] == NULL) {
+			ESP_LOGE(TAG, "No memory for band strips");
+			ST7789_Band_Deinit();
+			ST7789_UnSelect();
+			return ESP_ERR_NO_MEM;
+		}
+		ctx->band_seq[i] = ctx->trans_seq;
+	}
+	ST7789_UnSelect();
+	return ESP_OK;
+}
+
+/**
+ * @brief Release the strips of the band renderer
+ * @return none
+ */
+void ST7789_Band_Deinit(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	ST7789_WaitIdle();
+	for (uint8_t i = 0; i < 2; i++) {
+		heap_caps_free(ctx->band_buf[i]);
+		ctx->band_buf[i] = NULL;
+	}
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Draw a display list on an area of the screen, one strip at a time
+ * @note  Narrow areas get taller strips, every strip holds the same number of
+ *        pixels. Primitives outside a strip are skipped for that strip.
+ *        With the framebuffer enabled, or without strips, the list is drawn
+ *        on the current target clipped to the area.
+ * @param dl -> display list to replay
+ * @param area -> screen area to redraw, NULL for the whole screen
+ * @param bgcolor -> color of the pixels no primitive covers
+ * @return none
+ */
+void ST7789_Band_Render(const st7789_dl_t *dl, const st7789_rect_t *area, uint16_t bgcolor)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_rect_t a = {0, 0, ctx->width - 1, ctx->height - 1};
+	st7789_surface_t *saved;
+	st7789_surface_t strip;
+	uint8_t cur = 0;
+
+	if (area) {
+		if (area->x0 > a.x0) a.x0 = area->x0;
+		if (area->y0 > a.y0) a.y0 = area->y0;
+		if (area->x1 < a.x1) a.x1 = area->x1;
+		if (area->y1 < a.y1) a.y1 = area->y1;
+	}
+	if (a.x0 > a.x1 || a.y0 > a.y1)
+		return;
+
+	/* The strips stand in for the target, no other task may draw meanwhile */
+	ST7789_Select();
+	saved = ctx->target;
+	if (ctx->disp_buf || ctx->band_buf[0] == NULL) {
+		/* Nothing to gain from strips, draw on the current target */
+		const st7789_rect_t *saved_clip = ctx->clip;
+		ctx->clip = &a;
+		ST7789_FillArea(a.x0, a.y0, a.x1, a.y1, bgcolor);
+		for (uint16_t i = 0; i < dl->count; i++) {
+			st7789_rect_t b;
+			ST7789_DL_Bounds(&dl->ops[i], &b);
+			if (b.x1 < a.x0 || b.x0 > a.x1 || b.y1 < a.y0 || b.y0 > a.y1)
+				continue;
+			ST7789_DL_Exec(&dl->ops[i]);
+		}
+		ctx->clip = saved_clip;
+		ST7789_UnSelect();
+		return;
+	}
+
+	strip.x = a.x0;
+	strip.w = a.x1 - a.x0 + 1;
+	strip.stride = strip.w;
+	uint16_t rows = (ctx->width * ST7789_BAND_HEIGHT) / strip.w;
+
+	for (int16_t y = a.y0; y <= a.y1; y += rows) {
+		st7789_rect_t band = {a.x0, y, a.x1, y + rows - 1};
+		if (band.y1 > a.y1)
+			band.y1 = a.y1;
+
+		/* Wait for DMA to be done with the strip drawn two bands ago */
+		ST7789_WaitSeq(ctx->band_seq[cur]);
+		ST7789_BusYield();	// Not needed while the strip is drawn
+
+		strip.buf = ctx->band_buf[cur];
+		strip.y = band.y0;
+		strip.h = band.y1 - band.y0 + 1;
+		ctx->target = &strip;
+
+		ST7789_FillArea(band.x0, band.y0, band.x1, band.y1, bgcolor);
+		for (uint16_t i = 0; i < dl->count; i++) {
+			st7789_rect_t b;
+			ST7789_DL_Bounds(&dl->ops[i], &b);
+			if (b.x1 < band.x0 || b.x0 > band.x1 || b.y1 < band.y0 || b.y0 > band.y1)
+				continue;
+			ST7789_DL_Exec(&dl->ops[i]);
+		}
+
+		ctx->target = saved;
+		/* The window runs to the bottom of the area, so the next strips
+		   continue in it without new address commands */
+		ST7789_SetAddressWindow(a.x0, band.y0, a.x1, a.y1);
+		ctx->band_seq[cur] = ST7789_QueueBuffer(strip.buf, (size_t)strip.w * strip.h * 2);
+
+		cur ^= 1;
+	}
+	ST7789_UnSelect();
+}
@@ -0,0 +1,369 @@
+/**
+ * @file    st7789_bench.c
+ * @brief   Rendering benchmark of the ST7789 driver
+ * @details Each workload starts on a black screen with an idle queue. The
+ * 		clock, ST7789_Port_Time like the trace, the cycle counter and the
+ * 		transport counters are read before the first call; the cycles again
+ * 		once the calls returned, the rest after ST7789_WaitIdle, when the
+ * 		last byte left the wire.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_cpu.h"
+#endif
+
+#include "st7789.h"
+#include "st7789_bench.h"
+#include "st7789_internal.h"
+
+#define BENCH_IMAGE_SIZE  64  // Side of the image of the image workload
+
+/**
+ * Workload, draws count primitives
+ */
+typedef struct {
+	const char *name;
+	void (*run)(uint32_t count);
+	uint32_t count;
+}st7789_bench_t;
+
+static uint32_t bench_seed;
+static uint16_t *bench_image;	// BENCH_IMAGE_SIZE squared pixels, panel byte order
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief CPU time of the calling thread, there is no cycle counter
+ * @return nanoseconds, wrapping
+ */
+static uint32_t ST7789_Bench_Cycles(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+#else
+#define ST7789_Bench_Cycles()	esp_cpu_get_cycle_count()
+#endif
+
+/**
+ * @brief Next pseudo random number of the workloads
+ * @param n -> range
+ * @return number from 0 to n - 1
+ */
+static uint16_t ST7789_Bench_Rand(uint16_t n)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return (bench_seed >> 16) % n;
+}
+
+/**
+ * @brief Pseudo random color
+ * @return color
+ */
+static uint16_t ST7789_Bench_Color(void)
+{
+	return ST7789_Bench_Rand(0xFFFF) | 1;
+}
+
+/**
+ * @brief Workload: fill the whole screen
+ * @param count -> fills
+ * @return none
+ */
+static void ST7789_Bench_FillScreen(uint32_t count)
+{
+	static const uint16_t colors[] = {RED, GREEN, BLUE, WHITE};
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_Fill_Color(colors[i % 4]);
+}
+
+/**
+ * @brief Workload: fill 40x30 rectangles
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_FillRect(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint16_t x = ST7789_Bench_Rand(ctx->width - 40);
+		uint16_t y = ST7789_Bench_Rand(ctx->height - 30);
+
+		ST7789_Fill(x, y, x + 39, y + 29, ST7789_Bench_Color());
+	}
+}
+
+/**
+ * @brief Workload: draw single pixels
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Pixel(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawPixel(ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Workload: draw lines between random points
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Line(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawLine(ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height),
+				ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Workload: draw 60x40 rectangle outlines
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Rect(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint16_t x = ST7789_Bench_Rand(ctx->width - 60);
+		uint16_t y = ST7789_Bench_Rand(ctx->height - 40);
+
+		ST7789_DrawRectangle(x, y, x + 59, y + 39, ST7789_Bench_Color());
+	}
+}
+
+/**
+ * @brief Workload: draw circle outlines, radius 5 to 39
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Circle(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawCircle(40 + ST7789_Bench_Rand(ctx->width - 80), 40 + ST7789_Bench_Rand(ctx->height - 80),
+				5 + ST7789_Bench_Rand(35), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Workload: draw filled circles, radius 5 to 39
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_FilledCircle(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawFilledCircle(40 + ST7789_Bench_Rand(ctx->width - 80), 40 + ST7789_Bench_Rand(ctx->height - 80),
+				5 + ST7789_Bench_Rand(35), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Workload: draw triangle outlines
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Triangle(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawTriangle(ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height),
+				ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height),
+				ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Workload: draw filled triangles
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_FilledTriangle(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawFilledTriangle(ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height),
+				ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height),
+				ST7789_Bench_Rand(ctx->width), ST7789_Bench_Rand(ctx->height), ST7789_Bench_Color());
+}
+
+/**
+ * @brief Lines of text filling the screen, once per count
+ * @param font -> font
+ * @param count -> screens of text
+ * @return none
+ */
+static void ST7789_Bench_Text(const FontDef *font, uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	static const char line[] = "The quick brown fox jumps over the lazy dog 0123456789";
+
+	for (uint32_t i = 0; i < count; i++)
+		for (uint16_t y = 0; y + font->height <= ctx->height; y += font->height)
+			ST7789_WriteString(0, y, line, *font, i & 1 ? BLACK : WHITE, i & 1 ? WHITE : BLACK);
+}
+
+/**
+ * @brief Workload: screens of text in Font_7x10
+ * @param count -> screens
+ * @return none
+ */
+static void ST7789_Bench_Text7x10(uint32_t count)
+{
+	ST7789_Bench_Text(&Font_7x10, count);
+}
+
+/**
+ * @brief Workload: screens of text in Font_11x18
+ * @param count -> screens
+ * @return none
+ */
+static void ST7789_Bench_Text11x18(uint32_t count)
+{
+	ST7789_Bench_Text(&Font_11x18, count);
+}
+
+/**
+ * @brief Workload: screens of text in Font_16x26
+ * @param count -> screens
+ * @return none
+ */
+static void ST7789_Bench_Text16x26(uint32_t count)
+{
+	ST7789_Bench_Text(&Font_16x26, count);
+}
+
+/**
+ * @brief Workload: draw the 64x64 benchmark image
+ * @param count -> primitives
+ * @return none
+ */
+static void ST7789_Bench_Image(uint32_t count)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	for (uint32_t i = 0; i < count; i++)
+		ST7789_DrawImage(ST7789_Bench_Rand(ctx->width - BENCH_IMAGE_SIZE), ST7789_Bench_Rand(ctx->height - BENCH_IMAGE_SIZE),
+				BENCH_IMAGE_SIZE, BENCH_IMAGE_SIZE, (const uint8_t *)bench_image);
+}
+
+/**
+ * Workloads, in the order they run and are reported
+ */
+static const st7789_bench_t st7789_bench[] = {
+	{"fill_screen",     ST7789_Bench_FillScreen,     8},
+	{"fill_rect",       ST7789_Bench_FillRect,       64},
+	{"pixel",           ST7789_Bench_Pixel,          1000},
+	{"line",            ST7789_Bench_Line,           100},
+	{"rect",            ST7789_Bench_Rect,           64},
+	{"circle",          ST7789_Bench_Circle,         32},
+	{"filled_circle",   ST7789_Bench_FilledCircle,   32},
+	{"triangle",        ST7789_Bench_Triangle,       32},
+	{"filled_triangle", ST7789_Bench_FilledTriangle, 32},
+	{"text_7x10",       ST7789_Bench_Text7x10,       4},
+	{"text_11x18",      ST7789_Bench_Text11x18,      4},
+	{"text_16x26",      ST7789_Bench_Text16x26,      4},
+	{"image",           ST7789_Bench_Image,          32},
+};
+
+/**
+ * @brief Run the workloads on the display of the calling task
+ * @note  Draws to the panel straight, whatever the render target was, and
+ *        leaves it black. Takes a few seconds at the default bus clock.
+ * @param results -> measures, one per workload
+ * @param max -> room in results
+ * @return workloads run, 0 when out of memory
+ */
+size_t ST7789_Bench_Run(st7789_bench_result_t *results, size_t max)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	size_t n = sizeof(st7789_bench) / sizeof(st7789_bench[0]);
+	st7789_surface_t *target;
+
+	if (n > max)
+		n = max;
+	bench_image = heap_caps_malloc(BENCH_IMAGE_SIZE * BENCH_IMAGE_SIZE * 2, MALLOC_CAP_8BIT);
+	if (bench_image == NULL) {
+		ESP_LOGE(TAG, "No memory for the benchmark image");
+		return 0;
+	}
+	for (uint16_t y = 0; y < BENCH_IMAGE_SIZE; y++)
+		for (uint16_t x = 0; x < BENCH_IMAGE_SIZE; x++) {
+			uint16_t c = ((x * 31 / BENCH_IMAGE_SIZE) << 11) | ((y * 63 / BENCH_IMAGE_SIZE) << 5) | ((x ^ y) & 0x1F);
+			bench_image[y * BENCH_IMAGE_SIZE + x] = (c >> 8) | (c << 8);
+		}
+
+	/* Held throughout, other tasks must not add to the counters */
+	ST7789_Select();
+	target = ctx->target;
+	ctx->target = NULL;
+	bench_seed = ST7789_BENCH_SEED;
+
+	for (size_t i = 0; i < n; i++) {
+		st7789_bench_result_t *r = &results[i];
+		uint32_t seq, cycles;
+		uint64_t bytes;
+		int64_t start;
+
+		ST7789_Fill_Color(BLACK);
+		ST7789_WaitIdle();
+
+		r->name = st7789_bench[i].name;
+		r->count = st7789_bench[i].count;
+		seq = ctx->trans_seq;
+		bytes = ctx->stats.bytes;
+		start = ST7789_Port_Time();
+		cycles = ST7789_Bench_Cycles();
+
+		st7789_bench[i].run(st7789_bench[i].count);
+
+		r->cycles = ST7789_Bench_Cycles() - cycles;
+		ST7789_WaitIdle();
+		r->time_us = ST7789_Port_Time() - start;
+		r->transactions = ctx->trans_seq - seq;
+		r->bytes = (uint32_t)(ctx->stats.bytes - bytes);
+	}
+
+	ST7789_Fill_Color(BLACK);
+	ctx->target = target;
+	ST7789_UnSelect();
+	heap_caps_free(bench_image);
+	bench_image = NULL;
+	return n;
+}
+
+/**
+ * @brief Print benchmark results, one JSON object per line
+ * @param results -> measures of ST7789_Bench_Run
+ * @param count -> workloads in results
+ * @return none
+ */
+void ST7789_Bench_Print(const st7789_bench_result_t *results, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const st7789_bench_result_t *r = &results[i];
+
+		printf("{\"bench\":\"%s\",\"n\":%lu,\"us\":%lld,\"cycles\":%lu,\"trans\":%lu,\"bytes\":%lu}\n",
+				r->name, (unsigned long)r->count, (long long)r->time_us, (unsigned long)r->cycles,
+				(unsigned long)r->transactions, (unsigned long)r->bytes);
+	}
+}
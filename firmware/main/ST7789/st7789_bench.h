@@ -0,0 +1,46 @@
+/**
+ * @file    st7789_bench.h
+ * @brief   Rendering benchmark of the ST7789 driver.
+ * @note    Runs a fixed workload per primitive on the display of the calling
+ *     task and measures it. The workloads only depend on a fixed seed, so
+ *     results of two releases compare one to one. On the linux target the
+ *     panel is emulated, see st7789_emu.h; the bytes and transactions are
+ *     those the chip would send.
+ *
+ *     ST7789_Bench_Print writes one JSON object per line, here from the
+ *     linux target:
+ *
+ *         {"bench":"fill_rect","n":64,"us":3680,"cycles":3678309,"trans":380,"bytes":154294}
+ *
+ *     The host test bench_regression, test/host/test_bench.c, runs the suite
+ *     on the emulated panel and fails when the transactions or bytes of a
+ *     workload grow past the baseline in test/host/data/bench.
+ */
+
+#ifndef __ST7789_BENCH_H
+#define __ST7789_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "st7789.h"
+
+#define ST7789_BENCH_SEED  0x5EED  // Seed of the pseudo random shapes
+
+/**
+ * Measures of a workload
+ */
+typedef struct {
+	const char *name;		// Workload
+	uint32_t count;			// Primitives drawn
+	int64_t time_us;		// Wall time, until the last transaction was sent
+	uint32_t cycles;		// CPU cycles until the calls returned, thread CPU time in ns on linux
+	uint32_t transactions;	// Transactions queued
+	uint32_t bytes;			// Bytes queued, commands and data
+}st7789_bench_result_t;
+
+/* Benchmark functions. */
+size_t ST7789_Bench_Run(st7789_bench_result_t *results, size_t max);
+void ST7789_Bench_Print(const st7789_bench_result_t *results, size_t count);
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * @file    st7789_dl.c
+ * @brief   Display lists for the ST7789 driver
+ * @details A display list records primitives with their arguments so they
+ * 		can be replayed later, clipped to any render target.
+ */
+
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_dl.h"
+#include "st7789_internal.h"
+
+/**
+ * @brief Initialize a display list
+ * @param dl -> display list
+ * @param ops -> storage for the primitives
+ * @param size -> number of primitives ops can hold
+ * @return none
+ */
+void ST7789_DL_Init(st7789_dl_t *dl, st7789_dl_op_t *ops, uint16_t size)
+{
+	dl->ops = ops;
+	dl->size = size;
+	dl->count = 0;
+}
+
+/**
+ * @brief Remove every primitive from a display list
+ * @param dl -> display list
+ * @return none
+ */
+void ST7789_DL_Clear(st7789_dl_t *dl)
+{
+	dl->count = 0;
+}
+
+/**
+ * @brief Append a primitive to a display list
+ * @param dl -> display list
+ * @param type -> primitive type
+ * @param color -> color of the primitive
+ * @return the new primitive, NULL if the list is full
+ */
+static st7789_dl_op_t *ST7789_DL_Add(st7789_dl_t *dl, st7789_dl_type_t type, uint16_t color)
+{
+	st7789_dl_op_t *op;
+
+	if (dl->count >= dl->size)
+		return NULL;
+
+	op = &dl->ops[dl->count++];
+	memset(op, 0, sizeof(*op));
+	op->type = type;
+	op->color = color;
+	return op;
+}
+
+st7789_dl_op_t *ST7789_DL_Fill(st7789_dl_t *dl, int16_t xSta, int16_t ySta, int16_t xEnd, int16_t yEnd, uint16_t color)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_FILL, color);
+	if (op) {
+		op->line.x0 = xSta;
+		op->line.y0 = ySta;
+		op->line.x1 = xEnd;
+		op->line.y1 = yEnd;
+	}
+	return op;
+}
+
+st7789_dl_op_t *ST7789_DL_Line(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_LINE, color);
+	if (op) {
+		op->line.x0 = x1;
+		op->line.y0 = y1;
+		op->line.x1 = x2;
+		op->line.y1 = y2;
+	}
+	return op;
+}
+
+st7789_dl_op_t *ST7789_DL_Rectangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_RECT, color);
+	if (op) {
+		op->line.x0 = x1;
+		op->line.y0 = y1;
+		op->line.x1 = x2;
+		op->line.y1 = y2;
+	}
+	return op;
+}
+
+/**
+ * @brief Record a filled rectangle, a negative w or h extends it left or up
+ */
+st7789_dl_op_t *ST7789_DL_FilledRectangle(st7789_dl_t *dl, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+	st7789_dl_op_t *op;
+
+	/* Kept with x, y the top left corner so the bounds stay ordered */
+	if (w < 0) {
+		x += w;
+		w = -w;
+	}
+	if (h < 0) {
+		y += h;
+		h = -h;
+	}
+	op = ST7789_DL_Add(dl, ST7789_DL_FILLED_RECT, color);
+	if (op) {
+		op->rect.x = x;
+		op->rect.y = y;
+		op->rect.w = w;
+		op->rect.h = h;
+	}
+	return op;
+}
+
+/**
+ * @brief Record a circle, NULL for a negative radius
+ */
+st7789_dl_op_t *ST7789_DL_Circle(st7789_dl_t *dl, int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+	st7789_dl_op_t *op;
+
+	if (r < 0)
+		return NULL;
+	op = ST7789_DL_Add(dl, ST7789_DL_CIRCLE, color);
+	if (op) {
+		op->circle.x = x0;
+		op->circle.y = y0;
+		op->circle.r = r;
+	}
+	return op;
+}
+
+/**
+ * @brief Record a filled circle, NULL for a negative radius
+ */
+st7789_dl_op_t *ST7789_DL_FilledCircle(st7789_dl_t *dl, int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+	st7789_dl_op_t *op;
+
+	if (r < 0)
+		return NULL;
+	op = ST7789_DL_Add(dl, ST7789_DL_FILLED_CIRCLE, color);
+	if (op) {
+		op->circle.x = x0;
+		op->circle.y = y0;
+		op->circle.r = r;
+	}
+	return op;
+}
+
+st7789_dl_op_t *ST7789_DL_Triangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_TRIANGLE, color);
+	if (op) {
+		op->tri.x[0] = x1; op->tri.y[0] = y1;
+		op->tri.x[1] = x2; op->tri.y[1] = y2;
+		op->tri.x[2] = x3; op->tri.y[2] = y3;
+	}
+	return op;
+}
+
+st7789_dl_op_t *ST7789_DL_FilledTriangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_FILLED_TRIANGLE, color);
+	if (op) {
+		op->tri.x[0] = x1; op->tri.y[0] = y1;
+		op->tri.x[1] = x2; op->tri.y[1] = y2;
+		op->tri.x[2] = x3; op->tri.y[2] = y3;
+	}
+	return op;
+}
+
+/**
+ * @brief Record a string, str is referenced and must outlive the display list
+ */
+st7789_dl_op_t *ST7789_DL_String(st7789_dl_t *dl, int16_t x, int16_t y, const char *str, const FontDef *font, uint16_t color, uint16_t bgcolor)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_TEXT, color);
+	if (op) {
+		op->text.x = x;
+		op->text.y = y;
+		op->text.str = str;
+		op->text.font = font;
+		op->text.bgcolor = bgcolor;
+	}
+	return op;
+}
+
+/**
+ * @brief Record an image, data is referenced and must outlive the display list
+ */
+st7789_dl_op_t *ST7789_DL_Image(st7789_dl_t *dl, int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+{
+	st7789_dl_op_t *op = ST7789_DL_Add(dl, ST7789_DL_IMAGE, 0);
+	if (op) {
+		op->image.x = x;
+		op->image.y = y;
+		op->image.w = w;
+		op->image.h = h;
+		op->image.data = data;
+	}
+	return op;
+}
+
+/**
+ * @brief Screen area a primitive can touch
+ * @param op -> primitive
+ * @param r -> bounding rectangle, inclusive
+ * @return none
+ */
+void ST7789_DL_Bounds(const st7789_dl_op_t *op, st7789_rect_t *r)
+{
+	switch (op->type) {
+	case ST7789_DL_FILL:
+	case ST7789_DL_LINE:
+	case ST7789_DL_RECT:
+		r->x0 = op->line.x0 < op->line.x1 ? op->line.x0 : op->line.x1;
+		r->x1 = op->line.x0 < op->line.x1 ? op->line.x1 : op->line.x0;
+		r->y0 = op->line.y0 < op->line.y1 ? op->line.y0 : op->line.y1;
+		r->y1 = op->line.y0 < op->line.y1 ? op->line.y1 : op->line.y0;
+		break;
+	case ST7789_DL_FILLED_RECT:
+		/* ST7789_DrawFilledRectangle covers w + 1 columns and h + 1 rows */
+		r->x0 = op->rect.x;
+		r->y0 = op->rect.y;
+		r->x1 = op->rect.x + op->rect.w;
+		r->y1 = op->rect.y + op->rect.h;
+		break;
+	case ST7789_DL_CIRCLE:
+	case ST7789_DL_FILLED_CIRCLE:
+		r->x0 = op->circle.x - op->circle.r;
+		r->y0 = op->circle.y - op->circle.r;
+		r->x1 = op->circle.x + op->circle.r;
+		r->y1 = op->circle.y + op->circle.r;
+		break;
+	case ST7789_DL_TRIANGLE:
+	case ST7789_DL_FILLED_TRIANGLE:
+		r->x0 = r->x1 = op->tri.x[0];
+		r->y0 = r->y1 = op->tri.y[0];
+		for (uint8_t i = 1; i < 3; i++) {
+			if (op->tri.x[i] < r->x0) r->x0 = op->tri.x[i];
+			if (op->tri.x[i] > r->x1) r->x1 = op->tri.x[i];
+			if (op->tri.y[i] < r->y0) r->y0 = op->tri.y[i];
+			if (op->tri.y[i] > r->y1) r->y1 = op->tri.y[i];
+		}
+		break;
+	case ST7789_DL_TEXT: {
+		const st7789_ctx_t *ctx = ST7789_Ctx();
+		int32_t w = (int32_t)strlen(op->text.str) * op->text.font->width;
+		r->x0 = op->text.x;
+		r->y0 = op->text.y;
+		r->x1 = op->text.x + w - 1;
+		r->y1 = op->text.y + op->text.font->height - 1;
+		if (op->text.x + w >= ctx->width) {
+			/* ST7789_WriteString wraps to column 0 */
+			r->x0 = 0;
+			r->x1 = ctx->width - 1;
+			r->y1 = ctx->height - 1;
+		}
+		break;
+	}
+	case ST7789_DL_IMAGE:
+		r->x0 = op->image.x;
+		r->y0 = op->image.y;
+		r->x1 = op->image.x + op->image.w - 1;
+		r->y1 = op->image.y + op->image.h - 1;
+		break;
+	default: {
+		const st7789_ctx_t *ctx = ST7789_Ctx();
+		r->x0 = 0;
+		r->y0 = 0;
+		r->x1 = ctx->width - 1;
+		r->y1 = ctx->height - 1;
+		break;
+	}
+	}
+}
+
+/**
+ * @brief Draw a recorded primitive on the current render target
+ * @param op -> primitive
+ * @return none
+ */
+void ST7789_DL_Exec(const st7789_dl_op_t *op)
+{
+	if (op->hidden)
+		return;
+
+	switch (op->type) {
+	case ST7789_DL_FILL:
+		ST7789_FillArea(op->line.x0, op->line.y0, op->line.x1, op->line.y1, op->color);
+		break;
+	case ST7789_DL_LINE:
+		ST7789_DrawLine(op->line.x0, op->line.y0, op->line.x1, op->line.y1, op->color);
+		break;
+	case ST7789_DL_RECT:
+		ST7789_DrawRectangle(op->line.x0, op->line.y0, op->line.x1, op->line.y1, op->color);
+		break;
+	case ST7789_DL_FILLED_RECT:
+		ST7789_DrawFilledRectangle(op->rect.x, op->rect.y, op->rect.w, op->rect.h, op->color);
+		break;
+	case ST7789_DL_CIRCLE:
+		ST7789_DrawCircle(op->circle.x, op->circle.y, op->circle.r, op->color);
+		break;
+	case ST7789_DL_FILLED_CIRCLE:
+		ST7789_DrawFilledCircle(op->circle.x, op->circle.y, op->circle.r, op->color);
+		break;
+	case ST7789_DL_TRIANGLE:
+		ST7789_DrawTriangle(op->tri.x[0], op->tri.y[0], op->tri.x[1], op->tri.y[1],
+				op->tri.x[2], op->tri.y[2], op->color);
+		break;
+	case ST7789_DL_FILLED_TRIANGLE:
+		ST7789_DrawFilledTriangle(op->tri.x[0], op->tri.y[0], op->tri.x[1], op->tri.y[1],
+				op->tri.x[2], op->tri.y[2], op->color);
+		break;
+	case ST7789_DL_TEXT:
+		ST7789_WriteString(op->text.x, op->text.y, op->text.str, *op->text.font, op->color, op->text.bgcolor);
+		break;
+	case ST7789_DL_IMAGE:
+		ST7789_DrawImage(op->image.x, op->image.y, op->image.w, op->image.h, op->image.data);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,78 @@
+/**
+ * @file    st7789_dl.h
+ * @brief   Display lists and band renderer for the ST7789 driver.
+ * @note    A display list records ST7789 primitives instead of drawing them.
+ *     The band renderer replays it once per horizontal strip into two small
+ *     ping-pong buffers, so a whole scene is composed in RAM without a full
+ *     framebuffer and the SPI bus sends one strip while the next is drawn.
+ */
+
+#ifndef __ST7789_DL_H
+#define __ST7789_DL_H
+
+#include "st7789.h"
+
+/**
+ * Primitives a display list can hold, one per ST7789_Draw* function
+ */
+typedef enum {
+	ST7789_DL_FILL = 0,			// ST7789_Fill
+	ST7789_DL_LINE,				// ST7789_DrawLine
+	ST7789_DL_RECT,				// ST7789_DrawRectangle
+	ST7789_DL_FILLED_RECT,		// ST7789_DrawFilledRectangle
+	ST7789_DL_CIRCLE,			// ST7789_DrawCircle
+	ST7789_DL_FILLED_CIRCLE,	// ST7789_DrawFilledCircle
+	ST7789_DL_TRIANGLE,			// ST7789_DrawTriangle
+	ST7789_DL_FILLED_TRIANGLE,	// ST7789_DrawFilledTriangle
+	ST7789_DL_TEXT,				// ST7789_WriteString
+	ST7789_DL_IMAGE,			// ST7789_DrawImage
+}st7789_dl_type_t;
+
+/**
+ * One recorded primitive. Text and image data are referenced, not copied.
+ */
+typedef struct {
+	st7789_dl_type_t type;
+	uint8_t hidden;		// Skipped on replay
+	uint16_t color;
+	union {
+		struct { int16_t x0, y0, x1, y1; } line;	// FILL, LINE and RECT
+		struct { int16_t x, y, w, h; } rect;		// FILLED_RECT
+		struct { int16_t x, y, r; } circle;			// CIRCLE and FILLED_CIRCLE
+		struct { int16_t x[3], y[3]; } tri;			// TRIANGLE and FILLED_TRIANGLE
+		struct { int16_t x, y; const char *str; const FontDef *font; uint16_t bgcolor; } text;
+		struct { int16_t x, y; uint16_t w, h; const uint8_t *data; } image;
+	};
+}st7789_dl_op_t;
+
+/**
+ * Display list, storage is provided by the caller
+ */
+typedef struct {
+	st7789_dl_op_t *ops;
+	uint16_t count;
+	uint16_t size;
+}st7789_dl_t;
+
+/* Display list functions. */
+void ST7789_DL_Init(st7789_dl_t *dl, st7789_dl_op_t *ops, uint16_t size);
+void ST7789_DL_Clear(st7789_dl_t *dl);
+st7789_dl_op_t *ST7789_DL_Fill(st7789_dl_t *dl, int16_t xSta, int16_t ySta, int16_t xEnd, int16_t yEnd, uint16_t color);
+st7789_dl_op_t *ST7789_DL_Line(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+st7789_dl_op_t *ST7789_DL_Rectangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+st7789_dl_op_t *ST7789_DL_FilledRectangle(st7789_dl_t *dl, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+st7789_dl_op_t *ST7789_DL_Circle(st7789_dl_t *dl, int16_t x0, int16_t y0, int16_t r, uint16_t color);
+st7789_dl_op_t *ST7789_DL_FilledCircle(st7789_dl_t *dl, int16_t x0, int16_t y0, int16_t r, uint16_t color);
+st7789_dl_op_t *ST7789_DL_Triangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color);
+st7789_dl_op_t *ST7789_DL_FilledTriangle(st7789_dl_t *dl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, uint16_t color);
+st7789_dl_op_t *ST7789_DL_String(st7789_dl_t *dl, int16_t x, int16_t y, const char *str, const FontDef *font, uint16_t color, uint16_t bgcolor);
+st7789_dl_op_t *ST7789_DL_Image(st7789_dl_t *dl, int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data);
+void ST7789_DL_Bounds(const st7789_dl_op_t *op, st7789_rect_t *r);
+void ST7789_DL_Exec(const st7789_dl_op_t *op);
+
+/* Band renderer functions. */
+esp_err_t ST7789_Band_Init(void);
+void ST7789_Band_Deinit(void);
+void ST7789_Band_Render(const st7789_dl_t *dl, const st7789_rect_t *area, uint16_t bgcolor);
+
+#endif
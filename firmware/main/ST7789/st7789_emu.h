@@ -0,0 +1,49 @@
+/**
+ * @file    st7789_emu.h
+ * @brief   Emulated ST7789 controller of the linux target.
+ * @note    Built for the linux target of ESP-IDF, in place of the SPI master:
+ *
+ *         idf.py --preview -B build-linux -D SDKCONFIG=sdkconfig.linux \
+ *             -D SDKCONFIG_DEFAULTS=sdkconfig.defaults.linux set-target linux build
+ *
+ *     The driver runs unchanged and every transaction it queues is decoded
+ *     the way the controller would: DC, CASET/RASET windows, RAMWR/RAMWRC
+ *     with the memory pointer moving in the order MADCTL gives, and the
+ *     scrolling area of VSCRDEF/VSCRSADD. Pixels land in a 240x320 GRAM that
+ *     can be read back or saved as PNG, and the stream is counted so the wire
+ *     cost of each primitive can be measured.
+ *
+ *     Transactions complete as soon as they are queued. Partial and idle
+ *     mode, inversion and the gamma settings are accepted but not rendered.
+ *     Like the rest of the driver, the functions work on the display of the
+ *     calling task.
+ */
+
+#ifndef __ST7789_EMU_H
+#define __ST7789_EMU_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+/**
+ * Traffic seen by the emulated controller
+ */
+typedef struct {
+	uint32_t transactions;	// Transactions queued
+	uint32_t bytes;			// Bytes on the wire, commands, parameters and pixels
+	uint32_t commands;		// Command bytes, sent with DC low
+	uint32_t params;		// Parameter bytes of the commands other than RAMWR/RAMWRC
+	uint32_t windows;		// CASET and RASET commands
+	uint32_t pixels;		// Pixels written to GRAM
+}st7789_emu_stats_t;
+
+/* Emulator functions. */
+void ST7789_Emu_GetStats(st7789_emu_stats_t *stats);
+void ST7789_Emu_ResetStats(void);
+uint16_t ST7789_Emu_GetPixel(uint16_t x, uint16_t y);
+uint16_t ST7789_Emu_GetScreenPixel(uint16_t x, uint16_t y);
+esp_err_t ST7789_Emu_SavePNG(const char *path);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file    st7789_fb.c
+ * @brief   Optional RAM framebuffer for the ST7789 driver
+ * @details When the framebuffer is enabled every primitive draws into
+ * 		disp_buf of the display and records the area it touched.
+ * 		ST7789_Flush() then sends only those dirty rectangles to the panel,
+ * 		one address window each.
+ */
+
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_internal.h"
+
+/**
+ * @brief Record an area of the framebuffer that differs from the panel
+ * @param x0&y0 -> top left corner
+ * @param x1&y1 -> bottom right corner, inclusive
+ * @return none
+ */
+void ST7789_FB_MarkDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_rect_t r = {x0, y0, x1, y1};
+
+	ctx->dirty_count = ST7789_RectListAdd(ctx->dirty, ctx->dirty_count, ST7789_DIRTY_MAX, &r);
+}
+
+/**
+ * @brief Enable the framebuffer, primitives draw in RAM from now on
+ * @note  The framebuffer starts black and fully dirty, so the first flush
+ *        brings the panel in sync with it.
+ * @return ESP_OK, ESP_ERR_NO_MEM if the framebuffer cannot be allocated
+ */
+esp_err_t ST7789_FB_Enable(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	size_t pixels = (size_t)ctx->width * ctx->height;
+
+	ST7789_Select();
+	if (ctx->disp_buf) {
+		ST7789_UnSelect();
+		return ESP_OK;
+	}
+
+	ctx->disp_buf = heap_caps_malloc(pixels * 2, MALLOC_CAP_8BIT);
+	if (ctx->disp_buf == NULL) {
+		ESP_LOGE(TAG, "No memory for a %ux%u framebuffer", ctx->width, ctx->height);
+		ST7789_UnSelect();
+		return ESP_ERR_NO_MEM;
+	}
+	memset(ctx->disp_buf, 0, pixels * 2);
+
+	ctx->fb.buf = ctx->disp_buf;
+	ctx->fb.x = 0;
+	ctx->fb.y = 0;
+	ctx->fb.w = ctx->width;
+	ctx->fb.h = ctx->height;
+	ctx->fb.stride = ctx->width;
+	ctx->target = &ctx->fb;
+
+	ctx->dirty_count = 0;
+	ST7789_FB_MarkDirty(0, 0, ctx->width - 1, ctx->height - 1);
+	ST7789_UnSelect();
+	return ESP_OK;
+}
+
+/**
+ * @brief Flush and release the framebuffer, primitives draw to the panel again
+ * @return none
+ */
+void ST7789_FB_Disable(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	if (ctx->disp_buf) {
+		ST7789_Flush();
+		if (ctx->target == &ctx->fb)
+			ctx->target = NULL;	// A band or other RAM target stays in place
+		heap_caps_free(ctx->disp_buf);
+		ctx->disp_buf = NULL;
+		ctx->fb.buf = NULL;
+	}
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Send the dirty rectangles of the framebuffer to the panel
+ * @note  Pixels are copied in the DMA buffers when queued, drawing can
+ *        continue in the framebuffer as soon as this returns.
+ * @return none
+ */
+void ST7789_Flush(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_FLUSH);
+	if (ctx->disp_buf == NULL) {
+		ST7789_UnSelect();
+		return;
+	}
+
+	for (uint8_t i = 0; i < ctx->dirty_count; i++) {
+		st7789_rect_t *r = &ctx->dirty[i];
+		ST7789_SetAddressWindow(r->x0, r->y0, r->x1, r->y1);
+		ST7789_WriteRect(ctx->disp_buf + (size_t)r->y0 * ctx->width + r->x0,
+				r->x1 - r->x0 + 1, r->y1 - r->y0 + 1, ctx->width);
+	}
+	ctx->dirty_count = 0;
+	ST7789_Trace_Frame();
+	ST7789_UnSelect();
+	ST7789_Power_Update();
+}
@@ -0,0 +1,402 @@
+/**
+ * @file    st7789_font.c
+ * @brief   Anti-aliased proportional text for the ST7789 driver
+ * @details Glyph coverage is blended between the text color and either a
+ * 		background color or the pixels already on a RAM render target. With a
+ * 		background color every line is composed in one strip and sent in a
+ * 		single address window.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_font.h"
+#include "st7789_internal.h"
+
+/**
+ * Position in a line of text
+ */
+typedef struct {
+	const char *str;	// Next byte to decode
+	uint32_t prev;		// Previous code point, 0 at the start of the line
+	int16_t pen;		// Pen position from the start of the line
+}st7789_text_iter_t;
+
+/**
+ * @brief Load a font stored in memory, the data is used in place
+ * @param font -> font to initialize
+ * @param data -> font file contents, 4 bytes aligned
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if data is not a font,
+ *         ESP_ERR_INVALID_VERSION for an unknown version,
+ *         ESP_ERR_INVALID_SIZE if data is truncated
+ */
+esp_err_t ST7789_Font_Load(st7789_font_t *font, const void *data, size_t size)
+{
+	const st7789_font_header_t *hdr = data;
+	const uint8_t *p = data;
+	size_t tables;
+
+	memset(font, 0, sizeof(*font));
+	if (size < sizeof(*hdr) || memcmp(hdr->magic, ST7789_FONT_MAGIC, 4) != 0)
+		return ESP_ERR_INVALID_ARG;
+	if (hdr->version != ST7789_FONT_VERSION)
+		return ESP_ERR_INVALID_VERSION;
+	if (hdr->bpp != 1 && hdr->bpp != 2 && hdr->bpp != 4)
+		return ESP_ERR_INVALID_ARG;
+
+	tables = sizeof(*hdr) + hdr->count * sizeof(st7789_font_glyph_t) + hdr->kern_count * sizeof(st7789_font_kern_t);
+	if (size < tables || hdr->bitmap_size > size - tables)
+		return ESP_ERR_INVALID_SIZE;
+
+	font->header = hdr;
+	font->glyphs = (const st7789_font_glyph_t *)(p + sizeof(*hdr));
+	font->kerns = (const st7789_font_kern_t *)(font->glyphs + hdr->count);
+	font->bitmaps = p + tables;
+
+	for (uint16_t i = 0; i < hdr->count; i++) {
+		const st7789_font_glyph_t *g = &font->glyphs[i];
+		uint32_t len = ((uint32_t)g->width * g->height * hdr->bpp + 7) / 8;
+		/* Written so that a crafted offset cannot wrap past the check */
+		if (g->offset > hdr->bitmap_size || len > hdr->bitmap_size - g->offset) {
+			memset(font, 0, sizeof(*font));
+			return ESP_ERR_INVALID_SIZE;
+		}
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief Load a font from a file, e.g. on the storage SPIFFS partition
+ * @note  The filesystem must be mounted. Release the font with ST7789_Font_Free.
+ * @param font -> font to initialize
+ * @param path -> file path, e.g. "/spiffs/digits.fnt"
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the file cannot be read,
+ *         ESP_ERR_NO_MEM, or an error of ST7789_Font_Load
+ */
+esp_err_t ST7789_Font_LoadFile(st7789_font_t *font, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	void *data;
+	long size;
+	esp_err_t err;
+
+	memset(font, 0, sizeof(*font));
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Cannot open font %s", path);
+		return ESP_ERR_NOT_FOUND;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size <= 0) {
+		fclose(f);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	data = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	if (data == NULL) {
+		fclose(f);
+		ESP_LOGE(TAG, "No memory for font %s", path);
+		return ESP_ERR_NO_MEM;
+	}
+	if (fread(data, 1, size, f) != (size_t)size) {
+		fclose(f);
+		heap_caps_free(data);
+		return ESP_ERR_NOT_FOUND;
+	}
+	fclose(f);
+
+	err = ST7789_Font_Load(font, data, size);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Invalid font %s", path);
+		heap_caps_free(data);
+		return err;
+	}
+	font->alloc = data;
+	return ESP_OK;
+}
+
+/**
+ * @brief Release a font loaded with ST7789_Font_LoadFile
+ * @param font -> font
+ * @return none
+ */
+void ST7789_Font_Free(st7789_font_t *font)
+{
+	heap_caps_free(font->alloc);
+	memset(font, 0, sizeof(*font));
+}
+
+/**
+ * @brief Decode the next UTF-8 code point
+ * @param str -> string, advanced past the code point
+ * @return code point
+ */
+static uint32_t ST7789_Utf8Next(const char **str)
+{
+	const uint8_t *s = (const uint8_t *)*str;
+	uint32_t c = *s++;
+	uint8_t extra = 0;
+
+	if (c >= 0xF0) {
+		c &= 0x07;
+		extra = 3;
+	} else if (c >= 0xE0) {
+		c &= 0x0F;
+		extra = 2;
+	} else if (c >= 0xC0) {
+		c &= 0x1F;
+		extra = 1;
+	}
+	while (extra-- && (*s & 0xC0) == 0x80)
+		c = (c << 6) | (*s++ & 0x3F);
+
+	*str = (const char *)s;
+	return c;
+}
+
+/**
+ * @brief Find the glyph of a code point, '?' stands for missing glyphs
+ * @param font -> font
+ * @param code -> code point
+ * @return glyph, NULL if neither the code point nor '?' are in the font
+ */
+static const st7789_font_glyph_t *ST7789_Font_Glyph(const st7789_font_t *font, uint32_t code)
+{
+	const st7789_font_header_t *hdr = font->header;
+
+	if (code >= hdr->first && code - hdr->first < hdr->count)
+		return &font->glyphs[code - hdr->first];
+	if ('?' >= hdr->first && '?' - hdr->first < hdr->count)
+		return &font->glyphs['?' - hdr->first];
+	return NULL;
+}
+
+/**
+ * @brief Kerning between two code points
+ * @param font -> font
+ * @param left&right -> code points of the pair
+ * @return pixels to add to the advance of left
+ */
+static int16_t ST7789_Font_Kern(const st7789_font_t *font, uint32_t left, uint32_t right)
+{
+	uint32_t key = (left << 16) | right;
+	int32_t lo = 0, hi = (int32_t)font->header->kern_count - 1;
+
+	while (lo <= hi) {
+		int32_t mid = (lo + hi) / 2;
+		const st7789_font_kern_t *k = &font->kerns[mid];
+		uint32_t kkey = ((uint32_t)k->left << 16) | k->right;
+		if (kkey == key)
+			return k->adjust;
+		if (kkey < key)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Step to the next glyph of a line
+ * @param font -> font
+ * @param it -> position in the line, updated
+ * @param pen -> pen position of the glyph
+ * @return glyph, NULL at the end of the line
+ */
+static const st7789_font_glyph_t *ST7789_Text_Next(const st7789_font_t *font, st7789_text_iter_t *it, int16_t *pen)
+{
+	const st7789_font_glyph_t *g = NULL;
+
+	while (g == NULL) {
+		if (*it->str == '\0' || *it->str == '\n')
+			return NULL;
+		uint32_t code = ST7789_Utf8Next(&it->str);
+		g = ST7789_Font_Glyph(font, code);
+		if (g == NULL)
+			continue;
+		if (it->prev && font->header->kern_count)
+			it->pen += ST7789_Font_Kern(font, it->prev, code);
+		it->prev = code;
+	}
+	*pen = it->pen;
+	it->pen += g->advance;
+	return g;
+}
+
+/**
+ * @brief Width of a text, the widest line when it has several
+ * @param font -> font
+ * @param str -> UTF-8 text
+ * @return sum of the advances of the widest line, in pixels
+ */
+int16_t ST7789_Font_TextWidth(const st7789_font_t *font, const char *str)
+{
+	int16_t width = 0;
+	int16_t pen;
+
+	while (1) {
+		st7789_text_iter_t it = {str, 0, 0};
+		while (ST7789_Text_Next(font, &it, &pen))
+			;
+		if (it.pen > width)
+			width = it.pen;
+		if (*it.str != '\n')
+			break;
+		str = it.str + 1;
+	}
+	return width;
+}
+
+/**
+ * @brief Blend a glyph into a RAM surface
+ * @param font -> font
+ * @param g -> glyph
+ * @param s -> surface
+ * @param x&y -> screen position of the glyph bitmap
+ * @param clip -> part of the surface to draw, screen coordinates, inclusive
+ * @param color -> text color
+ * @return none
+ */
+static void ST7789_Font_Blend(const st7789_font_t *font, const st7789_font_glyph_t *g, const st7789_surface_t *s,
+		int16_t x, int16_t y, const st7789_rect_t *clip, uint16_t color)
+{
+	const uint8_t *bits = font->bitmaps + g->offset;
+	uint8_t bpp = font->header->bpp;
+	uint8_t max = (1 << bpp) - 1;
+	uint16_t fg = (color >> 8) | (color << 8);
+	uint8_t alpha[16];
+	st7789_rect_t r = {x, y, x + g->width - 1, y + g->height - 1};
+
+	if (r.x0 < clip->x0) r.x0 = clip->x0;
+	if (r.y0 < clip->y0) r.y0 = clip->y0;
+	if (r.x1 > clip->x1) r.x1 = clip->x1;
+	if (r.y1 > clip->y1) r.y1 = clip->y1;
+	if (r.x0 > r.x1 || r.y0 > r.y1)
+		return;
+
+	/* Coverage to 0..32 alpha */
+	for (uint8_t i = 0; i <= max; i++)
+		alpha[i] = (i * 32 + max / 2) / max;
+
+	for (int16_t py = r.y0; py <= r.y1; py++) {
+		uint16_t *dst = s->buf + (size_t)(py - s->y) * s->stride + (r.x0 - s->x);
+		uint32_t bit = ((uint32_t)(py - y) * g->width + (r.x0 - x)) * bpp;
+		for (int16_t px = r.x0; px <= r.x1; px++, dst++, bit += bpp) {
+			uint8_t cov = (bits[bit >> 3] >> (8 - bpp - (bit & 7))) & max;
+			if (cov == 0)
+				continue;
+			if (cov == max) {
+				*dst = fg;
+				continue;
+			}
+			uint16_t bg = (*dst >> 8) | (*dst << 8);
+			uint16_t out = ST7789_Blend565(color, bg, alpha[cov]);
+			*dst = (out >> 8) | (out << 8);
+		}
+	}
+}
+
+/**
+ * @brief Write an anti-aliased text over a background color
+ * @note  Each line is composed in RAM and sent in a single address window.
+ *        '\n' starts a new line at x, font height rows below.
+ * @param x&y -> top left corner of the first line
+ * @param str -> UTF-8 text
+ * @param font -> font
+ * @param color -> color of the text
+ * @param bgcolor -> background color of the text
+ * @return none
+ */
+void ST7789_DrawText(int16_t x, int16_t y, const char *str, const st7789_font_t *font, uint16_t color, uint16_t bgcolor)
+{
+	uint16_t h = font->header->height;
+	uint16_t bg = (bgcolor >> 8) | (bgcolor << 8);
+	const st7789_font_glyph_t *g;
+	int16_t pen;
+
+	ST7789_Select();	// The text strip is shared
+	while (1) {
+		/* Columns the line touches, ink and advances */
+		st7789_text_iter_t it = {str, 0, 0};
+		int16_t x0 = 0, x1 = 0;
+		while ((g = ST7789_Text_Next(font, &it, &pen))) {
+			if (g->width && pen + g->left < x0) x0 = pen + g->left;
+			if (g->width && pen + g->left + g->width > x1) x1 = pen + g->left + g->width;
+		}
+		if (it.pen > x1) x1 = it.pen;
+
+		uint16_t w = x1 - x0;
+		uint16_t *buf = w ? ST7789_TextStrip((uint32_t)w * h) : NULL;
+		if (buf) {
+			st7789_surface_t strip = {buf, x + x0, y, w, h, w};
+			st7789_rect_t all = {strip.x, strip.y, strip.x + w - 1, strip.y + h - 1};
+
+			for (uint32_t i = 0; i < (uint32_t)w * h; i++)
+				buf[i] = bg;
+			it = (st7789_text_iter_t){str, 0, 0};
+			while ((g = ST7789_Text_Next(font, &it, &pen)))
+				ST7789_Font_Blend(font, g, &strip, x + pen + g->left, y + g->top, &all, color);
+			ST7789_BlitArea(strip.x, strip.y, w, h, (const uint8_t *)buf);
+		} else if (w) {
+			ESP_LOGE(TAG, "No memory for a %ux%u text strip", w, h);
+		}
+
+		if (*it.str != '\n')
+			break;
+		str = it.str + 1;
+		y += h;
+	}
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Write an anti-aliased text blended into the pixels of the render target
+ * @note  Blending reads the target back, so it needs the framebuffer or a band
+ *        strip. On the panel, which cannot be read back, the text is drawn
+ *        over black.
+ * @param x&y -> top left corner of the first line
+ * @param str -> UTF-8 text
+ * @param font -> font
+ * @param color -> color of the text
+ * @return none
+ */
+void ST7789_DrawTextBlend(int16_t x, int16_t y, const char *str, const st7789_font_t *font, uint16_t color)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	const st7789_font_glyph_t *g;
+	int16_t pen;
+
+	ST7789_Select();
+	s = ctx->target;
+	if (s == NULL) {
+		ST7789_DrawText(x, y, str, font, color, BLACK);
+		ST7789_UnSelect();
+		return;
+	}
+
+	while (1) {
+		st7789_text_iter_t it = {str, 0, 0};
+		while ((g = ST7789_Text_Next(font, &it, &pen))) {
+			st7789_rect_t r = {x + pen + g->left, y + g->top, 0, 0};
+			r.x1 = r.x0 + g->width - 1;
+			r.y1 = r.y0 + g->height - 1;
+			if (!g->width || !g->height || !ST7789_ClipToTarget(&r))
+				continue;
+			ST7789_Font_Blend(font, g, s, x + pen + g->left, y + g->top, &r, color);
+			if (s == &ctx->fb)
+				ST7789_FB_MarkDirty(r.x0, r.y0, r.x1, r.y1);
+		}
+
+		if (*it.str != '\n')
+			break;
+		str = it.str + 1;
+		y += font->header->height;
+	}
+	ST7789_UnSelect();
+}
@@ -0,0 +1,80 @@
+/**
+ * @file    st7789_font.h
+ * @brief   Anti-aliased proportional fonts for the ST7789 driver.
+ * @note    Fonts are binary blobs made by tools/mkfont.py from a TTF file.
+ *     Each glyph has its own metrics and a bitmap cropped to its ink, holding
+ *     1, 2 or 4 bits of coverage per pixel packed MSB first, rows back to
+ *     back. Kerning pairs are sorted so they can be binary searched.
+ *
+ *     File layout, little endian, offsets from the start of the file:
+ *         st7789_font_header_t
+ *         st7789_font_glyph_t[count]
+ *         st7789_font_kern_t[kern_count]
+ *         glyph bitmaps, bitmap_size bytes
+ *
+ *     A font is used in place, from a flash array (e.g. EMBED_FILES in the
+ *     component CMakeLists.txt) or from a file read into RAM.
+ */
+
+#ifndef __ST7789_FONT_H
+#define __ST7789_FONT_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_FONT_MAGIC    "S7FN"
+#define ST7789_FONT_VERSION  1
+
+typedef struct {
+	uint8_t magic[4];		// ST7789_FONT_MAGIC
+	uint8_t version;		// ST7789_FONT_VERSION
+	uint8_t bpp;			// Coverage bits per pixel: 1, 2 or 4
+	uint8_t height;			// Line height in pixels
+	uint8_t baseline;		// Rows from the top of the line to the baseline
+	uint16_t first;			// Code point of the first glyph
+	uint16_t count;			// Number of glyphs
+	uint16_t kern_count;	// Number of kerning pairs
+	uint16_t reserved;
+	uint32_t bitmap_size;	// Bytes of glyph bitmaps
+}st7789_font_header_t;
+
+typedef struct {
+	uint32_t offset;		// Bitmap offset in the bitmap block
+	uint8_t width;			// Bitmap width, 0 for a glyph without ink
+	uint8_t height;			// Bitmap height
+	uint8_t advance;		// Pen advance after the glyph
+	int8_t left;			// Columns from the pen to the bitmap
+	int8_t top;				// Rows from the top of the line to the bitmap
+	uint8_t reserved[3];
+}st7789_font_glyph_t;
+
+typedef struct {
+	uint16_t left;			// Code point of the first glyph of the pair
+	uint16_t right;			// Code point of the second glyph of the pair
+	int16_t adjust;			// Pixels added to the advance between the two
+}st7789_font_kern_t;
+
+/**
+ * A loaded font, pointing into the font data
+ */
+typedef struct {
+	const st7789_font_header_t *header;
+	const st7789_font_glyph_t *glyphs;
+	const st7789_font_kern_t *kerns;
+	const uint8_t *bitmaps;
+	void *alloc;			// Data read by ST7789_Font_LoadFile, NULL otherwise
+}st7789_font_t;
+
+/* Font functions. */
+esp_err_t ST7789_Font_Load(st7789_font_t *font, const void *data, size_t size);
+esp_err_t ST7789_Font_LoadFile(st7789_font_t *font, const char *path);
+void ST7789_Font_Free(st7789_font_t *font);
+int16_t ST7789_Font_TextWidth(const st7789_font_t *font, const char *str);
+
+/* Text functions. */
+void ST7789_DrawText(int16_t x, int16_t y, const char *str, const st7789_font_t *font, uint16_t color, uint16_t bgcolor);
+void ST7789_DrawTextBlend(int16_t x, int16_t y, const char *str, const st7789_font_t *font, uint16_t color);
+
+#endif
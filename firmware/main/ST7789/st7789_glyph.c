@@ -0,0 +1,184 @@
+/**
+ * @file    st7789_glyph.c
+ * @brief   Glyph cache for the ST7789 text functions
+ * @details FontDef glyphs are 1 bit per pixel. Drawing one means expanding
+ * 		every bit to an RGB565 pixel. The cache keeps the expanded glyph for a
+ * 		(font, char, color, bgcolor) tuple, ready to send, and drops the least
+ * 		recently used glyphs to stay within a memory budget. Each display
+ * 		has its own cache, under the lock of the display.
+ */
+
+#include <string.h>
+#include "esp_heap_caps.h"
+
+#include "st7789.h"
+#include "st7789_internal.h"
+
+typedef struct st7789_glyph {
+	struct st7789_glyph *hnext;		// Next glyph in the same bucket
+	struct st7789_glyph *prev;		// LRU list, head is the most recent
+	struct st7789_glyph *next;
+	const uint16_t *font;			// FontDef data, identifies the font
+	uint16_t color;
+	uint16_t bgcolor;
+	char ch;
+	uint8_t width;
+	uint8_t height;
+	uint16_t pixels[];				// Panel byte order
+}st7789_glyph_t;
+
+static uint32_t GlyphHash(const uint16_t *font, char ch, uint16_t color, uint16_t bgcolor)
+{
+	uint32_t h = (uint32_t)(uintptr_t)font >> 2;
+
+	h = h * 31 + (uint8_t)ch;
+	h = h * 31 + color;
+	h = h * 31 + bgcolor;
+	return h & (ST7789_GLYPH_BUCKETS - 1);
+}
+
+static uint32_t GlyphSize(uint8_t width, uint8_t height)
+{
+	return sizeof(st7789_glyph_t) + (uint32_t)width * height * 2;
+}
+
+static void GlyphUnlink(st7789_glyph_cache_t *cache, st7789_glyph_t *g)
+{
+	if (g->prev) g->prev->next = g->next;
+	else cache->head = g->next;
+	if (g->next) g->next->prev = g->prev;
+	else cache->tail = g->prev;
+}
+
+static void GlyphPushFront(st7789_glyph_cache_t *cache, st7789_glyph_t *g)
+{
+	g->prev = NULL;
+	g->next = cache->head;
+	if (cache->head)
+		cache->head->prev = g;
+	cache->head = g;
+	if (cache->tail == NULL)
+		cache->tail = g;
+}
+
+static void GlyphEvict(st7789_glyph_cache_t *cache, st7789_glyph_t *g)
+{
+	st7789_glyph_t **link = &cache->buckets[GlyphHash(g->font, g->ch, g->color, g->bgcolor)];
+
+	while (*link != g)
+		link = &(*link)->hnext;
+	*link = g->hnext;
+
+	GlyphUnlink(cache, g);
+	cache->used -= GlyphSize(g->width, g->height);
+	heap_caps_free(g);
+}
+
+/**
+ * @brief Expand a 1 bpp glyph to RGB565
+ * @param font -> font of the glyph
+ * @param ch -> char to expand
+ * @param fg&bg -> colors, panel byte order
+ * @param out -> font.width * font.height pixels
+ * @return none
+ */
+static void GlyphExpand(const FontDef *font, char ch, uint16_t fg, uint16_t bg, uint16_t *out)
+{
+	const uint16_t *rows = &font->data[(ch - 32) * font->height];
+
+	for (uint8_t i = 0; i < font->height; i++) {
+		uint32_t b = rows[i];
+		for (uint8_t j = 0; j < font->width; j++)
+			*(out++) = ((b << j) & 0x8000) ? fg : bg;
+	}
+}
+
+/**
+ * @brief Get the RGB565 pixels of a glyph, from the cache when possible
+ * @param font -> font of the glyph
+ * @param ch -> char, printable ASCII, others are drawn as a space
+ * @param color -> color of the char
+ * @param bgcolor -> background color of the char
+ * @param scratch -> font.width * font.height pixels used when the glyph
+ *        cannot be cached
+ * @return font.height rows of font.width pixels, panel byte order
+ */
+const uint16_t *ST7789_Glyph_Get(const FontDef *font, char ch, uint16_t color, uint16_t bgcolor, uint16_t *scratch)
+{
+	st7789_glyph_cache_t *cache = &ST7789_Ctx()->glyphs;
+	uint32_t size = GlyphSize(font->width, font->height);
+	uint32_t h;
+	st7789_glyph_t *g;
+
+	if (ch < 32 || ch > 126)
+		ch = ' ';
+
+	h = GlyphHash(font->data, ch, color, bgcolor);
+	for (g = cache->buckets[h]; g; g = g->hnext) {
+		if (g->font == font->data && g->ch == ch && g->color == color && g->bgcolor == bgcolor) {
+			GlyphUnlink(cache, g);
+			GlyphPushFront(cache, g);
+			return g->pixels;
+		}
+	}
+
+	uint16_t fg = (color >> 8) | (color << 8);
+	uint16_t bg = (bgcolor >> 8) | (bgcolor << 8);
+
+	if (size > cache->budget) {
+		GlyphExpand(font, ch, fg, bg, scratch);
+		return scratch;
+	}
+
+	while (cache->used + size > cache->budget)
+		GlyphEvict(cache, cache->tail);
+
+	g = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	if (g == NULL) {
+		GlyphExpand(font, ch, fg, bg, scratch);
+		return scratch;
+	}
+	g->font = font->data;
+	g->ch = ch;
+	g->color = color;
+	g->bgcolor = bgcolor;
+	g->width = font->width;
+	g->height = font->height;
+	GlyphExpand(font, ch, fg, bg, g->pixels);
+
+	g->hnext = cache->buckets[h];
+	cache->buckets[h] = g;
+	GlyphPushFront(cache, g);
+	cache->used += size;
+	return g->pixels;
+}
+
+/**
+ * @brief Drop every cached glyph
+ * @return none
+ */
+void ST7789_GlyphCache_Clear(void)
+{
+	st7789_glyph_cache_t *cache = &ST7789_Ctx()->glyphs;
+
+	ST7789_Select();
+	while (cache->tail)
+		GlyphEvict(cache, cache->tail);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Set the memory the glyph cache of the display may use, 0 disables it
+ * @param bytes -> budget in bytes, glyph pixels plus bookkeeping
+ * @return none
+ */
+void ST7789_GlyphCache_SetBudget(uint32_t bytes)
+{
+	st7789_glyph_cache_t *cache = &ST7789_Ctx()->glyphs;
+
+	ST7789_Select();
+	cache->budget = bytes;
+	while (cache->used > cache->budget)
+		GlyphEvict(cache, cache->tail);
+	ST7789_UnSelect();
+}
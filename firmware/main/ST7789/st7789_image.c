@@ -0,0 +1,329 @@
+/**
+ * @file    st7789_image.c
+ * @brief   Compressed images for the ST7789 driver
+ * @details Images are decoded in chunks of rows straight into the DMA buffer
+ * 		of a transaction, and every chunk continues the address window of
+ * 		the previous one, so no RAM is needed whatever the image size. Indexed images are
+ * 		expanded through a lookup table of panel order colors, so a palette
+ * 		swap costs nothing at draw time.
+ */
+
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_image.h"
+#include "st7789_sprite.h"
+#include "st7789_internal.h"
+
+#define QOI_OP_INDEX	0x00
+#define QOI_OP_DIFF		0x40
+#define QOI_OP_LUMA		0x80
+#define QOI_OP_RUN		0xC0
+#define QOI_OP_RGB		0xFE
+
+#define QOI_HASH(px)	((((px) >> 11) * 3 + (((px) >> 5) & 0x3F) * 5 + ((px) & 0x1F) * 7) & 63)
+
+/**
+ * @brief Start decoding an image
+ * @param dec -> decoder to initialize
+ * @param data -> image file contents
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if data is not an image,
+ *         ESP_ERR_INVALID_VERSION for an unknown version,
+ *         ESP_ERR_INVALID_SIZE if data is truncated
+ */
+esp_err_t ST7789_Image_Open(st7789_image_dec_t *dec, const void *data, size_t size)
+{
+	const st7789_image_header_t *hdr = data;
+
+	memset(dec, 0, sizeof(*dec));
+	if (size < sizeof(*hdr) || memcmp(hdr->magic, ST7789_IMAGE_MAGIC, 4) != 0)
+		return ESP_ERR_INVALID_ARG;
+	if (hdr->version != ST7789_IMAGE_VERSION)
+		return ESP_ERR_INVALID_VERSION;
+	if (hdr->format > ST7789_IMAGE_RGB565A8)
+		return ESP_ERR_INVALID_ARG;
+	if (size - sizeof(*hdr) < hdr->size)
+		return ESP_ERR_INVALID_SIZE;
+	if (hdr->format == ST7789_IMAGE_RAW && hdr->size < (uint32_t)hdr->width * hdr->height * 2)
+		return ESP_ERR_INVALID_SIZE;
+	if (hdr->format == ST7789_IMAGE_RGB565A8 && hdr->size < (uint32_t)hdr->width * hdr->height * 3)
+		return ESP_ERR_INVALID_SIZE;
+
+	dec->src = (const uint8_t *)data + sizeof(*hdr);
+	dec->end = dec->src + hdr->size;
+	dec->width = hdr->width;
+	dec->height = hdr->height;
+	dec->format = hdr->format;
+
+	if (hdr->format == ST7789_IMAGE_RGB565A8) {
+		/* Decoding gives the colors, the alpha plane is read by the sprite code */
+		dec->end = dec->src + (size_t)hdr->width * hdr->height * 2;
+	} else if (hdr->format >= ST7789_IMAGE_INDEXED1) {
+		dec->bpp = 1 << (hdr->format - ST7789_IMAGE_INDEXED1);
+		uint32_t stride = ((uint32_t)hdr->width * dec->bpp + 7) / 8;
+		if (hdr->colors == 0 || hdr->colors > (1 << dec->bpp))
+			return ESP_ERR_INVALID_ARG;
+		if (hdr->size < hdr->colors * 2 + stride * hdr->height)
+			return ESP_ERR_INVALID_SIZE;
+		/* Big endian colors are already in panel byte order, unused entries stay black */
+		memcpy(dec->lut, dec->src, hdr->colors * 2);
+		dec->src += hdr->colors * 2;
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief Replace the palette of an indexed image
+ * @note  Call after ST7789_Image_Open, entries after colors keep the colors of
+ *        the image. Does nothing for other formats.
+ * @param dec -> decoder
+ * @param palette -> RGB565 colors
+ * @param colors -> entries of palette
+ * @return none
+ */
+void ST7789_Image_SetPalette(st7789_image_dec_t *dec, const uint16_t *palette, uint16_t colors)
+{
+	if (dec->bpp == 0)
+		return;
+	if (colors > (1 << dec->bpp))
+		colors = 1 << dec->bpp;
+	for (uint16_t i = 0; i < colors; i++)
+		dec->lut[i] = (palette[i] >> 8) | (palette[i] << 8);
+}
+
+/**
+ * @brief Decode the next pixels of an image
+ * @param dec -> decoder
+ * @param out -> decoded pixels, panel byte order
+ * @param count -> pixels to decode
+ * @return pixels decoded, less than count at the end of the data
+ */
+uint32_t ST7789_Image_Decode(st7789_image_dec_t *dec, uint16_t *out, uint32_t count)
+{
+	const uint8_t *p = dec->src;
+	const uint8_t *end = dec->end;
+	uint16_t px = dec->px;
+	uint16_t swapped = (px >> 8) | (px << 8);
+	uint32_t n = 0;
+
+	if (dec->format == ST7789_IMAGE_RAW || dec->format == ST7789_IMAGE_RGB565A8) {
+		uint32_t left = (end - p) / 2;
+		if (count > left)
+			count = left;
+		memcpy(out, p, (size_t)count * 2);
+		dec->src = p + (size_t)count * 2;
+		return count;
+	}
+
+	if (dec->bpp) {
+		uint8_t bpp = dec->bpp, bit = dec->bit;
+		uint8_t mask = (1 << bpp) - 1;
+		uint16_t x = dec->x;
+
+		while (n < count && p < end) {
+			out[n++] = dec->lut[(*p >> (8 - bpp - bit)) & mask];
+			bit += bpp;
+			/* Rows start on a byte */
+			if (++x == dec->width) {
+				x = 0;
+				bit = 8;
+			}
+			if (bit == 8) {
+				p++;
+				bit = 0;
+			}
+		}
+		dec->src = p;
+		dec->bit = bit;
+		dec->x = x;
+		return n;
+	}
+
+	while (n < count) {
+		if (dec->run) {
+			uint32_t k = count - n < dec->run ? count - n : dec->run;
+			dec->run -= k;
+			while (k--)
+				out[n++] = swapped;
+			continue;
+		}
+		if (p >= end)
+			break;
+
+		uint8_t op = *p++;
+		if (op == QOI_OP_RGB) {
+			if (end - p < 2) {
+				p = end;
+				break;
+			}
+			px = (p[0] << 8) | p[1];
+			p += 2;
+		} else if ((op & 0xC0) == QOI_OP_INDEX) {
+			px = dec->index[op];
+			swapped = (px >> 8) | (px << 8);
+			out[n++] = swapped;
+			continue;
+		} else if ((op & 0xC0) == QOI_OP_DIFF) {
+			uint16_t r = ((px >> 11) + ((op >> 4) & 3) - 2) & 0x1F;
+			uint16_t g = ((px >> 5) + ((op >> 2) & 3) - 2) & 0x3F;
+			uint16_t b = (px + (op & 3) - 2) & 0x1F;
+			px = (r << 11) | (g << 5) | b;
+		} else if ((op & 0xC0) == QOI_OP_LUMA) {
+			if (p >= end)
+				break;
+			int8_t dg = (op & 0x3F) - 32;
+			int8_t half = dg / 2;
+			uint16_t r = ((px >> 11) + (*p >> 4) - 8 + half) & 0x1F;
+			uint16_t g = ((px >> 5) + dg) & 0x3F;
+			uint16_t b = (px + (*p & 0x0F) - 8 + half) & 0x1F;
+			p++;
+			px = (r << 11) | (g << 5) | b;
+		} else {
+			dec->run = (op & 0x3F) + 1;
+			continue;
+		}
+
+		dec->index[QOI_HASH(px)] = px;
+		swapped = (px >> 8) | (px << 8);
+		out[n++] = swapped;
+	}
+
+	dec->src = p;
+	dec->px = px;
+	return n;
+}
+
+/**
+ * @brief Decode pixels that are not drawn
+ * @param dec -> decoder
+ * @param count -> pixels to drop
+ * @return 1, 0 if the data ended first
+ */
+static uint8_t ST7789_Image_Skip(st7789_image_dec_t *dec, uint32_t count)
+{
+	uint16_t scratch[32];
+
+	while (count) {
+		uint32_t k = count < 32 ? count : 32;
+
+		if (ST7789_Image_Decode(dec, scratch, k) != k)
+			return 0;
+		count -= k;
+	}
+	return 1;
+}
+
+/**
+ * @brief Draw an image, decoding it a few rows at a time
+ * @note  The image is clipped to the render target. Decoding stops after the
+ *        last visible row. Alpha images are blended as with ST7789_DrawSprite.
+ * @param x&y -> top left corner of the image
+ * @param data -> image file contents
+ * @param size -> bytes of data
+ * @return ESP_OK or an error of ST7789_Image_Open. Pixel data ending early
+ *         gives ESP_ERR_INVALID_SIZE, the rows before are drawn.
+ */
+esp_err_t ST7789_Image_Draw(int16_t x, int16_t y, const void *data, size_t size)
+{
+	return ST7789_Image_DrawPalette(x, y, data, size, NULL);
+}
+
+/**
+ * @brief Draw an indexed image with other colors, e.g. those of a theme
+ * @param x&y -> top left corner of the image
+ * @param data -> image file contents
+ * @param size -> bytes of data
+ * @param palette -> RGB565 colors, as many as the palette of the image, NULL
+ *        to keep it. Ignored for other formats.
+ * @return as ST7789_Image_Draw
+ */
+esp_err_t ST7789_Image_DrawPalette(int16_t x, int16_t y, const void *data, size_t size, const uint16_t *palette)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_image_dec_t dec;
+	esp_err_t err = ST7789_Image_Open(&dec, data, size);
+	st7789_surface_t *s;
+	uint16_t *buf = NULL;
+	uint16_t vw, left, right, rows = 1, n = 0;
+
+	if (err != ESP_OK)
+		return err;
+	if (!dec.width || !dec.height)
+		return ESP_OK;
+	if (palette != NULL)
+		ST7789_Image_SetPalette(&dec, palette, ((const st7789_image_header_t *)data)->colors);
+
+	if (dec.format == ST7789_IMAGE_RAW) {
+		/* Pixels are ready to send, blit them in place */
+		ST7789_BlitArea(x, y, dec.width, dec.height, dec.src);
+		return ESP_OK;
+	}
+	if (dec.format == ST7789_IMAGE_RGB565A8) {
+		st7789_sprite_t sprite = {dec.width, dec.height, (const uint16_t *)dec.src, dec.end};
+		ST7789_DrawSprite(x, y, &sprite);
+		return ESP_OK;
+	}
+
+	/* Hold the driver until the last chunk, they share one window */
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_IMAGE);
+	s = ctx->target;
+	st7789_rect_t vis = {x, y, x + dec.width - 1, y + dec.height - 1};
+	if (!ST7789_ClipToTarget(&vis)) {
+		ST7789_UnSelect();
+		return ESP_OK;
+	}
+	vw = vis.x1 - vis.x0 + 1;
+	left = vis.x0 - x;
+	right = dec.width - left - vw;
+
+	if (s == NULL) {
+		/* Chunks of rows decoded straight into the DMA buffer of a transaction */
+		rows = ST7789_DMA_BUF_SIZE / (vw * 2);
+		/* One window for the visible part, each chunk continues in it */
+		ST7789_SetAddressWindow(vis.x0, vis.y0, vis.x1, vis.y1);
+	}
+
+	if (vis.y0 > y) {
+		uint32_t hidden = vis.y0 - y;
+
+		if (dec.bpp) {
+			/* Rows of indexes have a fixed size, skip the hidden ones */
+			dec.src += (((uint32_t)dec.width * dec.bpp + 7) / 8) * hidden;
+		} else if (!ST7789_Image_Skip(&dec, hidden * dec.width)) {
+			err = ESP_ERR_INVALID_SIZE;
+		}
+	}
+
+	for (int16_t row = vis.y0; row <= vis.y1 && err == ESP_OK; row++) {
+		uint16_t *dst;
+
+		if (s) {
+			dst = s->buf + (size_t)(row - s->y) * s->stride + (vis.x0 - s->x);
+		} else {
+			if (n == 0)
+				buf = ST7789_PixelBuf();
+			dst = buf + (size_t)n * vw;
+		}
+
+		/* Columns outside the target are decoded and dropped */
+		if (!ST7789_Image_Skip(&dec, left) || ST7789_Image_Decode(&dec, dst, vw) != vw ||
+				(row < vis.y1 && !ST7789_Image_Skip(&dec, right))) {
+			err = ESP_ERR_INVALID_SIZE;
+			break;
+		}
+
+		if (s == NULL && (++n == rows || row == vis.y1)) {
+			ST7789_QueuePixels((uint32_t)n * vw);
+			n = 0;
+		}
+	}
+	if (n)
+		ST7789_QueuePixels((uint32_t)n * vw);	// Rows decoded before the data ended
+
+	if (s == &ctx->fb)
+		ST7789_FB_MarkDirty(vis.x0, vis.y0, vis.x1, vis.y1);
+	ST7789_UnSelect();
+	return err;
+}
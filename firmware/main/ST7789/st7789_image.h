@@ -0,0 +1,85 @@
+/**
+ * @file    st7789_image.h
+ * @brief   Compressed images for the ST7789 driver.
+ * @note    Images are made by tools/mkimage.py. A 16 bytes header is followed
+ *     by the pixels, either raw (big endian RGB565) or compressed with
+ *     QOI565, the QOI scheme adapted to RGB565:
+ *         00iiiiii           pixel i of the 64 entry index of seen colors
+ *         01rrggbb           r, g and b differences of -2..1 from the
+ *                            previous pixel
+ *         10gggggg rrrrbbbb  g difference of -32..31, r and b differences
+ *                            of -8..7 from half of it
+ *         11nnnnnn           previous pixel repeated n + 1 times, n < 62
+ *         11111110 hi lo     literal pixel
+ *     A color goes to index entry (r * 3 + g * 5 + b * 7) % 64, on the 5, 6
+ *     and 5 bit channels. The previous pixel starts black.
+ *
+ *     Indexed images hold a palette of big endian RGB565 colors, then 1, 2,
+ *     4 or 8 bits palette indexes packed MSB first, each row starting on a
+ *     byte. Another palette can be given when drawing, e.g. for themes.
+ *
+ *     Alpha images hold big endian RGB565 pixels, then one 8 bits alpha per
+ *     pixel. They are drawn as sprites, see st7789_sprite.h.
+ *
+ *     Images are decoded a few rows at a time, never as a whole.
+ */
+
+#ifndef __ST7789_IMAGE_H
+#define __ST7789_IMAGE_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_IMAGE_MAGIC    "S7IM"
+#define ST7789_IMAGE_VERSION  1
+
+typedef enum {
+	ST7789_IMAGE_RAW = 0,		// Big endian RGB565
+	ST7789_IMAGE_QOI565,		// QOI adapted to RGB565
+	ST7789_IMAGE_INDEXED1,		// 2 color palette
+	ST7789_IMAGE_INDEXED2,		// 4 color palette
+	ST7789_IMAGE_INDEXED4,		// 16 color palette
+	ST7789_IMAGE_INDEXED8,		// 256 color palette
+	ST7789_IMAGE_RGB565A8,		// Big endian RGB565, then A8
+}st7789_image_format_t;
+
+typedef struct {
+	uint8_t magic[4];		// ST7789_IMAGE_MAGIC
+	uint8_t version;		// ST7789_IMAGE_VERSION
+	uint8_t format;			// st7789_image_format_t
+	uint16_t width;
+	uint16_t height;
+	uint16_t colors;		// Palette entries of indexed images, 0 otherwise
+	uint32_t size;			// Bytes of palette and pixel data after the header
+}st7789_image_header_t;
+
+/**
+ * Streaming decoder state
+ */
+typedef struct {
+	const uint8_t *src;		// Next byte to decode
+	const uint8_t *end;		// End of the pixel data
+	uint16_t width;
+	uint16_t height;
+	uint8_t format;
+	uint8_t run;			// Repeats of px left to output
+	uint16_t px;			// Previous pixel
+	uint8_t bpp;			// Bits per index of indexed images
+	uint8_t bit;			// Bits of *src already decoded
+	uint16_t x;				// Column of the next pixel
+	union {
+		uint16_t index[64];	// QOI565: colors seen so far
+		uint16_t lut[256];	// Indexed: palette, panel byte order
+	};
+}st7789_image_dec_t;
+
+/* Image functions. */
+esp_err_t ST7789_Image_Open(st7789_image_dec_t *dec, const void *data, size_t size);
+void ST7789_Image_SetPalette(st7789_image_dec_t *dec, const uint16_t *palette, uint16_t colors);
+uint32_t ST7789_Image_Decode(st7789_image_dec_t *dec, uint16_t *out, uint32_t count);
+esp_err_t ST7789_Image_Draw(int16_t x, int16_t y, const void *data, size_t size);
+esp_err_t ST7789_Image_DrawPalette(int16_t x, int16_t y, const void *data, size_t size, const uint16_t *palette);
+
+#endif
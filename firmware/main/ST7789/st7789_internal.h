@@ -0,0 +1,201 @@
+/**
+ * @file    st7789_internal.h
+ * @brief   Driver state and helpers shared between the ST7789 modules.
+ * @note    Not part of the public API, include st7789.h instead.
+ */
+
+#ifndef __ST7789_INTERNAL_H
+#define __ST7789_INTERNAL_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "st7789.h"
+#include "st7789_port.h"
+#include "st7789_trace.h"
+
+/**
+ * RAM surface the primitives can render to instead of the panel.
+ * Pixels are stored in panel byte order (big endian RGB565).
+ */
+typedef struct {
+	uint16_t *buf;		// Pixel buffer
+	int16_t x;			// Screen column of the first pixel
+	int16_t y;			// Screen row of the first pixel
+	uint16_t w;			// Width in pixels
+	uint16_t h;			// Height in pixels
+	uint16_t stride;	// Pixels between two rows of buf
+}st7789_surface_t;
+
+#define ST7789_GLYPH_BUCKETS	32	// Hash buckets of the glyph cache, power of 2
+
+/**
+ * Expanded glyphs kept for reuse, LRU
+ */
+typedef struct {
+	struct st7789_glyph *buckets[ST7789_GLYPH_BUCKETS];
+	struct st7789_glyph *head;
+	struct st7789_glyph *tail;
+	uint32_t used;		// Bytes held by cached glyphs
+	uint32_t budget;	// Bytes the cache may hold
+}st7789_glyph_cache_t;
+
+/**
+ * Horizontal extent of a shape on every screen row, filled by ST7789_SpanEdge
+ */
+typedef struct {
+	int16_t xmin[ST7789_GRAM_HEIGHT];
+	int16_t xmax[ST7789_GRAM_HEIGHT];
+	int16_t ymin;
+	int16_t ymax;
+	int16_t rows;		// Screen rows, the rows past it are not tracked
+}st7789_spans_t;
+
+typedef struct st7789_display {
+	st7789_port_t port;				// Transport, SPI device or emulated controller
+	SemaphoreHandle_t lock;			// Recursive lock taken by ST7789_Select
+	StaticSemaphore_t lock_buf;
+	uint16_t lock_depth;			// ST7789_Select calls not yet undone
+	uint8_t bus_owned;				// The panel holds the shared bus
+	uint8_t bus_trans;				// Transactions queued since the bus was taken
+	int8_t dc_pin;
+	uint8_t port_open;				// ST7789_Port_Open done
+	struct st7789_display *next;	// Next display set up, see ST7789_WaitIdleAll
+
+	uint16_t width;			// Width of display
+	uint16_t height;		// Height of display
+	st7789_rot_t rotation;	// Rotation of display
+
+	uint16_t *disp_buf;	// Framebuffer, NULL when primitives draw straight to the panel
+
+	/* Transport queue, see st7789_port.h */
+	uint8_t *dma_buf[ST7789_DMA_QUEUE_SIZE];		// DMA capable buffer owned by each transaction
+	uint8_t trans_head;								// Next transaction to queue
+	uint8_t trans_pending;							// Queued transactions not yet reclaimed
+	uint32_t trans_seq;								// Transactions queued since init
+
+	/* Bulk fill */
+	uint16_t *fill_buf;		// DMA buffer holding the fill color, shared by all fill transactions
+	uint16_t fill_color;	// Color expanded in fill_buf (panel byte order)
+	uint32_t fill_seq;		// trans_seq after the last transaction reading fill_buf
+
+	/* Address window cache */
+	st7789_rect_t win;		// Window last programmed with CASET/RASET
+	uint8_t win_cols_valid;	// win.x0/x1 match the controller
+	uint8_t win_rows_valid;	// win.y0/y1 match the controller
+	uint8_t win_pos_valid;	// win_pos tracks the controller memory pointer
+	uint8_t win_stream;		// Nothing but pixels since the last RAMWR/RAMWRC
+	uint32_t win_pos;		// Pixels written in win since the last RAMWR
+
+	/* Render target */
+	st7789_surface_t *target;	// Surface the primitives draw to, NULL for the panel
+	st7789_surface_t fb;		// Surface wrapping disp_buf
+	const st7789_rect_t *clip;	// Extra clip rectangle, NULL for none
+
+	/* Dirty rectangles of the framebuffer */
+	st7789_rect_t dirty[ST7789_DIRTY_MAX];
+	uint8_t dirty_count;
+
+	/* Band renderer */
+	uint16_t *band_buf[2];	// Ping-pong strips, DMA capable
+	uint32_t band_seq[2];	// Last transaction reading each strip
+
+	/* Text */
+	uint16_t *text_buf;		// Line of glyphs composed by the text functions
+	uint32_t text_len;		// Pixels text_buf can hold
+	st7789_glyph_cache_t glyphs;
+
+	/* Filled shapes, too big for the stack of most tasks */
+	st7789_spans_t spans;
+
+	/* Hardware scrolling, along rows in portrait and columns in landscape */
+	uint16_t scroll_top;	// Fixed lines before the scrolling area
+	uint16_t scroll_len;	// Lines of the scrolling area, 0 when not scrolling
+	uint16_t scroll_off;	// Lines the content moved towards the start of the area
+
+	/* Power */
+	st7789_power_cfg_t power_cfg;
+	st7789_power_state_t power_state;
+	uint32_t power_pixels;		// Pixels sent since power_tick
+	TickType_t power_tick;		// Start of the counting window
+	TickType_t power_busy;		// End of the last window busy with drawing
+
+	/* Instrumentation, see st7789_trace.h */
+	uint8_t id;				// Number of the display in the trace
+	uint8_t trace_call;		// st7789_trace_call_t of the call holding the lock
+	uint8_t trace_on;		// The call holding the lock is traced
+	uint32_t trace_start;	// Time the lock was taken, microseconds
+	uint32_t trace_trans;	// trans_seq when the lock was taken
+	uint64_t trace_bytes;	// stats.bytes when the lock was taken
+	int64_t frame_us;		// Time of the last frame, 0 before the first
+	st7789_stats_t stats;
+}st7789_ctx_t;
+
+/* State of the display the calling task draws to, see ST7789_Display_Use.
+   A thread local lookup, functions fetch it once and keep the pointer. */
+st7789_ctx_t *ST7789_Ctx(void) __attribute__((pure));
+
+extern const char * TAG;
+
+/**
+ * @brief Blend two RGB565 colors
+ * @param fg&bg -> colors, native byte order
+ * @param alpha -> weight of fg, 0 to 32
+ * @return blended color
+ */
+static inline uint16_t ST7789_Blend565(uint16_t fg, uint16_t bg, uint8_t alpha)
+{
+	/* Spread the channels as 00000gggggg00000rrrrr000000bbbbb so one multiply
+	   blends all three */
+	uint32_t f = (fg | ((uint32_t)fg << 16)) & 0x07E0F81F;
+	uint32_t b = (bg | ((uint32_t)bg << 16)) & 0x07E0F81F;
+	uint32_t r = ((((f - b) * alpha) >> 5) + b) & 0x07E0F81F;
+
+	return (uint16_t)(r | (r >> 16));
+}
+
+/* Transport */
+void ST7789_WaitSeq(uint32_t seq);
+void ST7789_WaitIdleAll(void);
+uint32_t ST7789_QueueBuffer(const void *buf, size_t len);
+uint16_t *ST7789_PixelBuf(void);
+void ST7789_QueuePixels(uint32_t count);
+void ST7789_BusYield(void);
+void ST7789_SetAddressWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+void ST7789_InvalidateWindow(void);
+void ST7789_WriteRect(const void *src, uint16_t w, uint16_t h, uint16_t stride);
+
+/* Render target */
+uint8_t ST7789_ClipToTarget(st7789_rect_t *r);
+uint8_t ST7789_RectListAdd(st7789_rect_t *list, uint8_t count, uint8_t max, const st7789_rect_t *rect);
+void ST7789_FillArea(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+void ST7789_BlitArea(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data);
+
+/* Text */
+const uint16_t *ST7789_Glyph_Get(const FontDef *font, char ch, uint16_t color, uint16_t bgcolor, uint16_t *scratch);
+uint16_t *ST7789_TextStrip(uint32_t pixels);
+
+/* Instrumentation */
+void ST7789_Trace_Begin(st7789_ctx_t *ctx);
+void ST7789_Trace_End(st7789_ctx_t *ctx);
+void ST7789_Trace_Frame(void);
+void ST7789_Trace_QueueDepth(uint16_t depth);
+void ST7789_Trace_TaskStack(uint32_t free);
+
+/**
+ * @brief Name the driver call holding the lock, the outermost call wins
+ * @param call -> st7789_trace_call_t
+ * @return none
+ */
+static inline void ST7789_Trace_Call(uint8_t call)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	if (ctx->trace_call == ST7789_TRACE_OTHER)
+		ctx->trace_call = call;
+}
+
+/* Framebuffer */
+void ST7789_FB_MarkDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+
+#endif
@@ -0,0 +1,493 @@
+/**
+ * @file    st7789_jpeg.c
+ * @brief   Baseline JPEG decoder for the ST7789 driver
+ * @details Huffman codes up to ST7789_JPEG_LOOKUP_BITS long are decoded with
+ * 		one table lookup, longer ones with the canonical code limits. The IDCT
+ * 		is separable in fixed point and skips the columns without AC
+ * 		coefficients, the common case after quantization. Chroma is upsampled
+ * 		by replication while converting each MCU straight to RGB565.
+ */
+
+#include <string.h>
+
+#include "st7789_jpeg.h"
+
+#define JPEG_SOF0	0xC0
+#define JPEG_SOF1	0xC1
+#define JPEG_DHT	0xC4
+#define JPEG_RST0	0xD0
+#define JPEG_SOI	0xD8
+#define JPEG_EOI	0xD9
+#define JPEG_SOS	0xDA
+#define JPEG_DQT	0xDB
+#define JPEG_DRI	0xDD
+
+/* Natural index of the zigzag ordered coefficients */
+static const uint8_t jpeg_zigzag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* cos((2x + 1) * u * pi / 16) * c(u) / 2, scaled by 4096 */
+static const int16_t jpeg_idct[8][8] = {
+	{ 1448,  2009,  1892,  1703,  1448,  1138,   784,   400},
+	{ 1448,  1703,   784,  -400, -1448, -2009, -1892, -1138},
+	{ 1448,  1138,  -784, -2009, -1448,   400,  1892,  1703},
+	{ 1448,   400, -1892, -1138,  1448,  1703,  -784, -2009},
+	{ 1448,  -400, -1892,  1138,  1448, -1703,  -784,  2009},
+	{ 1448, -1138,  -784,  2009, -1448,  -400,  1892, -1703},
+	{ 1448, -1703,   784,   400, -1448,  2009, -1892,  1138},
+	{ 1448, -2009,  1892, -1703,  1448, -1138,   784,  -400},
+};
+
+static uint16_t ReadU16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+/**
+ * @brief Build the decoding tables of a Huffman table
+ * @param huff -> table to build
+ * @param counts -> number of codes of each length, 1 to 16
+ * @param vals -> symbols, in code order
+ * @param nvals -> number of symbols
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for an impossible code
+ */
+static esp_err_t ST7789_Jpeg_BuildHuff(st7789_jpeg_huff_t *huff, const uint8_t *counts, const uint8_t *vals, uint16_t nvals)
+{
+	uint32_t code = 0;
+	uint16_t k = 0;
+
+	memset(huff, 0, sizeof(*huff));
+	memcpy(huff->vals, vals, nvals);
+	for (uint8_t len = 1; len <= 16; len++) {
+		huff->valoffset[len] = (int32_t)k - (int32_t)code;
+		for (uint8_t i = 0; i < counts[len - 1]; i++, k++, code++) {
+			if (code >= (1u << len))
+				return ESP_ERR_INVALID_ARG;
+			if (len <= ST7789_JPEG_LOOKUP_BITS) {
+				uint8_t shift = ST7789_JPEG_LOOKUP_BITS - len;
+				for (uint32_t j = 0; j < (1u << shift); j++)
+					huff->lookup[(code << shift) | j] = (len << 8) | vals[k];
+			}
+		}
+		huff->maxcode[len] = counts[len - 1] ? (int32_t)code - 1 : -1;
+		code <<= 1;
+	}
+	huff->maxcode[17] = INT32_MAX;
+	return ESP_OK;
+}
+
+/**
+ * @brief Top up the bit buffer to more than 24 bits
+ * @note  Stuffed zero bytes are dropped. At a marker the data ends, and zeros
+ *        are shifted in instead.
+ */
+static void ST7789_Jpeg_Fill(st7789_jpeg_t *jpeg)
+{
+	while (jpeg->nbits <= 24) {
+		uint32_t b = 0;
+		if (!jpeg->marker && jpeg->p < jpeg->end) {
+			b = *jpeg->p++;
+			if (b == 0xFF) {
+				uint8_t next = jpeg->p < jpeg->end ? *jpeg->p : 0;
+				if (next == 0x00) {
+					jpeg->p++;
+				} else {
+					jpeg->marker = 1;
+					jpeg->p--;
+					b = 0;
+				}
+			}
+		}
+		jpeg->acc |= b << (24 - jpeg->nbits);
+		jpeg->nbits += 8;
+	}
+}
+
+static int32_t ST7789_Jpeg_Huff(st7789_jpeg_t *jpeg, const st7789_jpeg_huff_t *huff)
+{
+	uint16_t e;
+
+	ST7789_Jpeg_Fill(jpeg);
+	e = huff->lookup[jpeg->acc >> (32 - ST7789_JPEG_LOOKUP_BITS)];
+	if (e) {
+		jpeg->acc <<= e >> 8;
+		jpeg->nbits -= e >> 8;
+		return e & 0xFF;
+	}
+	for (uint8_t len = ST7789_JPEG_LOOKUP_BITS + 1; len <= 16; len++) {
+		int32_t code = jpeg->acc >> (32 - len);
+		if (code <= huff->maxcode[len]) {
+			jpeg->acc <<= len;
+			jpeg->nbits -= len;
+			return huff->vals[(code + huff->valoffset[len]) & 0xFF];
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Read an s bits magnitude and extend its sign
+ */
+static int32_t ST7789_Jpeg_Extend(st7789_jpeg_t *jpeg, uint8_t s)
+{
+	int32_t v;
+
+	if (s == 0)
+		return 0;
+	ST7789_Jpeg_Fill(jpeg);
+	v = jpeg->acc >> (32 - s);
+	jpeg->acc <<= s;
+	jpeg->nbits -= s;
+	if (v < (1 << (s - 1)))
+		v -= (1 << s) - 1;
+	return v;
+}
+
+/**
+ * @brief Inverse DCT of a block to 8 bit samples
+ * @param coef -> dequantized coefficients, natural order
+ * @param out -> first sample of the block
+ * @param stride -> bytes between two rows of out
+ * @return none
+ */
+static void ST7789_Jpeg_Idct(const int16_t *coef, uint8_t *out, uint16_t stride)
+{
+	int32_t tmp[64];
+
+	/* Columns, 2 fractional bits kept */
+	for (uint8_t u = 0; u < 8; u++) {
+		const int16_t *c = coef + u;
+		if (!(c[8] | c[16] | c[24] | c[32] | c[40] | c[48] | c[56])) {
+			int32_t dc = (c[0] * jpeg_idct[0][0] + 512) >> 10;
+			for (uint8_t y = 0; y < 8; y++)
+				tmp[y * 8 + u] = dc;
+			continue;
+		}
+		for (uint8_t y = 0; y < 8; y++) {
+			int32_t sum = 0;
+			for (uint8_t v = 0; v < 8; v++)
+				sum += jpeg_idct[y][v] * c[v * 8];
+			tmp[y * 8 + u] = (sum + 512) >> 10;
+		}
+	}
+
+	/* Rows */
+	for (uint8_t y = 0; y < 8; y++) {
+		const int32_t *t = tmp + y * 8;
+		for (uint8_t x = 0; x < 8; x++) {
+			int32_t sum = 0;
+			for (uint8_t u = 0; u < 8; u++)
+				sum += jpeg_idct[x][u] * t[u];
+			sum = ((sum + (1 << 13)) >> 14) + 128;
+			out[x] = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+		}
+		out += stride;
+	}
+}
+
+/**
+ * @brief Decode one block of a component into its MCU samples
+ * @return ESP_OK, ESP_FAIL for corrupt data
+ */
+static esp_err_t ST7789_Jpeg_Block(st7789_jpeg_t *jpeg, st7789_jpeg_comp_t *c, uint8_t *out, uint16_t stride)
+{
+	const uint16_t *q = jpeg->quant[c->tq];
+	int16_t coef[64];
+	int32_t s, v;
+
+	memset(coef, 0, sizeof(coef));
+
+	s = ST7789_Jpeg_Huff(jpeg, &jpeg->dc[c->td]);
+	if (s < 0 || s > 11)
+		return ESP_FAIL;
+	c->pred += ST7789_Jpeg_Extend(jpeg, s);
+	v = c->pred * q[0];
+	coef[0] = v < -2048 ? -2048 : v > 2047 ? 2047 : v;
+
+	for (uint8_t k = 1; k < 64; k++) {
+		int32_t rs = ST7789_Jpeg_Huff(jpeg, &jpeg->ac[c->ta]);
+		if (rs < 0)
+			return ESP_FAIL;
+		s = rs & 0x0F;
+		if (s == 0) {
+			if (rs != 0xF0)
+				break;	// End of block
+			k += 15;
+			continue;
+		}
+		k += rs >> 4;
+		if (k > 63)
+			return ESP_FAIL;
+		uint8_t n = jpeg_zigzag[k];
+		v = ST7789_Jpeg_Extend(jpeg, s) * q[n];
+		coef[n] = v < -2048 ? -2048 : v > 2047 ? 2047 : v;
+	}
+
+	ST7789_Jpeg_Idct(coef, out, stride);
+	return ESP_OK;
+}
+
+/**
+ * @brief Resynchronize on a restart marker
+ * @return ESP_OK, ESP_FAIL if the marker is missing
+ */
+static esp_err_t ST7789_Jpeg_Restart(st7789_jpeg_t *jpeg)
+{
+	const uint8_t *p = jpeg->p;
+
+	while (p + 1 < jpeg->end && !(p[0] == 0xFF && (p[1] & 0xF8) == JPEG_RST0))
+		p++;
+	if (p + 1 >= jpeg->end)
+		return ESP_FAIL;
+
+	jpeg->p = p + 2;
+	jpeg->acc = 0;
+	jpeg->nbits = 0;
+	jpeg->marker = 0;
+	jpeg->restart_left = jpeg->restart;
+	for (uint8_t i = 0; i < jpeg->ncomp; i++)
+		jpeg->comp[i].pred = 0;
+	return ESP_OK;
+}
+
+/**
+ * @brief Convert the samples of one MCU to RGB565
+ * @param jpeg -> decoder
+ * @param out -> first pixel of the MCU in the row
+ * @param w&h -> pixels of the MCU inside the image
+ * @return none
+ */
+static void ST7789_Jpeg_Color(st7789_jpeg_t *jpeg, uint16_t *out, uint8_t w, uint8_t h)
+{
+	const st7789_jpeg_comp_t *cy = &jpeg->comp[0];
+
+	for (uint8_t y = 0; y < h; y++) {
+		uint16_t *o = out + (uint32_t)y * jpeg->width;
+		const uint8_t *ys = cy->samples + (y >> cy->vshift) * cy->h * 8;
+
+		if (jpeg->ncomp == 1) {
+			for (uint8_t x = 0; x < w; x++) {
+				uint8_t l = ys[x >> cy->hshift];
+				uint16_t px = ((l >> 3) << 11) | ((l >> 2) << 5) | (l >> 3);
+				o[x] = (px >> 8) | (px << 8);
+			}
+			continue;
+		}
+
+		const st7789_jpeg_comp_t *cb = &jpeg->comp[1];
+		const st7789_jpeg_comp_t *cr = &jpeg->comp[2];
+		const uint8_t *bs = cb->samples + (y >> cb->vshift) * cb->h * 8;
+		const uint8_t *rs = cr->samples + (y >> cr->vshift) * cr->h * 8;
+		for (uint8_t x = 0; x < w; x++) {
+			int32_t l = ys[x >> cy->hshift];
+			int32_t b = bs[x >> cb->hshift] - 128;
+			int32_t r = rs[x >> cr->hshift] - 128;
+			int32_t R = l + ((91881 * r + 32768) >> 16);
+			int32_t G = l + ((-22554 * b - 46802 * r + 32768) >> 16);
+			int32_t B = l + ((116130 * b + 32768) >> 16);
+			R = R < 0 ? 0 : R > 255 ? 255 : R;
+			G = G < 0 ? 0 : G > 255 ? 255 : G;
+			B = B < 0 ? 0 : B > 255 ? 255 : B;
+			uint16_t px = ((R >> 3) << 11) | ((G >> 2) << 5) | (B >> 3);
+			o[x] = (px >> 8) | (px << 8);
+		}
+	}
+}
+
+/**
+ * @brief Parse the headers of a JPEG up to the start of the image data
+ * @param jpeg -> decoder to initialize
+ * @param data -> JPEG file contents, referenced until decoding ends
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a corrupt or truncated file,
+ *         ESP_ERR_NOT_SUPPORTED for progressive, arithmetic coded, 12 bit,
+ *         multi-scan or non power of 2 sampled files
+ */
+esp_err_t ST7789_Jpeg_Open(st7789_jpeg_t *jpeg, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = p + size;
+	uint8_t have_sof = 0;
+
+	memset(jpeg, 0, sizeof(*jpeg));
+	if (size < 4 || p[0] != 0xFF || p[1] != JPEG_SOI)
+		return ESP_ERR_INVALID_ARG;
+	p += 2;
+
+	while (1) {
+		uint8_t m;
+		uint16_t len;
+
+		/* Markers may be padded with 0xFF */
+		if (p >= end || *p != 0xFF)
+			return ESP_ERR_INVALID_ARG;
+		while (p < end && *p == 0xFF)
+			p++;
+		if (p + 3 > end)
+			return ESP_ERR_INVALID_ARG;
+		m = *p++;
+		len = ReadU16(p);
+		if (len < 2 || p + len > end)
+			return ESP_ERR_INVALID_ARG;
+		const uint8_t *seg = p + 2;
+		const uint8_t *seg_end = p + len;
+		p = seg_end;
+
+		switch (m) {
+		case JPEG_DQT:
+			while (seg < seg_end) {
+				uint8_t pq = *seg >> 4, tq = *seg & 0x0F;
+				seg++;
+				if (tq > 3 || seg + 64 * (pq + 1) > seg_end)
+					return ESP_ERR_INVALID_ARG;
+				for (uint8_t i = 0; i < 64; i++) {
+					jpeg->quant[tq][jpeg_zigzag[i]] = pq ? ReadU16(seg) : *seg;
+					seg += pq + 1;
+				}
+			}
+			break;
+
+		case JPEG_DHT:
+			while (seg < seg_end) {
+				uint8_t tc = *seg >> 4, th = *seg & 0x0F;
+				uint16_t nvals = 0;
+				if (seg + 17 > seg_end)
+					return ESP_ERR_INVALID_ARG;
+				if (tc > 1 || th > 1)
+					return ESP_ERR_NOT_SUPPORTED;
+				for (uint8_t i = 1; i <= 16; i++)
+					nvals += seg[i];
+				if (nvals > 256 || seg + 17 + nvals > seg_end)
+					return ESP_ERR_INVALID_ARG;
+				if (ST7789_Jpeg_BuildHuff(tc ? &jpeg->ac[th] : &jpeg->dc[th], seg + 1, seg + 17, nvals) != ESP_OK)
+					return ESP_ERR_INVALID_ARG;
+				seg += 17 + nvals;
+			}
+			break;
+
+		case JPEG_DRI:
+			if (len < 4)
+				return ESP_ERR_INVALID_ARG;
+			jpeg->restart = ReadU16(seg);
+			break;
+
+		case JPEG_SOF0:
+		case JPEG_SOF1: {
+			uint8_t hmax = 1, vmax = 1;
+			if (len < 8 || seg[0] != 8)
+				return len < 8 ? ESP_ERR_INVALID_ARG : ESP_ERR_NOT_SUPPORTED;
+			jpeg->height = ReadU16(seg + 1);
+			jpeg->width = ReadU16(seg + 3);
+			jpeg->ncomp = seg[5];
+			if (jpeg->ncomp != 1 && jpeg->ncomp != 3)
+				return ESP_ERR_NOT_SUPPORTED;
+			if (!jpeg->width || !jpeg->height || len < 8 + 3 * jpeg->ncomp)
+				return ESP_ERR_INVALID_ARG;
+
+			uint8_t blocks = 0;
+			for (uint8_t i = 0; i < jpeg->ncomp; i++) {
+				st7789_jpeg_comp_t *c = &jpeg->comp[i];
+				c->id = seg[6 + 3 * i];
+				c->h = seg[7 + 3 * i] >> 4;
+				c->v = seg[7 + 3 * i] & 0x0F;
+				c->tq = seg[8 + 3 * i] & 0x03;
+				if (jpeg->ncomp == 1)
+					c->h = c->v = 1;	// A single component scan has 1 block MCUs
+				if (c->h == 0 || c->v == 0 || c->h > 4 || c->v > 4 || c->h == 3 || c->v == 3)
+					return ESP_ERR_NOT_SUPPORTED;
+				if (c->h > hmax) hmax = c->h;
+				if (c->v > vmax) vmax = c->v;
+				c->samples = jpeg->samples + blocks * 64;
+				blocks += c->h * c->v;
+			}
+			if (blocks > 10)
+				return ESP_ERR_INVALID_ARG;
+			for (uint8_t i = 0; i < jpeg->ncomp; i++) {
+				st7789_jpeg_comp_t *c = &jpeg->comp[i];
+				while ((c->h << c->hshift) < hmax) c->hshift++;
+				while ((c->v << c->vshift) < vmax) c->vshift++;
+			}
+			jpeg->mcu_width = 8 * hmax;
+			jpeg->mcu_height = 8 * vmax;
+			jpeg->mcus_x = (jpeg->width + jpeg->mcu_width - 1) / jpeg->mcu_width;
+			have_sof = 1;
+			break;
+		}
+
+		case JPEG_SOS: {
+			if (!have_sof || len < 6 || seg[0] != jpeg->ncomp || len < 6 + 2 * seg[0])
+				return have_sof ? ESP_ERR_NOT_SUPPORTED : ESP_ERR_INVALID_ARG;
+			for (uint8_t i = 0; i < jpeg->ncomp; i++) {
+				uint8_t id = seg[1 + 2 * i];
+				uint8_t t = seg[2 + 2 * i];
+				uint8_t j = 0;
+				while (j < jpeg->ncomp && jpeg->comp[j].id != id)
+					j++;
+				if (j == jpeg->ncomp || (t >> 4) > 1 || (t & 0x0F) > 1)
+					return ESP_ERR_INVALID_ARG;
+				jpeg->comp[j].td = t >> 4;
+				jpeg->comp[j].ta = t & 0x0F;
+			}
+			jpeg->p = p;
+			jpeg->end = end;
+			jpeg->restart_left = jpeg->restart;
+			return ESP_OK;
+		}
+
+		case JPEG_EOI:
+			return ESP_ERR_INVALID_ARG;
+
+		default:
+			/* SOF2 and up: progressive, lossless, arithmetic coding */
+			if (m >= 0xC2 && m <= 0xCF && m != JPEG_DHT && m != 0xC8 && m != 0xCC)
+				return ESP_ERR_NOT_SUPPORTED;
+			break;	// APPn, COM and others are skipped
+		}
+	}
+}
+
+/**
+ * @brief Decode the next MCU row
+ * @param jpeg -> decoder
+ * @param out -> width * mcu_height pixels, panel byte order. Rows past the
+ *        bottom of the image are left untouched.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE after the last row,
+ *         ESP_FAIL for corrupt data
+ */
+esp_err_t ST7789_Jpeg_DecodeRow(st7789_jpeg_t *jpeg, uint16_t *out)
+{
+	uint32_t y0 = (uint32_t)jpeg->mcu_row * jpeg->mcu_height;
+	uint8_t h;
+
+	if (y0 >= jpeg->height)
+		return ESP_ERR_INVALID_STATE;
+	h = jpeg->height - y0 < jpeg->mcu_height ? jpeg->height - y0 : jpeg->mcu_height;
+
+	for (uint16_t mx = 0; mx < jpeg->mcus_x; mx++) {
+		if (jpeg->restart) {
+			if (jpeg->restart_left == 0 && ST7789_Jpeg_Restart(jpeg) != ESP_OK)
+				return ESP_FAIL;
+			jpeg->restart_left--;
+		}
+
+		for (uint8_t i = 0; i < jpeg->ncomp; i++) {
+			st7789_jpeg_comp_t *c = &jpeg->comp[i];
+			uint16_t stride = c->h * 8;
+			for (uint8_t by = 0; by < c->v; by++)
+				for (uint8_t bx = 0; bx < c->h; bx++)
+					if (ST7789_Jpeg_Block(jpeg, c, c->samples + by * 8 * stride + bx * 8, stride) != ESP_OK)
+						return ESP_FAIL;
+		}
+
+		uint32_t x0 = (uint32_t)mx * jpeg->mcu_width;
+		uint8_t w = jpeg->width - x0 < jpeg->mcu_width ? jpeg->width - x0 : jpeg->mcu_width;
+		ST7789_Jpeg_Color(jpeg, out + x0, w, h);
+	}
+
+	jpeg->mcu_row++;
+	return ESP_OK;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file    st7789_jpeg.h
+ * @brief   Baseline JPEG decoder for the ST7789 driver.
+ * @note    Decodes baseline (SOF0/SOF1) 8-bit Huffman JPEGs, grayscale or
+ *     YCbCr with any power of 2 sampling, with or without restart markers.
+ *     Progressive and arithmetic coded files are rejected.
+ *
+ *     The decoder outputs one MCU row at a time as RGB565 in panel byte
+ *     order, and only depends on the C library so it also builds on a host.
+ *     ST7789_Jpeg_Draw runs it on the other core while the calling task
+ *     sends the finished rows to the panel.
+ */
+
+#ifndef __ST7789_JPEG_H
+#define __ST7789_JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ST7789_JPEG_LOOKUP_BITS  9	// Huffman codes up to this length are decoded in one lookup
+
+typedef struct {
+	uint8_t vals[256];			// Symbols by code
+	uint16_t lookup[1 << ST7789_JPEG_LOOKUP_BITS];	// (length << 8) | symbol, 0 for longer codes
+	int32_t maxcode[18];		// Largest code of each length, -1 for none
+	int32_t valoffset[17];		// vals index of a code minus the code, by length
+}st7789_jpeg_huff_t;
+
+typedef struct {
+	uint8_t id;
+	uint8_t h, v;				// Sampling factors
+	uint8_t hshift, vshift;		// log2 of the MCU size over the component size
+	uint8_t tq;					// Quantization table
+	uint8_t td, ta;				// DC and AC Huffman tables
+	int16_t pred;				// DC prediction
+	uint8_t *samples;			// One MCU of samples, 8 * h wide, 8 * v high
+}st7789_jpeg_comp_t;
+
+typedef struct {
+	/* Entropy coded data */
+	const uint8_t *p;
+	const uint8_t *end;
+	uint32_t acc;				// Bit buffer, next bit is the MSB
+	uint8_t nbits;
+	uint8_t marker;				// A marker stops the data, zeros are read past it
+
+	uint16_t width;
+	uint16_t height;
+	uint8_t mcu_width;			// Pixels
+	uint8_t mcu_height;			// Pixels, rows output by each ST7789_Jpeg_DecodeRow
+	uint16_t mcus_x;			// MCUs per row
+	uint16_t mcu_row;			// Next MCU row to decode
+	uint16_t restart;			// MCUs between restart markers, 0 for none
+	uint16_t restart_left;		// MCUs before the next restart marker
+
+	uint8_t ncomp;
+	st7789_jpeg_comp_t comp[3];
+	uint16_t quant[4][64];		// Natural order
+	st7789_jpeg_huff_t dc[2];
+	st7789_jpeg_huff_t ac[2];
+	uint8_t samples[10 * 64];	// MCU samples of all components, at most 10 blocks
+}st7789_jpeg_t;
+
+/* Decoder functions. */
+esp_err_t ST7789_Jpeg_Open(st7789_jpeg_t *jpeg, const void *data, size_t size);
+esp_err_t ST7789_Jpeg_DecodeRow(st7789_jpeg_t *jpeg, uint16_t *out);
+
+/* Drawing functions. */
+esp_err_t ST7789_Jpeg_Draw(int16_t x, int16_t y, const void *data, size_t size);
+
+#endif
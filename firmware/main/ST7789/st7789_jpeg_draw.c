@@ -0,0 +1,231 @@
+/**
+ * @file    st7789_jpeg_draw.c
+ * @brief   JPEG drawing split across both cores for the ST7789 driver
+ * @details A decoder task on the other core fills stripes of one MCU row and
+ * 		hands them over through a single producer single consumer ring. The
+ * 		calling task sends each stripe to the render target and returns it
+ * 		through a second ring. Both sides only block on task notifications
+ * 		when their ring is empty, so decoding the next stripe overlaps with
+ * 		sending the previous one.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_jpeg.h"
+#include "st7789_internal.h"
+
+#define JPEG_RING_SIZE	8		// Power of 2, more than ST7789_JPEG_STRIPES + 1
+#define JPEG_END		0xFF	// Pushed on the full ring after the last stripe
+
+/**
+ * Single producer single consumer ring of stripe indexes
+ */
+typedef struct {
+	uint32_t head;				// Written by the producer only
+	uint32_t tail;				// Written by the consumer only
+	uint8_t slot[JPEG_RING_SIZE];
+}st7789_jpeg_ring_t;
+
+typedef struct {
+	st7789_jpeg_t jpeg;
+	uint16_t *stripe[ST7789_JPEG_STRIPES];
+	st7789_jpeg_ring_t free;	// Stripes the decoder may fill
+	st7789_jpeg_ring_t full;	// Stripes ready to send, then JPEG_END
+	TaskHandle_t display;		// Task drawing the JPEG
+	uint8_t stop;				// Set by the display task, rows left are not needed
+	esp_err_t err;				// Decoder result, valid after JPEG_END
+}st7789_jpeg_job_t;
+
+static TaskHandle_t jpeg_task;
+static st7789_jpeg_job_t *jpeg_job;	// Next job for the decoder task
+static SemaphoreHandle_t jpeg_lock;	// One job at a time, whatever the display
+
+static void ST7789_Jpeg_Push(st7789_jpeg_ring_t *ring, uint8_t v)
+{
+	uint32_t head = ring->head;
+
+	ring->slot[head & (JPEG_RING_SIZE - 1)] = v;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Pop a stripe index, blocking on the task notification while the ring
+ *        is empty
+ */
+static uint8_t ST7789_Jpeg_Pop(st7789_jpeg_ring_t *ring)
+{
+	uint32_t tail = ring->tail;
+	uint8_t v;
+
+	while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	v = ring->slot[tail & (JPEG_RING_SIZE - 1)];
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return v;
+}
+
+/**
+ * @brief Decoder task, decodes the jobs handed over by ST7789_Jpeg_Draw
+ * @note  Notifications left over from a previous job only cause an extra
+ *        check of the rings.
+ */
+static void ST7789_Jpeg_Task(void *arg)
+{
+	while (1) {
+		st7789_jpeg_job_t *job;
+		esp_err_t err = ESP_OK;
+
+		while ((job = __atomic_exchange_n(&jpeg_job, NULL, __ATOMIC_ACQUIRE)) == NULL)
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		TaskHandle_t display = job->display;
+		while (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+			uint8_t s = ST7789_Jpeg_Pop(&job->free);
+			err = ST7789_Jpeg_DecodeRow(&job->jpeg, job->stripe[s]);
+			if (err != ESP_OK)
+				break;
+			ST7789_Jpeg_Push(&job->full, s);
+			xTaskNotifyGive(display);
+		}
+		job->err = err == ESP_ERR_INVALID_STATE ? ESP_OK : err;
+
+		/* The job may be freed as soon as JPEG_END is seen */
+		ST7789_Jpeg_Push(&job->full, JPEG_END);
+		xTaskNotifyGive(display);
+	}
+}
+
+/**
+ * @brief Get the lock of the decoder, created by the first call
+ * @return lock, NULL if out of memory
+ */
+static SemaphoreHandle_t ST7789_Jpeg_Lock(void)
+{
+	SemaphoreHandle_t lock = __atomic_load_n(&jpeg_lock, __ATOMIC_ACQUIRE), none = NULL;
+
+	if (lock)
+		return lock;
+	lock = xSemaphoreCreateMutex();
+	if (lock && !__atomic_compare_exchange_n(&jpeg_lock, &none, lock, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* Another task created it first */
+		vSemaphoreDelete(lock);
+		lock = none;
+	}
+	return lock;
+}
+
+/**
+ * @brief Draw a baseline JPEG, decoding on the other core
+ * @note  The decoder task is created by the first call, on the core the
+ *        caller is not running on. The JPEG is clipped to the render target,
+ *        decoding stops after the last visible row. The notification of the
+ *        calling task is used to wait for stripes. JPEGs drawn on several
+ *        displays at once take turns on the decoder.
+ * @param x&y -> top left corner of the picture
+ * @param data -> JPEG file contents
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_NO_MEM, an error of ST7789_Jpeg_Open, or ESP_FAIL
+ *         for corrupt data, the rows before are drawn
+ */
+esp_err_t ST7789_Jpeg_Draw(int16_t x, int16_t y, const void *data, size_t size)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_jpeg_job_t *job;
+	SemaphoreHandle_t lock;
+	esp_err_t err;
+	uint16_t w, row = 0;
+	uint8_t s;
+
+	job = heap_caps_calloc(1, sizeof(*job), MALLOC_CAP_8BIT);
+	if (job == NULL)
+		return ESP_ERR_NO_MEM;
+	err = ST7789_Jpeg_Open(&job->jpeg, data, size);
+	if (err != ESP_OK) {
+		heap_caps_free(job);
+		return err;
+	}
+	w = job->jpeg.width;
+	lock = ST7789_Jpeg_Lock();
+	if (lock == NULL) {
+		heap_caps_free(job);
+		return ESP_ERR_NO_MEM;
+	}
+	xSemaphoreTake(lock, portMAX_DELAY);
+
+	/* Hold the driver until the last stripe, they share one window */
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_IMAGE);
+	st7789_rect_t vis = {x, y, x + w - 1, y + job->jpeg.height - 1};
+	if (!ST7789_ClipToTarget(&vis)) {
+		ST7789_UnSelect();
+		xSemaphoreGive(lock);
+		heap_caps_free(job);
+		return ESP_OK;
+	}
+
+	for (uint8_t i = 0; i < ST7789_JPEG_STRIPES; i++) {
+		job->stripe[i] = heap_caps_malloc((size_t)w * job->jpeg.mcu_height * 2, MALLOC_CAP_8BIT);
+		if (job->stripe[i] == NULL) {
+			err = ESP_ERR_NO_MEM;
+			goto out;
+		}
+		ST7789_Jpeg_Push(&job->free, i);
+	}
+
+	if (jpeg_task == NULL) {
+#if CONFIG_FREERTOS_UNICORE
+		BaseType_t core = 0;
+#else
+		BaseType_t core = !xPortGetCoreID();
+#endif
+		if (xTaskCreatePinnedToCore(ST7789_Jpeg_Task, "st7789_jpeg", ST7789_JPEG_TASK_STACK, NULL,
+				uxTaskPriorityGet(NULL), &jpeg_task, core) != pdPASS) {
+			jpeg_task = NULL;
+			err = ESP_ERR_NO_MEM;
+			goto out;
+		}
+	}
+
+	if (ctx->target == NULL) {
+		/* One window for the visible part, each stripe continues in it */
+		ST7789_SetAddressWindow(vis.x0, vis.y0, vis.x1, vis.y1);
+	}
+
+	job->display = xTaskGetCurrentTaskHandle();
+	__atomic_store_n(&jpeg_job, job, __ATOMIC_RELEASE);
+	xTaskNotifyGive(jpeg_task);
+
+	for (;;) {
+		if (__atomic_load_n(&job->full.head, __ATOMIC_ACQUIRE) == job->full.tail)
+			ST7789_BusYield();	// The other panels may use the bus while the decoder works
+		if ((s = ST7789_Jpeg_Pop(&job->full)) == JPEG_END)
+			break;
+
+		uint16_t n = job->jpeg.height - row < job->jpeg.mcu_height ? job->jpeg.height - row : job->jpeg.mcu_height;
+
+		if (!job->stop) {
+			if (y + row + n - 1 >= vis.y0)
+				ST7789_BlitArea(x, y + row, w, n, (const uint8_t *)job->stripe[s]);
+			row += n;
+			if (y + row > vis.y1)
+				__atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+		}
+		ST7789_Jpeg_Push(&job->free, s);
+		xTaskNotifyGive(jpeg_task);
+	}
+	err = job->err;
+
+out:
+	ST7789_UnSelect();
+	xSemaphoreGive(lock);
+	for (uint8_t i = 0; i < ST7789_JPEG_STRIPES; i++)
+		heap_caps_free(job->stripe[i]);
+	heap_caps_free(job);
+	return err;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file    st7789_port.h
+ * @brief   Transport of the ST7789 driver.
+ * @note    Not part of the public API. The driver reaches the panels through
+ *     these functions only. st7789_port_spi.c drives them with the SPI master
+ *     of the chip; on the linux target st7789_port_emu.c decodes the stream
+ *     into an emulated controller instead, see st7789_emu.h.
+ *
+ *     The functions work on the display passed by the driver, which looks
+ *     it up once per call rather than once per transaction.
+ */
+
+#ifndef __ST7789_PORT_H
+#define __ST7789_PORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_PORT_INLINE  4  // Writes up to this many bytes travel inside the transaction, without a DMA buffer
+
+#if CONFIG_IDF_TARGET_LINUX
+
+/**
+ * Transport state of a display, emulated controller
+ */
+typedef struct {
+	struct st7789_emu *emu;		// Controller decoding the stream of the display
+}st7789_port_t;
+
+#else
+
+#include "driver/spi_master.h"
+
+/**
+ * Transport state of a display, SPI master
+ */
+typedef struct {
+	spi_device_handle_t hspi;
+	spi_transaction_t trans[ST7789_DMA_QUEUE_SIZE];	// Transaction pool, used as a ring
+}st7789_port_t;
+
+#endif
+
+/* Transport functions. */
+struct st7789_display;
+esp_err_t ST7789_Port_Open(struct st7789_display *ctx, const st7789_config_t *cfg);
+void ST7789_Port_Close(struct st7789_display *ctx);
+void ST7789_Port_Queue(struct st7789_display *ctx, uint8_t idx, const void *buf, size_t len, uint8_t dc);
+void ST7789_Port_Reclaim(struct st7789_display *ctx);
+void ST7789_Port_AcquireBus(struct st7789_display *ctx);
+void ST7789_Port_ReleaseBus(struct st7789_display *ctx);
+void ST7789_Port_SetPin(struct st7789_display *ctx, int8_t pin, uint8_t level);
+int64_t ST7789_Port_Time(void);
+
+#endif
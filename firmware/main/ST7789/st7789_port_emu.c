@@ -0,0 +1,563 @@
+/**
+ * @file    st7789_port_emu.c
+ * @brief   Emulated transport of the ST7789 driver, linux target
+ * @details Each display gets an emulated controller decoding the byte stream
+ * 		as it is queued. Commands select what the following data bytes mean;
+ * 		RAMWR and RAMWRC data is written to GRAM through the memory pointer,
+ * 		which walks the CASET/RASET window column first and is mapped to the
+ * 		memory by MADCTL: MX and MY mirror the column and page counters, MV
+ * 		then exchanges them. The screen shows GRAM through the scrolling area
+ * 		of VSCRDEF/VSCRSADD.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_emu.h"
+#include "st7789_internal.h"
+#include "st7789_port.h"
+
+#define EMU_PARAM_MAX  16  // Parameter bytes kept for a command, the longest decoded takes 6
+
+/**
+ * Emulated controller
+ */
+struct st7789_emu {
+	uint16_t gram[ST7789_GRAM_HEIGHT][ST7789_GRAM_WIDTH];	// Memory, native RGB565
+
+	/* Decoder */
+	uint8_t cmd;					// Last command, the data bytes belong to it
+	uint8_t param[EMU_PARAM_MAX];	// Parameters of cmd received so far
+	uint8_t nparam;
+	uint8_t pixel_half;				// The first byte of a pixel is in pixel_hi
+	uint8_t pixel_hi;
+
+	/* Registers */
+	uint16_t xs, xe;		// Column window, CASET
+	uint16_t ys, ye;		// Page window, RASET
+	uint16_t col, row;		// Memory pointer
+	uint8_t madctl;
+	uint16_t tfa, vsa;		// Scrolling area, VSCRDEF
+	uint16_t ssa;			// First line of the scrolling area, VSCRSADD
+
+	int8_t rst_pin;
+	st7789_emu_stats_t stats;
+};
+
+static SemaphoreHandle_t emu_bus;	// Shared bus of the emulated panels
+
+/**
+ * @brief Registers after a hardware or software reset, GRAM is kept
+ * @param emu -> controller
+ * @return none
+ */
+static void ST7789_Emu_Reset(struct st7789_emu *emu)
+{
+	emu->cmd = ST7789_NOP;
+	emu->nparam = 0;
+	emu->pixel_half = 0;
+	emu->xs = 0;
+	emu->xe = ST7789_GRAM_WIDTH - 1;
+	emu->ys = 0;
+	emu->ye = ST7789_GRAM_HEIGHT - 1;
+	emu->col = emu->row = 0;
+	emu->madctl = 0;
+	emu->tfa = 0;
+	emu->vsa = ST7789_GRAM_HEIGHT;
+	emu->ssa = 0;
+}
+
+/**
+ * @brief Memory position of a pixel addressed by column and page
+ * @param emu -> controller
+ * @param col&row -> column and page counters
+ * @param x&y -> GRAM column and line
+ * @return 1 when the address is inside GRAM
+ */
+static uint8_t ST7789_Emu_Map(const struct st7789_emu *emu, uint16_t col, uint16_t row, uint16_t *x, uint16_t *y)
+{
+	uint8_t mv = emu->madctl & ST7789_MADCTL_MV;
+	uint16_t cols = mv ? ST7789_GRAM_HEIGHT : ST7789_GRAM_WIDTH;
+	uint16_t rows = mv ? ST7789_GRAM_WIDTH : ST7789_GRAM_HEIGHT;
+
+	if (col >= cols || row >= rows)
+		return 0;
+	if (emu->madctl & ST7789_MADCTL_MX)
+		col = cols - 1 - col;
+	if (emu->madctl & ST7789_MADCTL_MY)
+		row = rows - 1 - row;
+	*x = mv ? row : col;
+	*y = mv ? col : row;
+	return 1;
+}
+
+/**
+ * @brief GRAM line shown on a line of the panel
+ * @param emu -> controller
+ * @param line -> panel line
+ * @return GRAM line
+ */
+static uint16_t ST7789_Emu_Line(const struct st7789_emu *emu, uint16_t line)
+{
+	if (line < emu->tfa || line >= emu->tfa + emu->vsa)
+		return line;
+	line = emu->ssa + (line - emu->tfa);
+	if (line >= emu->tfa + emu->vsa)
+		line -= emu->vsa;
+	return line < ST7789_GRAM_HEIGHT ? line : 0;
+}
+
+/**
+ * @brief Pixel the panel shows at screen coordinates
+ * @param emu -> controller
+ * @param x&y -> column and page addresses
+ * @return color, native RGB565, 0 outside GRAM
+ */
+static uint16_t ST7789_Emu_Screen(const struct st7789_emu *emu, uint16_t x, uint16_t y)
+{
+	uint16_t gx, gy;
+
+	if (!ST7789_Emu_Map(emu, x, y, &gx, &gy))
+		return 0;
+	/* The scrolling area shows another line of GRAM where the pixel lies */
+	return emu->gram[ST7789_Emu_Line(emu, gy)][gx];
+}
+
+/**
+ * @brief Decode a command byte
+ * @param emu -> controller
+ * @param cmd -> command
+ * @return none
+ */
+static void ST7789_Emu_Command(struct st7789_emu *emu, uint8_t cmd)
+{
+	emu->stats.commands++;
+	emu->cmd = cmd;
+	emu->nparam = 0;
+	emu->pixel_half = 0;
+
+	switch (cmd) {
+	case ST7789_SWRESET:
+		ST7789_Emu_Reset(emu);
+		break;
+	case ST7789_CASET:
+	case ST7789_RASET:
+		emu->stats.windows++;
+		break;
+	case ST7789_RAMWR:
+		emu->col = emu->xs;
+		emu->row = emu->ys;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Decode a parameter byte of the current command
+ * @param emu -> controller
+ * @param b -> parameter
+ * @return none
+ */
+static void ST7789_Emu_Param(struct st7789_emu *emu, uint8_t b)
+{
+	uint8_t *p = emu->param;
+
+	emu->stats.params++;
+	if (emu->nparam == EMU_PARAM_MAX)
+		return;
+	p[emu->nparam++] = b;
+
+	switch (emu->cmd) {
+	case ST7789_CASET:
+		if (emu->nparam == 4) {
+			emu->xs = (p[0] << 8) | p[1];
+			emu->xe = (p[2] << 8) | p[3];
+		}
+		break;
+	case ST7789_RASET:
+		if (emu->nparam == 4) {
+			emu->ys = (p[0] << 8) | p[1];
+			emu->ye = (p[2] << 8) | p[3];
+		}
+		break;
+	case ST7789_MADCTL:
+		if (emu->nparam == 1)
+			emu->madctl = p[0];
+		break;
+	case ST7789_VSCRDEF:
+		if (emu->nparam == 6) {
+			emu->tfa = (p[0] << 8) | p[1];
+			emu->vsa = (p[2] << 8) | p[3];
+		}
+		break;
+	case ST7789_VSCRSADD:
+		if (emu->nparam == 2)
+			emu->ssa = (p[0] << 8) | p[1];
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Write pixel bytes of RAMWR/RAMWRC at the memory pointer
+ * @param emu -> controller
+ * @param p -> bytes, big endian RGB565
+ * @param n -> number of bytes
+ * @return none
+ */
+static void ST7789_Emu_Pixels(struct st7789_emu *emu, const uint8_t *p, size_t n)
+{
+	for (; n; n--, p++) {
+		uint16_t x, y;
+
+		if (!emu->pixel_half) {
+			emu->pixel_hi = *p;
+			emu->pixel_half = 1;
+			continue;
+		}
+		emu->pixel_half = 0;
+		if (ST7789_Emu_Map(emu, emu->col, emu->row, &x, &y))
+			emu->gram[y][x] = (emu->pixel_hi << 8) | *p;
+		emu->stats.pixels++;
+
+		/* Along the column window, then to the next page, back to the
+		   start past the end of the window */
+		if (emu->col++ >= emu->xe) {
+			emu->col = emu->xs;
+			if (emu->row++ >= emu->ye)
+				emu->row = emu->ys;
+		}
+	}
+}
+
+/**
+ * @brief Create the emulated controller of a display
+ * @param ctx -> display
+ * @param cfg -> pins of the panel, only reset is used
+ * @return ESP_OK, ESP_ERR_NO_MEM
+ */
+esp_err_t ST7789_Port_Open(st7789_ctx_t *ctx, const st7789_config_t *cfg)
+{
+	struct st7789_emu *emu;
+
+	if (emu_bus == NULL && (emu_bus = xSemaphoreCreateMutex()) == NULL)
+		return ESP_ERR_NO_MEM;
+	emu = heap_caps_calloc(1, sizeof(*emu), MALLOC_CAP_8BIT);
+	if (emu == NULL)
+		return ESP_ERR_NO_MEM;
+	ST7789_Emu_Reset(emu);
+	emu->rst_pin = cfg->rst_pin;
+	ctx->port.emu = emu;
+	return ESP_OK;
+}
+
+/**
+ * @brief Free the emulated controller of the display
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_Close(st7789_ctx_t *ctx)
+{
+	heap_caps_free(ctx->port.emu);
+	ctx->port.emu = NULL;
+}
+
+/**
+ * @brief Decode a transaction, it completes at once
+ * @param ctx -> display
+ * @param idx -> index of the transaction, unused
+ * @param buf -> data
+ * @param len -> number of bytes
+ * @param dc -> level of the DC line, 0 command, 1 data
+ * @return none
+ */
+void ST7789_Port_Queue(st7789_ctx_t *ctx, uint8_t idx, const void *buf, size_t len, uint8_t dc)
+{
+	struct st7789_emu *emu = ctx->port.emu;
+	const uint8_t *p = buf;
+
+	emu->stats.transactions++;
+	emu->stats.bytes += len;
+	if (!dc) {
+		while (len--)
+			ST7789_Emu_Command(emu, *p++);
+	} else if (emu->cmd == ST7789_RAMWR || emu->cmd == ST7789_WRITE_MEM_CONTINUE) {
+		ST7789_Emu_Pixels(emu, p, len);
+	} else {
+		while (len--)
+			ST7789_Emu_Param(emu, *p++);
+	}
+}
+
+/**
+ * @brief Nothing to wait for, transactions complete when queued
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_Reclaim(st7789_ctx_t *ctx)
+{
+}
+
+/**
+ * @brief Take the shared bus for the display, other panels wait their turn
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_AcquireBus(st7789_ctx_t *ctx)
+{
+	xSemaphoreTake(emu_bus, portMAX_DELAY);
+}
+
+/**
+ * @brief Let the other panels use the bus
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_ReleaseBus(st7789_ctx_t *ctx)
+{
+	xSemaphoreGive(emu_bus);
+}
+
+/**
+ * @brief Drive a control pin of the panel, reset low resets the controller
+ * @param ctx -> display
+ * @param pin -> pin of st7789_config_t
+ * @param level -> 0 low, 1 high
+ * @return none
+ */
+void ST7789_Port_SetPin(st7789_ctx_t *ctx, int8_t pin, uint8_t level)
+{
+	struct st7789_emu *emu = ctx->port.emu;
+
+	if (pin == emu->rst_pin && !level)
+		ST7789_Emu_Reset(emu);
+}
+
+/**
+ * @brief Time for the counters and the trace
+ * @return microseconds of a monotonic clock
+ */
+int64_t ST7789_Port_Time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Read the traffic counters of the display
+ * @param stats -> counters since init or the last ST7789_Emu_ResetStats
+ * @return none
+ */
+void ST7789_Emu_GetStats(st7789_emu_stats_t *stats)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	if (ctx->port.emu)
+		*stats = ctx->port.emu->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Zero the traffic counters of the display
+ * @return none
+ */
+void ST7789_Emu_ResetStats(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	if (ctx->port.emu)
+		memset(&ctx->port.emu->stats, 0, sizeof(ctx->port.emu->stats));
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Read a pixel of the controller memory
+ * @param x -> GRAM column, 0 to 239
+ * @param y -> GRAM line, 0 to 319
+ * @return color, native RGB565, 0 outside GRAM
+ */
+uint16_t ST7789_Emu_GetPixel(uint16_t x, uint16_t y)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint16_t color = 0;
+
+	ST7789_Select();
+	if (ctx->port.emu && x < ST7789_GRAM_WIDTH && y < ST7789_GRAM_HEIGHT)
+		color = ctx->port.emu->gram[y][x];
+	ST7789_UnSelect();
+	return color;
+}
+
+/**
+ * @brief Read a pixel as the panel shows it
+ * @note  Coordinates are those of the drawing functions: the pixel a write
+ *        to (x, y) lands on under the current MADCTL, seen through the
+ *        scrolling area.
+ * @param x&y -> screen coordinates
+ * @return color, native RGB565, 0 outside GRAM
+ */
+uint16_t ST7789_Emu_GetScreenPixel(uint16_t x, uint16_t y)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint16_t color = 0;
+
+	ST7789_Select();
+	if (ctx->port.emu)
+		color = ST7789_Emu_Screen(ctx->port.emu, x, y);
+	ST7789_UnSelect();
+	return color;
+}
+
+/**
+ * @brief Update a CRC-32 of PNG chunks
+ * @param crc -> CRC so far, 0 to start
+ * @param p -> bytes
+ * @param n -> number of bytes
+ * @return CRC
+ */
+static uint32_t ST7789_Emu_Crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+	crc = ~crc;
+	while (n--) {
+		crc ^= *p++;
+		for (uint8_t k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+/**
+ * @brief Write a PNG chunk
+ * @param f -> file
+ * @param type -> chunk type, 4 characters
+ * @param data -> chunk data
+ * @param len -> bytes of data
+ * @return none
+ */
+static void ST7789_Emu_PNGChunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+	uint8_t be[4] = {len >> 24, len >> 16, len >> 8, len};
+	uint32_t crc;
+
+	fwrite(be, 1, 4, f);
+	fwrite(type, 1, 4, f);
+	crc = ST7789_Emu_Crc32(0, (const uint8_t *)type, 4);
+	if (len) {
+		fwrite(data, 1, len, f);
+		crc = ST7789_Emu_Crc32(crc, data, len);
+	}
+	be[0] = crc >> 24;
+	be[1] = crc >> 16;
+	be[2] = crc >> 8;
+	be[3] = crc;
+	fwrite(be, 1, 4, f);
+}
+
+/**
+ * @brief Save the screen as the panel shows it, width x height of the
+ *        current rotation
+ * @note  The image is a 24 bit PNG. Its pixel data is a zlib stream of stored
+ *        blocks, big but simple, which every viewer reads.
+ * @param path -> file to write
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before init, ESP_ERR_NO_MEM, ESP_FAIL
+ *         when the file cannot be written
+ */
+esp_err_t ST7789_Emu_SavePNG(const char *path)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	uint16_t w, h;
+	size_t raw_len, z_len, pos = 0;
+	uint8_t *raw, *z;
+	uint32_t a = 1, b = 0;
+	esp_err_t err = ESP_OK;
+	FILE *f;
+
+	ST7789_Select();
+	if (ctx->port.emu == NULL) {
+		ST7789_UnSelect();
+		return ESP_ERR_INVALID_STATE;
+	}
+	w = ctx->width;
+	h = ctx->height;
+	raw_len = (size_t)h * (1 + w * 3);
+	z_len = 2 + raw_len + 5 * ((raw_len + 65534) / 65535) + 4;
+	raw = heap_caps_malloc(raw_len, MALLOC_CAP_8BIT);
+	z = heap_caps_malloc(z_len, MALLOC_CAP_8BIT);
+	if (raw == NULL || z == NULL) {
+		ST7789_UnSelect();
+		heap_caps_free(raw);
+		heap_caps_free(z);
+		return ESP_ERR_NO_MEM;
+	}
+
+	/* Scanlines, filter type 0 then RGB888 */
+	for (uint16_t y = 0; y < h; y++) {
+		raw[pos++] = 0;
+		for (uint16_t x = 0; x < w; x++) {
+			uint16_t c = ST7789_Emu_Screen(ctx->port.emu, x, y);
+
+			raw[pos++] = ((c >> 11) * 527 + 23) >> 6;
+			raw[pos++] = (((c >> 5) & 0x3F) * 259 + 33) >> 6;
+			raw[pos++] = ((c & 0x1F) * 527 + 23) >> 6;
+		}
+	}
+	ST7789_UnSelect();
+
+	/* zlib header, stored blocks, Adler-32 */
+	pos = 0;
+	z[pos++] = 0x78;
+	z[pos++] = 0x01;
+	for (size_t off = 0; off < raw_len;) {
+		uint16_t n = raw_len - off > 65535 ? 65535 : raw_len - off;
+
+		z[pos++] = off + n == raw_len;
+		z[pos++] = n;
+		z[pos++] = n >> 8;
+		z[pos++] = ~n;
+		z[pos++] = (uint16_t)~n >> 8;
+		memcpy(z + pos, raw + off, n);
+		pos += n;
+		off += n;
+	}
+	for (size_t i = 0; i < raw_len; i++) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	z[pos++] = b >> 8;
+	z[pos++] = b;
+	z[pos++] = a >> 8;
+	z[pos++] = a;
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Cannot write %s", path);
+		err = ESP_FAIL;
+	} else {
+		static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+		uint8_t ihdr[13] = {0, 0, w >> 8, w, 0, 0, h >> 8, h, 8, 2, 0, 0, 0};
+
+		fwrite(sig, 1, sizeof(sig), f);
+		ST7789_Emu_PNGChunk(f, "IHDR", ihdr, sizeof(ihdr));
+		ST7789_Emu_PNGChunk(f, "IDAT", z, pos);
+		ST7789_Emu_PNGChunk(f, "IEND", NULL, 0);
+		if (fclose(f) != 0)
+			err = ESP_FAIL;
+	}
+	heap_caps_free(raw);
+	heap_caps_free(z);
+	return err;
+}
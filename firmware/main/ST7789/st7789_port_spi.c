@@ -0,0 +1,173 @@
+/**
+ * @file    st7789_port_spi.c
+ * @brief   SPI master transport of the ST7789 driver
+ * @details Transactions are queued to the SPI master with DMA. DC is driven
+ * 		from the pre transfer callback, so commands and data can be queued
+ * 		back to back without waiting for the bus.
+ */
+
+#include <string.h>
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "st7789.h"
+#include "st7789_internal.h"
+#include "st7789_port.h"
+
+/* Transactions carry their display in user, with the DC level in bit 0 */
+#define TRANS_CTX(t)	((st7789_ctx_t *)((uintptr_t)(t)->user & ~(uintptr_t)1))
+#define TRANS_DC(t)		((uintptr_t)(t)->user & 1)
+
+static uint8_t spi_bus_ready;	// spi_bus_initialize done, the bus is shared by the displays
+
+/**
+ * @brief Drive DC before a transaction goes on the wire
+ * @param t -> transaction about to start
+ * @return none
+ */
+static void IRAM_ATTR spi_PreTransferCallback(spi_transaction_t *t)
+{
+	gpio_set_level(TRANS_CTX(t)->dc_pin, TRANS_DC(t));
+}
+
+/**
+ * @brief Set up the pins, the SPI bus on first use and the SPI device of a
+ *        display
+ * @param ctx -> display
+ * @param cfg -> pins and clock of the panel
+ * @return ESP_OK or an error of the SPI driver
+ */
+esp_err_t ST7789_Port_Open(st7789_ctx_t *ctx, const st7789_config_t *cfg)
+{
+	esp_err_t err;
+
+	gpio_config_t io_output_conf = {};
+    io_output_conf.intr_type = GPIO_INTR_DISABLE;
+    io_output_conf.mode = GPIO_MODE_OUTPUT;
+    io_output_conf.pin_bit_mask = (1ULL<<cfg->dc_pin);
+	if (cfg->rst_pin >= 0)
+		io_output_conf.pin_bit_mask |= 1ULL << cfg->rst_pin;
+	if (cfg->bl_pin >= 0)
+		io_output_conf.pin_bit_mask |= 1ULL << cfg->bl_pin;
+    io_output_conf.pull_up_en = 0;
+
+    gpio_config(&io_output_conf);
+
+	if (!spi_bus_ready) {
+		spi_bus_config_t buscfg = {
+			.miso_io_num = -1,
+			.mosi_io_num = ST7789_SDA_PIN,
+			.sclk_io_num = ST7789_SCL_PIN,
+			.quadwp_io_num = -1,
+			.quadhd_io_num = -1,
+			.max_transfer_sz = ST7789_DMA_BUF_SIZE,
+		};
+		//Initialize the SPI bus, once for all the displays
+		err = spi_bus_initialize(SPI_HOST, &buscfg, SPI_DMA_CH_AUTO);
+		if (err != ESP_OK)
+			return err;
+		spi_bus_ready = 1;
+	}
+
+    spi_device_interface_config_t SpiDeviceCfg = {
+		.clock_speed_hz = cfg->clock_hz,		//<<< Clock of this panel
+		.mode = 0,								//<<< SPI mode 0
+		.spics_io_num = cfg->cs_pin,			//<<< CS pin number
+		.queue_size = ST7789_DMA_QUEUE_SIZE,	//<<< Number of transactions we want to be able to queue at a time using spi_device_queue_trans()
+		.pre_cb = spi_PreTransferCallback,		//<<< Drives DC for each transaction
+	};
+	return spi_bus_add_device(SPI_HOST, &SpiDeviceCfg, &ctx->port.hspi);
+}
+
+/**
+ * @brief Remove the SPI device of the display, the bus stays up
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_Close(st7789_ctx_t *ctx)
+{
+	if (ctx->port.hspi) {
+		spi_bus_remove_device(ctx->port.hspi);
+		ctx->port.hspi = NULL;
+	}
+}
+
+/**
+ * @brief Queue a transaction of the pool
+ * @param ctx -> display
+ * @param idx -> index of the transaction
+ * @param buf -> data to send, must be DMA capable and untouched until sent
+ * @param len -> number of bytes
+ * @param dc -> level of the DC line, 0 command, 1 data
+ * @return none
+ */
+void ST7789_Port_Queue(st7789_ctx_t *ctx, uint8_t idx, const void *buf, size_t len, uint8_t dc)
+{
+	spi_transaction_t *t = &ctx->port.trans[idx];
+
+	memset(t, 0, sizeof(*t));
+	t->length = len * 8;								//Transaction length is in bits
+	t->user = (void *)((uintptr_t)ctx | dc);
+	if (len <= ST7789_PORT_INLINE) {
+		t->flags = SPI_TRANS_USE_TXDATA;				//Short writes travel inside the transaction
+		memcpy(t->tx_data, buf, len);
+	}
+	else
+		t->tx_buffer = buf;
+	ESP_ERROR_CHECK(spi_device_queue_trans(ctx->port.hspi, t, portMAX_DELAY));
+}
+
+/**
+ * @brief Wait for the oldest queued transaction to leave the wire
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_Reclaim(st7789_ctx_t *ctx)
+{
+	spi_transaction_t *t;
+	spi_device_get_trans_result(ctx->port.hspi, &t, portMAX_DELAY);
+}
+
+/**
+ * @brief Take the shared bus for the display, other panels wait their turn
+ * @param ctx -> display
+ * @return none
+ */
+void ST7789_Port_AcquireBus(st7789_ctx_t *ctx)
+{
+	ESP_ERROR_CHECK(spi_device_acquire_bus(ctx->port.hspi, portMAX_DELAY));
+}
+
+/**
+ * @brief Let the other panels use the bus
+ * @param ctx -> display
+ * @note  Transactions still queued are sent before the bus changes hands.
+ * @return none
+ */
+void ST7789_Port_ReleaseBus(st7789_ctx_t *ctx)
+{
+	spi_device_release_bus(ctx->port.hspi);
+}
+
+/**
+ * @brief Drive a control pin of the panel, reset or backlight
+ * @param ctx -> display
+ * @param pin -> GPIO number, set up by ST7789_Port_Open
+ * @param level -> 0 low, 1 high
+ * @return none
+ */
+void ST7789_Port_SetPin(st7789_ctx_t *ctx, int8_t pin, uint8_t level)
+{
+	gpio_set_level(pin, level);
+}
+
+/**
+ * @brief Time for the counters and the trace
+ * @return microseconds since boot
+ */
+int64_t ST7789_Port_Time(void)
+{
+	return esp_timer_get_time();
+}
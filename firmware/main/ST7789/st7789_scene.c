@@ -0,0 +1,187 @@
+/**
+ * @file    st7789_scene.c
+ * @brief   Retained scene for the ST7789 driver
+ * @details Nodes remember what is on screen. Every change records the areas
+ * 		it affects, and rendering replays only the nodes overlapping those
+ * 		areas, clipped to them, through the band renderer.
+ */
+
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_scene.h"
+#include "st7789_internal.h"
+
+/**
+ * @brief Initialize an empty scene
+ * @param scene -> scene
+ * @param nodes -> storage for the nodes
+ * @param size -> number of nodes the storage can hold
+ * @param bgcolor -> color of the pixels no node covers
+ * @return none
+ */
+void ST7789_Scene_Init(st7789_scene_t *scene, st7789_node_t *nodes, uint16_t size, uint16_t bgcolor)
+{
+	ST7789_DL_Init(&scene->dl, nodes, size);
+	scene->bgcolor = bgcolor;
+	scene->damage_count = 0;
+}
+
+/**
+ * @brief Mark an area of the scene to be redrawn on the next render
+ * @param scene -> scene
+ * @param area -> damaged area, inclusive
+ * @return none
+ */
+void ST7789_Scene_Damage(st7789_scene_t *scene, const st7789_rect_t *area)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_rect_t r = *area;
+
+	if (r.x0 < 0) r.x0 = 0;
+	if (r.y0 < 0) r.y0 = 0;
+	if (r.x1 >= ctx->width) r.x1 = ctx->width - 1;
+	if (r.y1 >= ctx->height) r.y1 = ctx->height - 1;
+	if (r.x0 > r.x1 || r.y0 > r.y1)
+		return;
+
+	scene->damage_count = ST7789_RectListAdd(scene->damage, scene->damage_count, ST7789_SCENE_DAMAGE_MAX, &r);
+}
+
+/**
+ * @brief Mark the area of a node to be redrawn, e.g. after adding it or after
+ *        changing the data it references
+ * @param scene -> scene
+ * @param node -> node
+ * @return none
+ */
+void ST7789_Scene_Invalidate(st7789_scene_t *scene, const st7789_node_t *node)
+{
+	st7789_rect_t r;
+
+	ST7789_DL_Bounds(node, &r);
+	ST7789_Scene_Damage(scene, &r);
+}
+
+/**
+ * @brief Mark the whole screen to be redrawn
+ * @param scene -> scene
+ * @return none
+ */
+void ST7789_Scene_InvalidateAll(st7789_scene_t *scene)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_rect_t r = {0, 0, ctx->width - 1, ctx->height - 1};
+
+	scene->damage_count = 0;
+	ST7789_Scene_Damage(scene, &r);
+}
+
+/**
+ * @brief Replace a node, damaging both its old and its new area
+ * @param scene -> scene
+ * @param node -> node to change
+ * @param value -> new content of the node
+ * @return none
+ */
+void ST7789_Scene_Update(st7789_scene_t *scene, st7789_node_t *node, const st7789_node_t *value)
+{
+	ST7789_Scene_Invalidate(scene, node);
+	*node = *value;
+	ST7789_Scene_Invalidate(scene, node);
+}
+
+/**
+ * @brief Change the color of a node
+ * @param scene -> scene
+ * @param node -> node to change
+ * @param color -> new color
+ * @return none
+ */
+void ST7789_Scene_SetColor(st7789_scene_t *scene, st7789_node_t *node, uint16_t color)
+{
+	if (node->color == color)
+		return;
+	node->color = color;
+	ST7789_Scene_Invalidate(scene, node);
+}
+
+/**
+ * @brief Show or hide a node
+ * @param scene -> scene
+ * @param node -> node to change
+ * @param visible -> 1 to show the node, 0 to hide it
+ * @return none
+ */
+void ST7789_Scene_SetVisible(st7789_scene_t *scene, st7789_node_t *node, uint8_t visible)
+{
+	if (!node->hidden == !!visible)
+		return;
+	node->hidden = !visible;
+	ST7789_Scene_Invalidate(scene, node);
+}
+
+/**
+ * @brief Change the string of a text node
+ * @note  Only the character cells that differ are damaged. The node references
+ *        str: pass a new buffer rather than rewriting the current one, or call
+ *        ST7789_Scene_Invalidate() after changing it in place.
+ * @param scene -> scene
+ * @param node -> text node
+ * @param str -> new string
+ * @return none
+ */
+void ST7789_Scene_SetText(st7789_scene_t *scene, st7789_node_t *node, const char *str)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	const char *old;
+	const FontDef *font;
+	int32_t old_len, new_len, len;
+
+	if (node->type != ST7789_DL_TEXT)
+		return;
+
+	/* The text fields are only valid once the node is known to be text */
+	old = node->text.str;
+	font = node->text.font;
+	old_len = strlen(old);
+	new_len = strlen(str);
+	len = old_len > new_len ? old_len : new_len;
+
+	if (node->text.x + len * font->width >= ctx->width) {
+		/* One of the strings wraps, its cells are not on a single row */
+		ST7789_Scene_Invalidate(scene, node);
+		node->text.str = str;
+		ST7789_Scene_Invalidate(scene, node);
+		return;
+	}
+
+	node->text.str = str;
+	if (node->hidden)
+		return;
+	for (int32_t i = 0; i < len; i++) {
+		if (i < old_len && i < new_len && old[i] == str[i])
+			continue;
+		st7789_rect_t cell = {
+			node->text.x + i * font->width,
+			node->text.y,
+			node->text.x + (i + 1) * font->width - 1,
+			node->text.y + font->height - 1,
+		};
+		ST7789_Scene_Damage(scene, &cell);
+	}
+}
+
+/**
+ * @brief Redraw the damaged areas of the scene
+ * @note  With the framebuffer enabled the areas are redrawn in it, and
+ *        ST7789_Flush() sends them.
+ * @param scene -> scene
+ * @return none
+ */
+void ST7789_Scene_Render(st7789_scene_t *scene)
+{
+	for (uint8_t i = 0; i < scene->damage_count; i++)
+		ST7789_Band_Render(&scene->dl, &scene->damage[i], scene->bgcolor);
+	scene->damage_count = 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file    st7789_scene.h
+ * @brief   Retained scene on top of the ST7789 display lists.
+ * @note    A scene is a display list whose primitives (nodes) stay on screen.
+ *     Changing a node damages the area it covered and the area it now covers,
+ *     ST7789_Scene_Render() then redraws only the damaged areas, replaying
+ *     every node that overlaps them in list (z) order.
+ */
+
+#ifndef __ST7789_SCENE_H
+#define __ST7789_SCENE_H
+
+#include "st7789_dl.h"
+
+/**
+ * Retained scene. Nodes are added to dl with the ST7789_DL_* functions, then
+ * ST7789_Scene_Invalidate() must be called on them to get them drawn.
+ */
+typedef struct {
+	st7789_dl_t dl;		// Nodes, first is at the bottom
+	uint16_t bgcolor;	// Color of the pixels no node covers
+	st7789_rect_t damage[ST7789_SCENE_DAMAGE_MAX];
+	uint8_t damage_count;
+}st7789_scene_t;
+
+typedef st7789_dl_op_t st7789_node_t;
+
+/* Scene functions. */
+void ST7789_Scene_Init(st7789_scene_t *scene, st7789_node_t *nodes, uint16_t size, uint16_t bgcolor);
+void ST7789_Scene_Damage(st7789_scene_t *scene, const st7789_rect_t *area);
+void ST7789_Scene_Invalidate(st7789_scene_t *scene, const st7789_node_t *node);
+void ST7789_Scene_InvalidateAll(st7789_scene_t *scene);
+void ST7789_Scene_Update(st7789_scene_t *scene, st7789_node_t *node, const st7789_node_t *value);
+void ST7789_Scene_SetColor(st7789_scene_t *scene, st7789_node_t *node, uint16_t color);
+void ST7789_Scene_SetVisible(st7789_scene_t *scene, st7789_node_t *node, uint8_t visible);
+void ST7789_Scene_SetText(st7789_scene_t *scene, st7789_node_t *node, const char *str);
+void ST7789_Scene_Render(st7789_scene_t *scene);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * @file    st7789_sprite.c
+ * @brief   Alpha blended sprites for the ST7789 driver
+ * @details The blend loop takes four pixels per iteration. Runs of four opaque
+ * 		or four transparent pixels, the bulk of most icons, are copied or
+ * 		skipped without blending. Only the edges pay for the multiply.
+ */
+
+#include <string.h>
+#include "esp_heap_caps.h"
+
+#include "st7789.h"
+#include "st7789_image.h"
+#include "st7789_sprite.h"
+#include "st7789_internal.h"
+
+/**
+ * @brief Blend a sprite pixel over a background pixel
+ * @param fg&bg -> colors, panel byte order
+ * @param a -> alpha, 0 to 255
+ * @return color, panel byte order
+ */
+static inline uint16_t ST7789_Sprite_Blend(uint16_t fg, uint16_t bg, uint8_t a)
+{
+	uint16_t px = ST7789_Blend565((fg >> 8) | (fg << 8), (bg >> 8) | (bg << 8), (a * 33) >> 8);
+
+	return (px >> 8) | (px << 8);
+}
+
+/**
+ * @brief Blend a row of sprite pixels over a row of background
+ * @param dst -> output, may be bg
+ * @param bg -> background
+ * @param src -> sprite pixels
+ * @param alpha -> sprite alpha
+ * @param n -> pixels
+ * @return none
+ */
+static void ST7789_Sprite_BlendRow(uint16_t *dst, const uint16_t *bg, const uint16_t *src, const uint8_t *alpha, uint16_t n)
+{
+	for (; n >= 4; n -= 4, dst += 4, bg += 4, src += 4, alpha += 4) {
+		uint32_t a;
+
+		memcpy(&a, alpha, 4);
+		if (a == 0xFFFFFFFF) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = src[3];
+		} else if (a == 0) {
+			if (dst != bg) {
+				dst[0] = bg[0];
+				dst[1] = bg[1];
+				dst[2] = bg[2];
+				dst[3] = bg[3];
+			}
+		} else {
+			dst[0] = ST7789_Sprite_Blend(src[0], bg[0], alpha[0]);
+			dst[1] = ST7789_Sprite_Blend(src[1], bg[1], alpha[1]);
+			dst[2] = ST7789_Sprite_Blend(src[2], bg[2], alpha[2]);
+			dst[3] = ST7789_Sprite_Blend(src[3], bg[3], alpha[3]);
+		}
+	}
+	while (n--)
+		*dst++ = ST7789_Sprite_Blend(*src++, *bg++, *alpha++);
+}
+
+/**
+ * @brief Blend a sprite over a background and write it to the render target
+ * @param bg -> background tile, NULL for the pixels of a RAM target, black
+ *        on the panel
+ * @return none
+ */
+static void ST7789_Sprite_Composite(int16_t x, int16_t y, const st7789_sprite_t *sprite, const st7789_tile_t *bg)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	uint16_t *buf = NULL;
+	uint16_t vw, rows = 1, n = 0;
+
+	if (!sprite->w || !sprite->h)
+		return;
+	/* Hold the driver until the last row, blending reads the target */
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_SPRITE);
+	s = ctx->target;
+	st7789_rect_t vis = {x, y, x + sprite->w - 1, y + sprite->h - 1};
+	if (bg) {
+		/* Pixels without background are not drawn */
+		if (bg->x > vis.x0) vis.x0 = bg->x;
+		if (bg->y > vis.y0) vis.y0 = bg->y;
+		if (bg->x + bg->w - 1 < vis.x1) vis.x1 = bg->x + bg->w - 1;
+		if (bg->y + bg->h - 1 < vis.y1) vis.y1 = bg->y + bg->h - 1;
+	}
+	if (!ST7789_ClipToTarget(&vis)) {
+		ST7789_UnSelect();
+		return;
+	}
+	vw = vis.x1 - vis.x0 + 1;
+
+	if (s == NULL) {
+		/* Chunks of rows blended straight into the DMA buffer of a transaction */
+		rows = ST7789_DMA_BUF_SIZE / (vw * 2);
+		/* One window for the visible part, each chunk continues in it */
+		ST7789_SetAddressWindow(vis.x0, vis.y0, vis.x1, vis.y1);
+	}
+
+	for (int16_t row = vis.y0; row <= vis.y1; row++) {
+		size_t off = (size_t)(row - y) * sprite->w + (vis.x0 - x);
+		const uint16_t *back;
+		uint16_t *dst;
+
+		if (s) {
+			dst = s->buf + (size_t)(row - s->y) * s->stride + (vis.x0 - s->x);
+		} else {
+			if (n == 0)
+				buf = ST7789_PixelBuf();
+			dst = buf + (size_t)n * vw;
+		}
+
+		if (bg) {
+			back = bg->pixels + (size_t)(row - bg->y) * bg->w + (vis.x0 - bg->x);
+		} else {
+			if (s == NULL)
+				memset(dst, 0, (size_t)vw * 2);
+			back = dst;
+		}
+		ST7789_Sprite_BlendRow(dst, back, sprite->pixels + off, sprite->alpha + off, vw);
+
+		if (s == NULL && (++n == rows || row == vis.y1)) {
+			ST7789_QueuePixels((uint32_t)n * vw);
+			n = 0;
+		}
+	}
+
+	if (s == &ctx->fb)
+		ST7789_FB_MarkDirty(vis.x0, vis.y0, vis.x1, vis.y1);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Use an alpha image as a sprite, the data is used in place
+ * @param sprite -> sprite to initialize
+ * @param data -> ST7789_IMAGE_RGB565A8 image file contents, 2 bytes aligned
+ * @param size -> bytes of data
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if data is not an alpha image, or an
+ *         error of ST7789_Image_Open
+ */
+esp_err_t ST7789_Sprite_Open(st7789_sprite_t *sprite, const void *data, size_t size)
+{
+	st7789_image_dec_t dec;
+	esp_err_t err = ST7789_Image_Open(&dec, data, size);
+
+	memset(sprite, 0, sizeof(*sprite));
+	if (err != ESP_OK)
+		return err;
+	if (dec.format != ST7789_IMAGE_RGB565A8)
+		return ESP_ERR_INVALID_ARG;
+
+	sprite->w = dec.width;
+	sprite->h = dec.height;
+	sprite->pixels = (const uint16_t *)dec.src;
+	sprite->alpha = dec.end;
+	return ESP_OK;
+}
+
+/**
+ * @brief Draw a sprite blended into the pixels of the render target
+ * @note  Blending reads the target back, so it needs the framebuffer or a band
+ *        strip. On the panel, which cannot be read back, the sprite is drawn
+ *        over black; use ST7789_DrawSpriteOn with a background tile instead.
+ * @param x&y -> top left corner of the sprite
+ * @param sprite -> sprite
+ * @return none
+ */
+void ST7789_DrawSprite(int16_t x, int16_t y, const st7789_sprite_t *sprite)
+{
+	ST7789_Sprite_Composite(x, y, sprite, NULL);
+}
+
+/**
+ * @brief Draw a sprite blended over a background tile
+ * @note  Works on any render target, the panel included. Only the part of the
+ *        sprite over the tile is drawn, so moving a sprite over a tile also
+ *        erases its previous position when the tile covers both.
+ * @param x&y -> top left corner of the sprite
+ * @param sprite -> sprite
+ * @param bg -> background of the area
+ * @return none
+ */
+void ST7789_DrawSpriteOn(int16_t x, int16_t y, const st7789_sprite_t *sprite, const st7789_tile_t *bg)
+{
+	ST7789_Sprite_Composite(x, y, sprite, bg);
+}
+
+/**
+ * @brief Keep a copy of an area of the render target as a background tile
+ * @note  Capture the background before drawing sprites over it, e.g. once
+ *        after the framebuffer holds the screen without them.
+ * @param tile -> tile to fill
+ * @param x&y -> top left corner of the area
+ * @param w&h -> size of the area, it must lie inside the render target
+ * @return ESP_OK, ESP_ERR_INVALID_STATE when drawing to the panel,
+ *         ESP_ERR_INVALID_ARG for an area outside the target, ESP_ERR_NO_MEM
+ */
+esp_err_t ST7789_Tile_Capture(st7789_tile_t *tile, int16_t x, int16_t y, uint16_t w, uint16_t h)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	uint16_t *pixels;
+	esp_err_t err = ESP_OK;
+
+	memset(tile, 0, sizeof(*tile));
+	ST7789_Select();
+	s = ctx->target;
+	if (s == NULL)
+		err = ESP_ERR_INVALID_STATE;
+	else if (!w || !h || x < s->x || y < s->y || x + w > s->x + s->w || y + h > s->y + s->h)
+		err = ESP_ERR_INVALID_ARG;
+	else if ((pixels = heap_caps_malloc((size_t)w * h * 2, MALLOC_CAP_8BIT)) == NULL)
+		err = ESP_ERR_NO_MEM;
+	if (err != ESP_OK) {
+		ST7789_UnSelect();
+		return err;
+	}
+	for (uint16_t row = 0; row < h; row++)
+		memcpy(pixels + (size_t)row * w, s->buf + (size_t)(y + row - s->y) * s->stride + (x - s->x), (size_t)w * 2);
+	ST7789_UnSelect();
+
+	tile->x = x;
+	tile->y = y;
+	tile->w = w;
+	tile->h = h;
+	tile->pixels = pixels;
+	tile->owned = 1;
+	return ESP_OK;
+}
+
+/**
+ * @brief Free the pixels of a captured tile
+ * @param tile -> tile
+ * @return none
+ */
+void ST7789_Tile_Free(st7789_tile_t *tile)
+{
+	if (tile->owned)
+		heap_caps_free((void *)tile->pixels);
+	memset(tile, 0, sizeof(*tile));
+}
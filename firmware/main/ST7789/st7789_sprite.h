@@ -0,0 +1,49 @@
+/**
+ * @file    st7789_sprite.h
+ * @brief   Alpha blended sprites for the ST7789 driver.
+ * @note    A sprite is an RGB565 image with one 8 bits alpha per pixel, kept
+ *     as two planes. The panel memory cannot be read back, so sprites are
+ *     blended over a known background: the pixels of a RAM render target,
+ *     such as the framebuffer, or a background tile held in memory.
+ *
+ *     Sprites are stored as ST7789_IMAGE_RGB565A8 images, made by
+ *     tools/mkimage.py --alpha.
+ */
+
+#ifndef __ST7789_SPRITE_H
+#define __ST7789_SPRITE_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+typedef struct {
+	uint16_t w;
+	uint16_t h;
+	const uint16_t *pixels;	// RGB565, panel byte order
+	const uint8_t *alpha;	// 0 for transparent to 255 for opaque
+}st7789_sprite_t;
+
+/**
+ * Background of a screen area
+ */
+typedef struct {
+	int16_t x;				// Screen column of the first pixel
+	int16_t y;				// Screen row of the first pixel
+	uint16_t w;
+	uint16_t h;
+	const uint16_t *pixels;	// RGB565, panel byte order
+	uint8_t owned;			// Pixels were allocated by ST7789_Tile_Capture
+}st7789_tile_t;
+
+/* Sprite functions. */
+esp_err_t ST7789_Sprite_Open(st7789_sprite_t *sprite, const void *data, size_t size);
+void ST7789_DrawSprite(int16_t x, int16_t y, const st7789_sprite_t *sprite);
+void ST7789_DrawSpriteOn(int16_t x, int16_t y, const st7789_sprite_t *sprite, const st7789_tile_t *bg);
+
+/* Background tile functions. */
+esp_err_t ST7789_Tile_Capture(st7789_tile_t *tile, int16_t x, int16_t y, uint16_t w, uint16_t h);
+void ST7789_Tile_Free(st7789_tile_t *tile);
+
+#endif
@@ -0,0 +1,433 @@
+/**
+ * @file    st7789_task.c
+ * @brief   Display task of the ST7789 driver
+ * @details The command ring is a bounded multi producer, single consumer
+ * 		queue: each slot carries a sequence number telling whether it is
+ * 		free for the lap a producer claimed with a compare and swap, or
+ * 		holds a command the display task may take. Producers never wait for
+ * 		each other or for the bus, only for room when the ring is full.
+ * 		The display task copies a batch of commands out of the ring before
+ * 		drawing, so the slots are free again while the batch is sent.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_dl.h"
+#include "st7789_task.h"
+#include "st7789_internal.h"
+
+#if (ST7789_TASK_QUEUE_SIZE & (ST7789_TASK_QUEUE_SIZE - 1)) != 0
+#error "ST7789_TASK_QUEUE_SIZE must be a power of two"
+#endif
+
+typedef struct {
+	uint32_t seq;		// Position the slot is free for, or position + 1 once filled
+	st7789_cmd_t cmd;
+}st7789_task_slot_t;
+
+static struct {
+	st7789_task_slot_t slots[ST7789_TASK_QUEUE_SIZE];
+	uint32_t head;			// Next position to claim, shared by the producers
+	uint32_t tail;			// Next position to take, display task only
+	TaskHandle_t task;
+	TaskHandle_t waiter;	// Task stopping the display task
+	st7789_handle_t display;	// Display the task starts on
+	uint8_t stop;
+}st7789_task;
+
+/**
+ * @brief Put a command in the ring
+ * @param cmd -> command to copy
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the task is not running, or
+ *         ESP_ERR_TIMEOUT if the ring stayed full
+ */
+static esp_err_t ST7789_Task_Post(const st7789_cmd_t *cmd)
+{
+	TickType_t start = xTaskGetTickCount();
+	TaskHandle_t task = __atomic_load_n(&st7789_task.task, __ATOMIC_ACQUIRE);
+	st7789_task_slot_t *slot;
+	uint32_t pos;
+
+	if (task == NULL)
+		return ESP_ERR_INVALID_STATE;
+
+	pos = __atomic_load_n(&st7789_task.head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &st7789_task.slots[pos & (ST7789_TASK_QUEUE_SIZE - 1)];
+		int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&st7789_task.head, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* The slot still holds the command of the previous lap */
+			if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(ST7789_TASK_POST_WAIT_MS))
+				return ESP_ERR_TIMEOUT;
+			xTaskNotifyGive(task);
+			vTaskDelay(1);
+			pos = __atomic_load_n(&st7789_task.head, __ATOMIC_RELAXED);
+		} else {
+			/* Another producer took the slot */
+			pos = __atomic_load_n(&st7789_task.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->cmd = *cmd;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	xTaskNotifyGive(task);
+	return ESP_OK;
+}
+
+/**
+ * @brief Take a command out of the ring
+ * @param cmd -> copy of the command
+ * @return 1 if a command was taken, 0 if the ring is empty
+ */
+static uint8_t ST7789_Task_Take(st7789_cmd_t *cmd)
+{
+	uint32_t pos = st7789_task.tail;
+	st7789_task_slot_t *slot = &st7789_task.slots[pos & (ST7789_TASK_QUEUE_SIZE - 1)];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return 0;
+	*cmd = slot->cmd;
+	__atomic_store_n(&slot->seq, pos + ST7789_TASK_QUEUE_SIZE, __ATOMIC_RELEASE);
+	st7789_task.tail = pos + 1;
+
+	/* A string copied in the command now lives in the copy */
+	if (cmd->type == ST7789_CMD_DRAW && cmd->op.type == ST7789_DL_TEXT && cmd->op.text.str == NULL)
+		cmd->op.text.str = cmd->text;
+	return 1;
+}
+
+/**
+ * @brief Tell whether a drawing command paints every pixel of its bounds
+ * @param op -> primitive
+ * @param r -> bounds of the primitive
+ * @return 1 if opaque
+ */
+static uint8_t ST7789_Task_Opaque(const st7789_dl_op_t *op, st7789_rect_t *r)
+{
+	switch (op->type) {
+	case ST7789_DL_FILL:
+		if (op->line.x0 > op->line.x1 || op->line.y0 > op->line.y1)
+			return 0;
+		break;
+	case ST7789_DL_FILLED_RECT:
+		/* ST7789_DrawFilledRectangle takes an unsigned size */
+		if (op->rect.w < 0 || op->rect.h < 0)
+			return 0;
+		break;
+	case ST7789_DL_IMAGE:
+		if (!op->image.w || !op->image.h)
+			return 0;
+		break;
+	default:
+		return 0;
+	}
+	ST7789_DL_Bounds(op, r);
+	return 1;
+}
+
+/**
+ * @brief Tell whether two rectangles share a pixel
+ */
+static inline uint8_t ST7789_Task_Overlap(const st7789_rect_t *a, const st7789_rect_t *b)
+{
+	return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+/**
+ * @brief Tell whether a command is a fill still to be drawn
+ */
+static inline uint8_t ST7789_Task_IsFill(const st7789_cmd_t *cmd)
+{
+	return cmd->type == ST7789_CMD_DRAW && !cmd->op.hidden && cmd->op.type == ST7789_DL_FILL;
+}
+
+/**
+ * @brief Coalesce a run of drawing commands
+ * @note  Primitives entirely painted over by a later opaque primitive are
+ *        hidden. Fills are moved up behind the previous fill of their color
+ *        when nothing they overlap is drawn in between, so each color is
+ *        expanded in the fill buffer once, and adjacent fills of the same
+ *        color forming a rectangle become one window.
+ * @param cmds -> batch of commands
+ * @param order -> drawing order of the run, indexes in cmds, reordered
+ * @param n -> number of commands in the run
+ * @return none
+ */
+static void ST7789_Task_Coalesce(st7789_cmd_t *cmds, uint8_t *order, uint8_t n)
+{
+	st7789_rect_t rj, ri;
+
+	/* Overdraw */
+	for (uint8_t j = 1; j < n; j++) {
+		st7789_dl_op_t *top = &cmds[order[j]].op;
+
+		if (top->hidden || !ST7789_Task_Opaque(top, &rj))
+			continue;
+		for (uint8_t i = 0; i < j; i++) {
+			st7789_dl_op_t *op = &cmds[order[i]].op;
+
+			if (op->hidden)
+				continue;
+			ST7789_DL_Bounds(op, &ri);
+			if (ri.x0 >= rj.x0 && ri.x1 <= rj.x1 && ri.y0 >= rj.y0 && ri.y1 <= rj.y1)
+				op->hidden = 1;
+		}
+	}
+
+	/* Group the fills of a color */
+	for (uint8_t i = 0; i + 1 < n; i++) {
+		if (!ST7789_Task_IsFill(&cmds[order[i]]))
+			continue;
+		for (uint8_t j = i + 1; j < n; j++) {
+			uint8_t k, fill = order[j];
+
+			if (!ST7789_Task_IsFill(&cmds[fill]) || cmds[fill].op.color != cmds[order[i]].op.color)
+				continue;
+			ST7789_DL_Bounds(&cmds[fill].op, &rj);
+			for (k = i + 1; k < j; k++) {
+				if (cmds[order[k]].op.hidden)
+					continue;
+				ST7789_DL_Bounds(&cmds[order[k]].op, &ri);
+				if (ST7789_Task_Overlap(&ri, &rj))
+					break;
+			}
+			if (k == j) {
+				memmove(&order[i + 2], &order[i + 1], j - i - 1);
+				order[i + 1] = fill;
+			}
+			break;
+		}
+	}
+
+	/* Merge fills forming a rectangle */
+	for (uint8_t i = 0; i + 1 < n; i++) {
+		st7789_cmd_t *a = &cmds[order[i]], *b = &cmds[order[i + 1]];
+
+		if (!ST7789_Task_IsFill(a) || !ST7789_Task_IsFill(b) || a->op.color != b->op.color)
+			continue;
+		ST7789_DL_Bounds(&a->op, &ri);
+		ST7789_DL_Bounds(&b->op, &rj);
+		if (ri.x0 == rj.x0 && ri.x1 == rj.x1 && rj.y0 <= ri.y1 + 1 && ri.y0 <= rj.y1 + 1) {
+			ri.y0 = ri.y0 < rj.y0 ? ri.y0 : rj.y0;
+			ri.y1 = ri.y1 > rj.y1 ? ri.y1 : rj.y1;
+		} else if (ri.y0 == rj.y0 && ri.y1 == rj.y1 && rj.x0 <= ri.x1 + 1 && ri.x0 <= rj.x1 + 1) {
+			ri.x0 = ri.x0 < rj.x0 ? ri.x0 : rj.x0;
+			ri.x1 = ri.x1 > rj.x1 ? ri.x1 : rj.x1;
+		} else {
+			continue;
+		}
+		/* The merged fill takes the place of the second, the next may extend it */
+		a->op.hidden = 1;
+		b->op.line.x0 = ri.x0;
+		b->op.line.y0 = ri.y0;
+		b->op.line.x1 = ri.x1;
+		b->op.line.y1 = ri.y1;
+	}
+}
+
+/**
+ * @brief Display task, draws the posted commands until stopped
+ */
+static void ST7789_Task_Main(void *arg)
+{
+	st7789_cmd_t batch[ST7789_TASK_BATCH];
+	uint8_t order[ST7789_TASK_BATCH];
+	TaskHandle_t waiter;
+
+	ST7789_Display_Use(st7789_task.display);
+	for (;;) {
+		st7789_ctx_t *ctx;
+		uint8_t n = 0;
+		uint32_t frames;
+
+		while (n < ST7789_TASK_BATCH && ST7789_Task_Take(&batch[n])) {
+			order[n] = n;
+			n++;
+		}
+		if (n == 0) {
+			if (__atomic_load_n(&st7789_task.stop, __ATOMIC_ACQUIRE))
+				break;
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+
+		/* Calls, flushes and syncs keep their place, draws coalesce between them */
+		for (uint8_t i = 0, first = 0; i <= n; i++) {
+			if (i == n || batch[i].type != ST7789_CMD_DRAW) {
+				if (i - first > 1)
+					ST7789_Task_Coalesce(batch, &order[first], i - first);
+				first = i + 1;
+			}
+		}
+
+		ST7789_Select();
+		ctx = ST7789_Ctx();
+		ST7789_Trace_Call(ST7789_TRACE_BATCH);
+		/* The batch plus what was queued behind it */
+		ST7789_Trace_QueueDepth(n + __atomic_load_n(&st7789_task.head, __ATOMIC_RELAXED) - st7789_task.tail);
+		frames = ctx->stats.frames;
+		for (uint8_t i = 0; i < n; i++) {
+			st7789_cmd_t *cmd = &batch[order[i]];
+
+			switch (cmd->type) {
+			case ST7789_CMD_DRAW:
+				ST7789_DL_Exec(&cmd->op);
+				break;
+			case ST7789_CMD_FLUSH:
+				ST7789_Flush();
+				break;
+			case ST7789_CMD_CALL:
+				/* Out of the lock, the call may switch displays */
+				ST7789_UnSelect();
+				cmd->call.fn(cmd->call.arg);
+				ST7789_Select();
+				break;
+			case ST7789_CMD_SYNC:
+				ST7789_WaitIdle();
+				xTaskNotifyGive(cmd->waiter);
+				break;
+			default:
+				break;
+			}
+		}
+		if (ctx->stats.frames == frames)
+			ST7789_Trace_Frame();	// No flush, the batch is the frame
+		ST7789_Trace_TaskStack(uxTaskGetStackHighWaterMark(NULL));
+		ST7789_UnSelect();
+		ST7789_Power_Update();
+	}
+
+	waiter = st7789_task.waiter;
+	__atomic_store_n(&st7789_task.task, NULL, __ATOMIC_RELEASE);
+	xTaskNotifyGive(waiter);
+	vTaskDelete(NULL);
+}
+
+/**
+ * @brief Start the display task
+ * @note  The task has the priority of the caller and draws to its display.
+ *        The driver must be initialized. Drawing directly stays possible,
+ *        the driver lock orders it with the batches of the task.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the task runs, ESP_ERR_NO_MEM
+ */
+esp_err_t ST7789_Task_Start(void)
+{
+	TaskHandle_t task;
+
+	if (__atomic_load_n(&st7789_task.task, __ATOMIC_ACQUIRE) != NULL)
+		return ESP_ERR_INVALID_STATE;
+
+	memset(&st7789_task, 0, sizeof(st7789_task));
+	for (uint32_t i = 0; i < ST7789_TASK_QUEUE_SIZE; i++)
+		st7789_task.slots[i].seq = i;
+	st7789_task.display = ST7789_Display_Current();
+
+	if (xTaskCreate(ST7789_Task_Main, "st7789", ST7789_TASK_STACK, NULL,
+			uxTaskPriorityGet(NULL), &task) != pdPASS)
+		return ESP_ERR_NO_MEM;
+	/* The task only looks at the ring, posts see it once it exists */
+	__atomic_store_n(&st7789_task.task, task, __ATOMIC_RELEASE);
+	return ESP_OK;
+}
+
+/**
+ * @brief Stop the display task once the posted commands are drawn
+ * @note  The notification of the calling task is used to wait. Nothing may
+ *        be posted while stopping.
+ * @return none
+ */
+void ST7789_Task_Stop(void)
+{
+	TaskHandle_t task = __atomic_load_n(&st7789_task.task, __ATOMIC_ACQUIRE);
+
+	if (task == NULL)
+		return;
+	st7789_task.waiter = xTaskGetCurrentTaskHandle();
+	__atomic_store_n(&st7789_task.stop, 1, __ATOMIC_RELEASE);
+	xTaskNotifyGive(task);
+	while (__atomic_load_n(&st7789_task.task, __ATOMIC_ACQUIRE) != NULL)
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+/**
+ * @brief Post the primitives of a display list to the display task
+ * @note  The list may be reused as soon as this returns. Primitives of
+ *        lists posted by other tasks may be drawn between these.
+ * @param dl -> display list
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the task is not running, or
+ *         ESP_ERR_TIMEOUT if the ring stayed full, the primitives before
+ *         the failing one are posted
+ */
+esp_err_t ST7789_Task_PostList(const st7789_dl_t *dl)
+{
+	st7789_cmd_t cmd = {.type = ST7789_CMD_DRAW};
+	esp_err_t err = ESP_OK;
+
+	for (uint16_t i = 0; i < dl->count && err == ESP_OK; i++) {
+		cmd.op = dl->ops[i];
+		if (cmd.op.type == ST7789_DL_TEXT && strlen(cmd.op.text.str) < ST7789_TASK_TEXT_MAX) {
+			strcpy(cmd.text, cmd.op.text.str);
+			cmd.op.text.str = NULL;
+		}
+		err = ST7789_Task_Post(&cmd);
+	}
+	return err;
+}
+
+/**
+ * @brief Post a framebuffer flush to the display task
+ * @return ESP_OK, ESP_ERR_INVALID_STATE, or ESP_ERR_TIMEOUT
+ */
+esp_err_t ST7789_Task_PostFlush(void)
+{
+	st7789_cmd_t cmd = {.type = ST7789_CMD_FLUSH};
+
+	return ST7789_Task_Post(&cmd);
+}
+
+/**
+ * @brief Post a function to be run by the display task
+ * @note  The function runs in order with the commands around it, and may
+ *        draw, change the render target, or switch the display of the task
+ *        with ST7789_Display_Use for the commands after it.
+ * @param fn -> function
+ * @param arg -> argument of fn
+ * @return ESP_OK, ESP_ERR_INVALID_STATE, or ESP_ERR_TIMEOUT
+ */
+esp_err_t ST7789_Task_PostCall(void (*fn)(void *arg), void *arg)
+{
+	st7789_cmd_t cmd = {.type = ST7789_CMD_CALL};
+
+	cmd.call.fn = fn;
+	cmd.call.arg = arg;
+	return ST7789_Task_Post(&cmd);
+}
+
+/**
+ * @brief Wait until the commands posted by the calling task are on the panel
+ * @note  The notification of the calling task is used to wait. After a
+ *        timeout the notification still comes later, and would end the next
+ *        wait on the notification early.
+ * @param wait -> ticks to wait
+ * @return ESP_OK, ESP_ERR_INVALID_STATE, or ESP_ERR_TIMEOUT
+ */
+esp_err_t ST7789_Task_Sync(TickType_t wait)
+{
+	st7789_cmd_t cmd = {.type = ST7789_CMD_SYNC};
+	esp_err_t err;
+
+	cmd.waiter = xTaskGetCurrentTaskHandle();
+	err = ST7789_Task_Post(&cmd);
+	if (err != ESP_OK)
+		return err;
+	return ulTaskNotifyTake(pdTRUE, wait) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
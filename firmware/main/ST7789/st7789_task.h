@@ -0,0 +1,64 @@
+/**
+ * @file    st7789_task.h
+ * @brief   Display task of the ST7789 driver.
+ * @note    The display task owns the panel. Other tasks, on either core,
+ *     post drawing commands to a lock-free ring and return at once, without
+ *     waiting for the SPI bus. The task takes the commands in batches, drops
+ *     those a later command paints over, groups fills of the same color and
+ *     merges adjacent ones, then draws the batch holding the driver lock.
+ *
+ *     Drawing commands are display list primitives, recorded with the
+ *     ST7789_DL_* functions and posted as a list:
+ *
+ *         st7789_dl_op_t ops[2];
+ *         st7789_dl_t dl;
+ *         ST7789_DL_Init(&dl, ops, 2);
+ *         ST7789_DL_Fill(&dl, 0, 0, 239, 19, BLUE);
+ *         ST7789_DL_String(&dl, 4, 1, "Wi-Fi up", &Font_11x18, WHITE, BLUE);
+ *         ST7789_Task_PostList(&dl);
+ *
+ *     Strings shorter than ST7789_TASK_TEXT_MAX are copied with the command.
+ *     Longer strings, fonts and image data are referenced and must stay
+ *     valid until drawn, see ST7789_Task_Sync. Posting is for tasks, not
+ *     interrupts.
+ */
+
+#ifndef __ST7789_TASK_H
+#define __ST7789_TASK_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#include "st7789.h"
+#include "st7789_dl.h"
+
+/**
+ * Commands of the display task
+ */
+typedef enum {
+	ST7789_CMD_DRAW = 0,	// A display list primitive
+	ST7789_CMD_FLUSH,		// ST7789_Flush
+	ST7789_CMD_CALL,		// A function run by the display task
+	ST7789_CMD_SYNC,		// Wake the posting task once everything before is sent
+}st7789_cmd_type_t;
+
+typedef struct {
+	st7789_cmd_type_t type;
+	union {
+		st7789_dl_op_t op;									// DRAW
+		struct { void (*fn)(void *arg); void *arg; } call;	// CALL
+		TaskHandle_t waiter;								// SYNC
+	};
+	char text[ST7789_TASK_TEXT_MAX];	// Copy of the string of a short text op
+}st7789_cmd_t;
+
+/* Display task functions. */
+esp_err_t ST7789_Task_Start(void);
+void ST7789_Task_Stop(void);
+esp_err_t ST7789_Task_PostList(const st7789_dl_t *dl);
+esp_err_t ST7789_Task_PostFlush(void);
+esp_err_t ST7789_Task_PostCall(void (*fn)(void *arg), void *arg);
+esp_err_t ST7789_Task_Sync(TickType_t wait);
+
+#endif
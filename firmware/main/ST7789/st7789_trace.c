@@ -0,0 +1,401 @@
+/**
+ * @file    st7789_trace.c
+ * @brief   Runtime counters and draw call trace of the ST7789 driver
+ * @details The counters live in the state of each display and are updated
+ * 		by st7789.c as transactions are queued. Trace events are written by
+ * 		the task releasing the driver lock into a ring shared by the
+ * 		displays; the slot is claimed with an atomic increment, so two
+ * 		displays can record at once. A reader racing a writer may see a
+ * 		torn event, the trace is meant for a quiet moment after the run.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_console.h"
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_trace.h"
+#include "st7789_internal.h"
+
+static const uint16_t stats_frame_ms[ST7789_STATS_FRAME_BUCKETS - 1] = {8, 17, 33, 50, 100, 200, 500};
+
+static const char *const trace_names[ST7789_TRACE_CALLS] = {
+	[ST7789_TRACE_OTHER] = "other",
+	[ST7789_TRACE_FILL] = "fill",
+	[ST7789_TRACE_BLIT] = "blit",
+	[ST7789_TRACE_LINE] = "line",
+	[ST7789_TRACE_RECT] = "rect",
+	[ST7789_TRACE_CIRCLE] = "circle",
+	[ST7789_TRACE_FILLED_CIRCLE] = "filled_circle",
+	[ST7789_TRACE_TRIANGLE] = "triangle",
+	[ST7789_TRACE_FILLED_TRIANGLE] = "filled_triangle",
+	[ST7789_TRACE_TEXT] = "text",
+	[ST7789_TRACE_IMAGE] = "image",
+	[ST7789_TRACE_SPRITE] = "sprite",
+	[ST7789_TRACE_FLUSH] = "flush",
+	[ST7789_TRACE_SCROLL] = "scroll",
+	[ST7789_TRACE_ANIM] = "anim",
+	[ST7789_TRACE_BATCH] = "batch",
+};
+
+#if ST7789_TRACE_EVENTS
+static struct {
+	st7789_trace_event_t events[ST7789_TRACE_EVENTS];
+	uint32_t head;		// Events recorded since the last clear, the ring keeps the latest
+	uint8_t enabled;
+}st7789_trace;
+#endif
+
+/**
+ * @brief Start the event of a driver call, on the outermost lock
+ * @param ctx -> display taking the lock
+ * @return none
+ */
+void ST7789_Trace_Begin(st7789_ctx_t *ctx)
+{
+	ctx->trace_call = ST7789_TRACE_OTHER;
+#if ST7789_TRACE_EVENTS
+	ctx->trace_on = __atomic_load_n(&st7789_trace.enabled, __ATOMIC_RELAXED);
+	if (ctx->trace_on) {
+		ctx->trace_start = (uint32_t)ST7789_Port_Time();
+		ctx->trace_trans = ctx->trans_seq;
+		ctx->trace_bytes = ctx->stats.bytes;
+	}
+#endif
+}
+
+/**
+ * @brief Record the event of a driver call, on the outermost unlock
+ * @param ctx -> display releasing the lock
+ * @return none
+ */
+void ST7789_Trace_End(st7789_ctx_t *ctx)
+{
+#if ST7789_TRACE_EVENTS
+	st7789_trace_event_t *e;
+	uint32_t pos;
+
+	if (!ctx->trace_on)
+		return;
+	ctx->trace_on = 0;
+
+	pos = __atomic_fetch_add(&st7789_trace.head, 1, __ATOMIC_RELAXED);
+	e = &st7789_trace.events[pos % ST7789_TRACE_EVENTS];
+	e->ts_us = ctx->trace_start;
+	e->dur_us = (uint32_t)ST7789_Port_Time() - ctx->trace_start;
+	e->bytes = (uint32_t)(ctx->stats.bytes - ctx->trace_bytes);
+	e->transactions = ctx->trans_seq - ctx->trace_trans;
+	e->call = ctx->trace_call;
+	e->display = ctx->id;
+#endif
+}
+
+/**
+ * @brief Count a frame and its frame time
+ * @note  Called with the lock held.
+ * @return none
+ */
+void ST7789_Trace_Frame(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	int64_t now = ST7789_Port_Time();
+	int64_t ms = (now - ctx->frame_us) / 1000;
+	uint8_t i = 0;
+
+	ctx->stats.frames++;
+	if (ctx->frame_us && ms <= ST7789_STATS_IDLE_MS) {
+		while (i < ST7789_STATS_FRAME_BUCKETS - 1 && ms >= stats_frame_ms[i])
+			i++;
+		ctx->stats.frame_hist[i]++;
+	}
+	ctx->frame_us = now;
+}
+
+/**
+ * @brief Note the fill level of the display task ring
+ * @param depth -> commands in the ring, the batch being run included
+ * @return none
+ */
+void ST7789_Trace_QueueDepth(uint16_t depth)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ctx->stats.queue_depth = depth;
+	if (depth > ctx->stats.queue_depth_max)
+		ctx->stats.queue_depth_max = depth;
+}
+
+/**
+ * @brief Note the stack left to the display task
+ * @param free -> least free stack of the task so far, bytes
+ * @return none
+ */
+void ST7789_Trace_TaskStack(uint32_t free)
+{
+	ST7789_Ctx()->stats.task_stack_free = free;
+}
+
+/**
+ * @brief Read the counters of the display of the calling task
+ * @param stats -> filled with the counters
+ * @return none
+ */
+void ST7789_Stats_Get(st7789_stats_t *stats)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	*stats = ctx->stats;
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Zero the counters of the display of the calling task
+ * @return none
+ */
+void ST7789_Stats_Reset(void)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+
+	ST7789_Select();
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	ctx->frame_us = 0;
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Print the counters of the display of the calling task
+ * @param f -> output, e.g. stdout
+ * @return none
+ */
+void ST7789_Stats_Print(FILE *f)
+{
+	st7789_stats_t s;
+
+	ST7789_Stats_Get(&s);
+	fprintf(f, "transactions  %lu\n", (unsigned long)s.transactions);
+	fprintf(f, "bytes         %llu\n", (unsigned long long)s.bytes);
+	fprintf(f, "windows       %lu sent, %lu kept\n", (unsigned long)s.windows, (unsigned long)s.windows_kept);
+	fprintf(f, "queue wait    %llu us\n", (unsigned long long)s.queue_wait_us);
+	fprintf(f, "bus wait      %llu us\n", (unsigned long long)s.bus_wait_us);
+	fprintf(f, "task queue    %u, max %u\n", s.queue_depth, s.queue_depth_max);
+	if (s.task_stack_free)
+		fprintf(f, "task stack    %lu bytes free\n", (unsigned long)s.task_stack_free);
+	fprintf(f, "frames        %lu\n", (unsigned long)s.frames);
+	for (uint8_t i = 0; i < ST7789_STATS_FRAME_BUCKETS; i++) {
+		if (i < ST7789_STATS_FRAME_BUCKETS - 1)
+			fprintf(f, "  < %3u ms    %lu\n", stats_frame_ms[i], (unsigned long)s.frame_hist[i]);
+		else
+			fprintf(f, "  longer      %lu\n", (unsigned long)s.frame_hist[i]);
+	}
+}
+
+/**
+ * @brief Start or stop recording driver calls
+ * @note  Calls holding the lock when the trace changes are not recorded.
+ * @param enable -> 1 to record, 0 to stop
+ * @return none
+ */
+void ST7789_Trace_Enable(uint8_t enable)
+{
+#if ST7789_TRACE_EVENTS
+	__atomic_store_n(&st7789_trace.enabled, enable != 0, __ATOMIC_RELAXED);
+#else
+	(void)enable;
+#endif
+}
+
+/**
+ * @brief Drop the recorded events
+ * @return none
+ */
+void ST7789_Trace_Clear(void)
+{
+#if ST7789_TRACE_EVENTS
+	__atomic_store_n(&st7789_trace.head, 0, __ATOMIC_RELAXED);
+#endif
+}
+
+#if ST7789_TRACE_EVENTS
+/**
+ * @brief Latest recorded events, read in place in the ring
+ * @param first -> set to the count of the oldest one, see ST7789_Trace_At
+ * @return number of events
+ */
+static size_t ST7789_Trace_Span(uint32_t *first)
+{
+	uint32_t head = __atomic_load_n(&st7789_trace.head, __ATOMIC_RELAXED);
+	size_t n = head < ST7789_TRACE_EVENTS ? head : ST7789_TRACE_EVENTS;
+
+	*first = head - n;
+	return n;
+}
+
+/**
+ * @brief Copy of a recorded event
+ * @param pos -> count of the event, from ST7789_Trace_Span
+ * @return event
+ */
+static st7789_trace_event_t ST7789_Trace_At(uint32_t pos)
+{
+	return st7789_trace.events[pos % ST7789_TRACE_EVENTS];
+}
+#endif
+
+/**
+ * @brief Copy the latest recorded events, oldest first
+ * @param events -> filled with the events
+ * @param max -> size of events
+ * @return number of events copied
+ */
+size_t ST7789_Trace_Read(st7789_trace_event_t *events, size_t max)
+{
+#if ST7789_TRACE_EVENTS
+	uint32_t first;
+	size_t n = ST7789_Trace_Span(&first);
+
+	if (n > max) {
+		first += n - max;
+		n = max;
+	}
+	for (size_t i = 0; i < n; i++)
+		events[i] = ST7789_Trace_At(first + i);
+	return n;
+#else
+	(void)events;
+	(void)max;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Name of a traced call
+ * @param call -> st7789_trace_call_t
+ * @return name, "other" for unknown values
+ */
+const char *ST7789_Trace_CallName(uint8_t call)
+{
+	return call < ST7789_TRACE_CALLS ? trace_names[call] : trace_names[ST7789_TRACE_OTHER];
+}
+
+/**
+ * @brief Write the recorded events as Chrome trace JSON
+ * @note  Times start at the earliest event, displays are threads of one
+ *        process. Load the output in chrome://tracing or ui.perfetto.dev.
+ *        Events are recorded when they end, so the oldest one in the ring
+ *        is not always the first to start.
+ * @param f -> output
+ * @return none
+ */
+void ST7789_Trace_Export(FILE *f)
+{
+#if ST7789_TRACE_EVENTS
+	uint32_t first;
+	size_t n = ST7789_Trace_Span(&first);
+	uint32_t displays = 0;
+	uint32_t origin = n ? ST7789_Trace_At(first).ts_us : 0;
+
+	for (size_t i = 1; i < n; i++) {
+		uint32_t ts = ST7789_Trace_At(first + i).ts_us;
+
+		if ((int32_t)(ts - origin) < 0)
+			origin = ts;	// The clock wraps, compare the difference
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (size_t i = 0; i < n; i++) {
+		st7789_trace_event_t e = ST7789_Trace_At(first + i);
+
+		if (e.display < 32)
+			displays |= 1UL << e.display;
+		fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lu,\"dur\":%lu,"
+				"\"args\":{\"bytes\":%lu,\"trans\":%u}}",
+				i ? "," : "", ST7789_Trace_CallName(e.call), e.display,
+				(unsigned long)(e.ts_us - origin), (unsigned long)e.dur_us,
+				(unsigned long)e.bytes, e.transactions);
+	}
+	for (uint8_t d = 0; d < 32; d++) {
+		if (displays & (1UL << d)) {
+			fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+					"\"args\":{\"name\":\"display %u\"}}", d, d);
+		}
+	}
+	fprintf(f, "\n]}\n");
+#else
+	fprintf(f, "{\"traceEvents\":[]}\n");
+#endif
+}
+
+/**
+ * @brief Print the recorded events, one per line
+ * @param f -> output
+ * @return none
+ */
+static void ST7789_Trace_Dump(FILE *f)
+{
+#if ST7789_TRACE_EVENTS
+	uint32_t first;
+	size_t n = ST7789_Trace_Span(&first);
+
+	fprintf(f, "%10s %8s %4s %-16s %8s %6s\n", "start_us", "dur_us", "disp", "call", "bytes", "trans");
+	for (size_t i = 0; i < n; i++) {
+		st7789_trace_event_t e = ST7789_Trace_At(first + i);
+
+		fprintf(f, "%10lu %8lu %4u %-16s %8lu %6u\n", (unsigned long)e.ts_us, (unsigned long)e.dur_us,
+				e.display, ST7789_Trace_CallName(e.call), (unsigned long)e.bytes, e.transactions);
+	}
+#else
+	fprintf(f, "trace left out, ST7789_TRACE_EVENTS is 0\n");
+#endif
+}
+
+/**
+ * @brief Handler of the "st7789" console command
+ * @param argc -> number of arguments
+ * @param argv -> arguments, the command first
+ * @return 0 on success, 1 on a usage error
+ */
+static int ST7789_Trace_Command(int argc, char **argv)
+{
+	const char *sub = argc > 1 ? argv[1] : "stats";
+	const char *arg = argc > 2 ? argv[2] : "";
+
+	if (strcmp(sub, "stats") == 0) {
+		ST7789_Stats_Print(stdout);
+	} else if (strcmp(sub, "reset") == 0) {
+		ST7789_Stats_Reset();
+	} else if (strcmp(sub, "trace") == 0 && strcmp(arg, "on") == 0) {
+		ST7789_Trace_Enable(1);
+	} else if (strcmp(sub, "trace") == 0 && strcmp(arg, "off") == 0) {
+		ST7789_Trace_Enable(0);
+	} else if (strcmp(sub, "trace") == 0 && strcmp(arg, "clear") == 0) {
+		ST7789_Trace_Clear();
+	} else if (strcmp(sub, "trace") == 0 && strcmp(arg, "dump") == 0) {
+		ST7789_Trace_Dump(stdout);
+	} else if (strcmp(sub, "trace") == 0 && strcmp(arg, "json") == 0) {
+		ST7789_Trace_Export(stdout);
+	} else {
+		printf("usage: st7789 stats|reset|trace on|off|clear|dump|json\n");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Add the "st7789" command to esp_console
+ * @note  The console must be initialized. The counters are those of the
+ *        display of the console task.
+ * @return ESP_OK or an error of esp_console_cmd_register
+ */
+esp_err_t ST7789_Trace_RegisterConsole(void)
+{
+	const esp_console_cmd_t cmd = {
+		.command = "st7789",
+		.help = "Driver counters and draw call trace",
+		.hint = "stats|reset|trace on|off|clear|dump|json",
+		.func = ST7789_Trace_Command,
+	};
+
+	return esp_console_cmd_register(&cmd);
+}
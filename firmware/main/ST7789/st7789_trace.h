@@ -0,0 +1,105 @@
+/**
+ * @file    st7789_trace.h
+ * @brief   Runtime counters and draw call trace of the ST7789 driver.
+ * @note    The counters are always on and cost a few additions per
+ *     transaction, plus two clock reads whenever the driver waits. Each
+ *     display keeps its own.
+ *
+ *     The trace is off until ST7789_Trace_Enable. It records one event per
+ *     driver call: from taking the driver lock to releasing it, with the
+ *     bytes and transactions queued meanwhile. Calls made while the caller
+ *     holds the lock, a display task batch for one, are a single event named
+ *     after the first call. The ring of ST7789_TRACE_EVENTS events is shared
+ *     by the displays and keeps the latest ones.
+ *
+ *     ST7789_Trace_Export writes the ring as Chrome trace JSON, for
+ *     chrome://tracing or Perfetto, one track per display.
+ *     ST7789_Trace_RegisterConsole adds the "st7789" command to esp_console:
+ *
+ *         st7789 stats
+ *         st7789 reset
+ *         st7789 trace on|off|clear|dump|json
+ */
+
+#ifndef __ST7789_TRACE_H
+#define __ST7789_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "st7789.h"
+
+#define ST7789_STATS_FRAME_BUCKETS  8  // Buckets of the frame time histogram
+
+/**
+ * Draw calls named by the trace
+ */
+typedef enum {
+	ST7789_TRACE_OTHER = 0,		// Driver call without a name, e.g. setup
+	ST7789_TRACE_FILL,
+	ST7789_TRACE_BLIT,
+	ST7789_TRACE_LINE,
+	ST7789_TRACE_RECT,
+	ST7789_TRACE_CIRCLE,
+	ST7789_TRACE_FILLED_CIRCLE,
+	ST7789_TRACE_TRIANGLE,
+	ST7789_TRACE_FILLED_TRIANGLE,
+	ST7789_TRACE_TEXT,
+	ST7789_TRACE_IMAGE,			// Scaled, rotated or JPEG image
+	ST7789_TRACE_SPRITE,
+	ST7789_TRACE_FLUSH,
+	ST7789_TRACE_SCROLL,
+	ST7789_TRACE_ANIM,
+	ST7789_TRACE_BATCH,			// Display task batch
+	ST7789_TRACE_CALLS
+}st7789_trace_call_t;
+
+/**
+ * Counters of a display
+ * Frames are ST7789_Flush calls, animation frames and display task batches
+ * without a flush. The frame time is the time since the previous frame;
+ * bucket i of the histogram counts frame times under 8, 17, 33, 50, 100,
+ * 200 and 500 ms, the last bucket the longer ones. Gaps over
+ * ST7789_STATS_IDLE_MS are idle time and not counted.
+ */
+typedef struct {
+	uint32_t transactions;	// Transactions queued
+	uint64_t bytes;			// Bytes queued, commands and data
+	uint32_t windows;		// Address windows sent with CASET/RASET
+	uint32_t windows_kept;	// Address windows the window cache saved
+	uint64_t queue_wait_us;	// Time spent waiting for queued transactions
+	uint64_t bus_wait_us;	// Time spent waiting for the shared bus
+	uint16_t queue_depth;	// Commands in the display task ring at its last batch
+	uint16_t queue_depth_max;
+	uint32_t task_stack_free;	// Least free stack of the display task, bytes, 0 before a batch
+	uint32_t frames;
+	uint32_t frame_hist[ST7789_STATS_FRAME_BUCKETS];
+}st7789_stats_t;
+
+/**
+ * Trace event
+ */
+typedef struct {
+	uint32_t ts_us;			// Start, microseconds since boot, wrapping
+	uint32_t dur_us;		// Time the lock was held
+	uint32_t bytes;			// Bytes queued during the call
+	uint16_t transactions;	// Transactions queued during the call
+	uint8_t call;			// st7789_trace_call_t
+	uint8_t display;		// Display, in the order they were set up
+}st7789_trace_event_t;
+
+/* Counter functions. */
+void ST7789_Stats_Get(st7789_stats_t *stats);
+void ST7789_Stats_Reset(void);
+void ST7789_Stats_Print(FILE *f);
+
+/* Trace functions. */
+void ST7789_Trace_Enable(uint8_t enable);
+void ST7789_Trace_Clear(void);
+size_t ST7789_Trace_Read(st7789_trace_event_t *events, size_t max);
+const char *ST7789_Trace_CallName(uint8_t call);
+void ST7789_Trace_Export(FILE *f);
+esp_err_t ST7789_Trace_RegisterConsole(void);
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * @file    st7789_xform.c
+ * @brief   Scaled and rotated images for the ST7789 driver
+ * @details Every screen pixel is mapped back to the image with 16.16 fixed
+ * 		point steps, so the inner loops only add. Rows go straight into a RAM
+ * 		render target, or for the panel straight into the DMA buffers of the
+ * 		transactions. Scaled rows fill a transaction each time, rotated rows
+ * 		are sent as one span each, covering only the pixels inside the image.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_internal.h"
+
+#define XFORM_HALF	0x8000		// 0.5 in 16.16
+
+/**
+ * @brief Read an image pixel
+ * @return RGB565 color
+ */
+static inline uint16_t ST7789_Xform_Pixel(const uint8_t *data, uint16_t w, int32_t x, int32_t y)
+{
+	const uint8_t *p = data + ((size_t)y * w + x) * 2;
+
+	return (p[0] << 8) | p[1];
+}
+
+/**
+ * @brief Bilinear sample of an image
+ * @param u&v -> 16.16 position, pixel centers on integers, clamped to the image
+ * @return color in panel byte order
+ */
+static inline uint16_t ST7789_Xform_Bilinear(const uint8_t *data, uint16_t w, uint16_t h, int32_t u, int32_t v)
+{
+	int32_t umax = (int32_t)(w - 1) << 16, vmax = (int32_t)(h - 1) << 16;
+	int32_t x0, y0, x1, y1;
+	uint8_t fx, fy;
+	uint16_t top, bottom, px;
+
+	u = u < 0 ? 0 : (u > umax ? umax : u);
+	v = v < 0 ? 0 : (v > vmax ? vmax : v);
+	x0 = u >> 16;
+	y0 = v >> 16;
+	fx = (u >> 11) & 31;
+	fy = (v >> 11) & 31;
+	x1 = x0 + (fx != 0);
+	y1 = y0 + (fy != 0);
+
+	top = ST7789_Blend565(ST7789_Xform_Pixel(data, w, x1, y0), ST7789_Xform_Pixel(data, w, x0, y0), fx);
+	bottom = ST7789_Blend565(ST7789_Xform_Pixel(data, w, x1, y1), ST7789_Xform_Pixel(data, w, x0, y1), fx);
+	px = ST7789_Blend565(bottom, top, fy);
+	return (px >> 8) | (px << 8);
+}
+
+/**
+ * @brief Sample one output row
+ * @param out -> row, panel byte order
+ * @param n -> pixels to sample
+ * @param u&v -> 16.16 image position of the first pixel
+ * @param du&dv -> 16.16 steps between two pixels
+ * @return none
+ */
+static void ST7789_Xform_Row(uint16_t *out, uint16_t n, const uint8_t *data, uint16_t w, uint16_t h,
+		int32_t u, int32_t v, int32_t du, int32_t dv, st7789_filter_t filter)
+{
+	if (filter == ST7789_FILTER_BILINEAR) {
+		u -= XFORM_HALF;
+		v -= XFORM_HALF;
+		while (n--) {
+			*out++ = ST7789_Xform_Bilinear(data, w, h, u, v);
+			u += du;
+			v += dv;
+		}
+		return;
+	}
+
+	if (dv == 0) {
+		/* Scaling, the row of the image does not change */
+		const uint8_t *row = data + (size_t)(v >> 16) * w * 2;
+		while (n--) {
+			const uint8_t *p = row + (u >> 16) * 2;
+			*out++ = p[0] | (p[1] << 8);
+			u += du;
+		}
+		return;
+	}
+	while (n--) {
+		const uint8_t *p = data + ((size_t)(v >> 16) * w + (u >> 16)) * 2;
+		*out++ = p[0] | (p[1] << 8);
+		u += du;
+		v += dv;
+	}
+}
+
+/**
+ * @brief Draw an image scaled to another size
+ * @note  The part outside the render target is clipped and not sampled.
+ * @param x&y -> top left corner on screen
+ * @param w&h -> size of the image
+ * @param data -> RGB565 pixels, panel byte order
+ * @param dw&dh -> size on screen
+ * @param filter -> ST7789_FILTER_NEAREST or ST7789_FILTER_BILINEAR
+ * @return none
+ */
+void ST7789_DrawImageScaled(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data, uint16_t dw, uint16_t dh, st7789_filter_t filter)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	uint16_t *buf = NULL;
+	uint16_t vw, rows = 1, n = 0;
+	int32_t du, dv, u, v;
+
+	if (!w || !h || !dw || !dh)
+		return;
+	/* Hold the driver until the last chunk, they share one window */
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_IMAGE);
+	s = ctx->target;
+	st7789_rect_t vis = {x, y, x + dw - 1, y + dh - 1};
+	if (!ST7789_ClipToTarget(&vis)) {
+		ST7789_UnSelect();
+		return;
+	}
+	vw = vis.x1 - vis.x0 + 1;
+
+	/* Image position of the center of the first visible pixel */
+	du = ((int32_t)w << 16) / dw;
+	dv = ((int32_t)h << 16) / dh;
+	u = (int32_t)((int64_t)(vis.x0 - x) * du + du / 2);
+	v = (int32_t)((int64_t)(vis.y0 - y) * dv + dv / 2);
+
+	if (s == NULL) {
+		/* A row is at most the panel width, well within a transaction */
+		rows = ST7789_DMA_BUF_SIZE / (vw * 2);
+		/* One window for the visible part, each chunk continues in it */
+		ST7789_SetAddressWindow(vis.x0, vis.y0, vis.x1, vis.y1);
+	}
+
+	for (int16_t row = vis.y0; row <= vis.y1; row++, v += dv) {
+		if (s) {
+			uint16_t *out = s->buf + (size_t)(row - s->y) * s->stride + (vis.x0 - s->x);
+			ST7789_Xform_Row(out, vw, data, w, h, u, v, du, 0, filter);
+			continue;
+		}
+		if (n == 0)
+			buf = ST7789_PixelBuf();
+		ST7789_Xform_Row(buf + (size_t)n * vw, vw, data, w, h, u, v, du, 0, filter);
+		if (++n == rows || row == vis.y1) {
+			ST7789_QueuePixels((uint32_t)n * vw);
+			n = 0;
+		}
+	}
+
+	if (s == &ctx->fb)
+		ST7789_FB_MarkDirty(vis.x0, vis.y0, vis.x1, vis.y1);
+	ST7789_UnSelect();
+}
+
+/**
+ * @brief Floor of n / d, for d > 0
+ */
+static int64_t ST7789_Xform_FloorDiv(int64_t n, int64_t d)
+{
+	return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+/**
+ * @brief Narrow [*t0, *t1] to the steps t where lo <= a + t * d <= hi
+ * @return none
+ */
+static void ST7789_Xform_Span(int32_t a, int32_t d, int32_t lo, int32_t hi, int32_t *t0, int32_t *t1)
+{
+	int64_t first, last;
+
+	if (d == 0) {
+		if (a < lo || a > hi)
+			*t1 = *t0 - 1;
+		return;
+	}
+	if (d > 0) {
+		first = -ST7789_Xform_FloorDiv((int64_t)a - lo, d);
+		last = ST7789_Xform_FloorDiv((int64_t)hi - a, d);
+	} else {
+		first = -ST7789_Xform_FloorDiv((int64_t)hi - a, -d);
+		last = ST7789_Xform_FloorDiv((int64_t)a - lo, -d);
+	}
+	if (first > *t0)
+		*t0 = first;
+	if (last < *t1)
+		*t1 = last;
+}
+
+/**
+ * @brief Draw an image rotated and scaled around a pivot
+ * @note  Only the pixels covered by the image are drawn, one span per row.
+ *        The part outside the render target is clipped and not sampled.
+ * @param x&y -> screen position of the pivot
+ * @param w&h -> size of the image
+ * @param data -> RGB565 pixels, panel byte order
+ * @param px&py -> pivot in the image, (0, 0) is the top left corner of the
+ *        first pixel, (w / 2, h / 2) the center of the image
+ * @param angle -> clockwise rotation, tenths of a degree
+ * @param scale -> size on screen, 256 for the size of the image
+ * @param filter -> ST7789_FILTER_NEAREST or ST7789_FILTER_BILINEAR
+ * @return none
+ */
+void ST7789_DrawImageRotated(int16_t x, int16_t y, uint16_t w, uint16_t h, const uint8_t *data, int16_t px, int16_t py, int16_t angle, uint16_t scale, st7789_filter_t filter)
+{
+	st7789_ctx_t *ctx = ST7789_Ctx();
+	st7789_surface_t *s;
+	float a = angle * (float)M_PI / 1800.0f;
+	float c = cosf(a), sn = sinf(a), k = scale / 256.0f;
+	float minx = INFINITY, miny = INFINITY, maxx = -INFINITY, maxy = -INFINITY;
+	int32_t dudx, dvdx, u, v, umax, vmax;
+	st7789_rect_t drawn = {INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN};
+
+	if (!w || !h || !scale)
+		return;
+
+	/* Screen box of the image corners */
+	for (uint8_t i = 0; i < 4; i++) {
+		float cu = (i & 1 ? w : 0) - px, cv = (i & 2 ? h : 0) - py;
+		float sx = x + (c * cu - sn * cv) * k, sy = y + (sn * cu + c * cv) * k;
+		minx = fminf(minx, sx);
+		maxx = fmaxf(maxx, sx);
+		miny = fminf(miny, sy);
+		maxy = fmaxf(maxy, sy);
+	}
+	st7789_rect_t vis = {
+		fmaxf(floorf(minx), INT16_MIN), fmaxf(floorf(miny), INT16_MIN),
+		fminf(ceilf(maxx), INT16_MAX), fminf(ceilf(maxy), INT16_MAX)
+	};
+	ST7789_Select();
+	ST7789_Trace_Call(ST7789_TRACE_IMAGE);
+	s = ctx->target;
+	if (!ST7789_ClipToTarget(&vis)) {
+		ST7789_UnSelect();
+		return;
+	}
+
+	/* Image steps of one screen pixel, a row down is the x step turned a quarter */
+	dudx = lroundf(c / k * 65536);
+	dvdx = lroundf(-sn / k * 65536);
+
+	/* Image position of the center of the top left pixel of the box */
+	float fx = vis.x0 + 0.5f - x, fy = vis.y0 + 0.5f - y;
+	u = lroundf((px + (c * fx + sn * fy) / k) * 65536);
+	v = lroundf((py + (c * fy - sn * fx) / k) * 65536);
+	umax = ((int32_t)w << 16) - 1;
+	vmax = ((int32_t)h << 16) - 1;
+
+	for (int16_t row = vis.y0; row <= vis.y1; row++, u -= dvdx, v += dudx) {
+		int32_t t0 = 0, t1 = vis.x1 - vis.x0;
+
+		ST7789_Xform_Span(u, dudx, 0, umax, &t0, &t1);
+		ST7789_Xform_Span(v, dvdx, 0, vmax, &t0, &t1);
+		if (t0 > t1)
+			continue;
+
+		uint16_t n = t1 - t0 + 1;
+		int32_t su = u + t0 * dudx, sv = v + t0 * dvdx;
+		if (s) {
+			uint16_t *out = s->buf + (size_t)(row - s->y) * s->stride + (vis.x0 + t0 - s->x);
+			ST7789_Xform_Row(out, n, data, w, h, su, sv, dudx, dvdx, filter);
+			if (vis.x0 + t0 < drawn.x0)
+				drawn.x0 = vis.x0 + t0;
+			if (vis.x0 + t1 > drawn.x1)
+				drawn.x1 = vis.x0 + t1;
+			if (row < drawn.y0)
+				drawn.y0 = row;
+			drawn.y1 = row;
+		} else {
+			ST7789_SetAddressWindow(vis.x0 + t0, row, vis.x0 + t1, row);
+			ST7789_Xform_Row(ST7789_PixelBuf(), n, data, w, h, su, sv, dudx, dvdx, filter);
+			ST7789_QueuePixels(n);
+		}
+	}
+
+	if (s == &ctx->fb && drawn.x0 <= drawn.x1)
+		ST7789_FB_MarkDirty(drawn.x0, drawn.y0, drawn.x1, drawn.y1);
+	ST7789_UnSelect();
+}
@@ -7,14 +7,15 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
 #include "esp_log.h"
 #include "sdkconfig.h"
 
 #include "globals.h"
 #include "ST7789/st7789.h"
+#include "ST7789/st7789_bench.h"
 
 /* PRIVATE DEFINES */
 #define TAG "Main"
@@ -29,7 +30,13 @@ void app_main(void)
     // init_spiffs();
 
     ST7789_Init(240,240,ROT_PORTRAIT_180);
-    ST7789_Test();
+
+    st7789_bench_result_t bench[16];
+    ST7789_Bench_Print(bench, ST7789_Bench_Run(bench, sizeof(bench) / sizeof(bench[0])));
+#if CONFIG_IDF_TARGET_LINUX
+    /* Host build, the results are all there is to it */
+    exit(0);
+#endif
 
     while (1)
     {
@@ -0,0 +1,366 @@
+/**
+ * @file    host_idf.c
+ * @brief   The ESP-IDF and FreeRTOS calls of the driver, on POSIX threads
+ * @details Enough to run the driver with the emulated panels of
+ * 		st7789_port_emu.c in a host process: a task is a detached thread with
+ * 		a notification count and its thread local pointers, the thread that
+ * 		calls the driver first becomes a task the same way. Priorities, cores
+ * 		and stack sizes are ignored. There are no partitions and no console.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * Task, a thread
+ */
+struct host_task {
+	pthread_mutex_t lock;
+	pthread_cond_t notified;
+	uint32_t notify;		// Notifications given and not taken yet
+	TaskFunction_t fn;
+	void *arg;
+	BaseType_t core;
+	void *tls[CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS];
+};
+
+/**
+ * Mutex, recursive or not
+ */
+struct host_mutex {
+	pthread_mutex_t m;
+};
+
+_Static_assert(sizeof(StaticSemaphore_t) >= sizeof(struct host_mutex), "StaticSemaphore_t too small");
+
+static __thread struct host_task *host_current;
+
+/**
+ * @brief Absolute time a wait of some ticks ends
+ * @param ticks -> ticks to wait
+ * @param ts -> end of the wait, CLOCK_REALTIME
+ * @return none
+ */
+static void host_Deadline(TickType_t ticks, struct timespec *ts)
+{
+	uint64_t ns = (uint64_t)pdTICKS_TO_MS(ticks) * 1000000;
+
+	clock_gettime(CLOCK_REALTIME, ts);
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+static struct host_task *host_NewTask(void)
+{
+	struct host_task *t = calloc(1, sizeof(*t));
+
+	if (t == NULL)
+		abort();
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->notified, NULL);
+	return t;
+}
+
+static void *host_TaskEntry(void *arg)
+{
+	struct host_task *t = arg;
+
+	host_current = t;
+	t->fn(t->arg);
+	return NULL;
+}
+
+/* Tasks */
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	if (host_current == NULL)
+		host_current = host_NewTask();
+	return host_current;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t prio, TaskHandle_t *task, BaseType_t core)
+{
+	struct host_task *t = host_NewTask();
+	pthread_t th;
+
+	(void)name;
+	(void)stack;
+	(void)prio;
+	t->fn = fn;
+	t->arg = arg;
+	t->core = core;
+	if (task)
+		*task = t;
+	if (pthread_create(&th, NULL, host_TaskEntry, t) != 0) {
+		free(t);
+		return pdFAIL;
+	}
+	pthread_detach(th);
+	return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t prio, TaskHandle_t *task)
+{
+	return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, task, 0);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	/* Only a task ending itself is supported, its handle is gone as on FreeRTOS */
+	if (task == NULL || task == host_current) {
+		struct host_task *t = host_current;
+
+		host_current = NULL;
+		pthread_cond_destroy(&t->notified);
+		pthread_mutex_destroy(&t->lock);
+		free(t);
+		pthread_exit(NULL);
+	}
+	abort();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TickType_t)((uint64_t)ts.tv_sec * configTICK_RATE_HZ + ts.tv_nsec / (1000000000 / configTICK_RATE_HZ));
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	usleep((useconds_t)pdTICKS_TO_MS(ticks) * 1000);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev, TickType_t increment)
+{
+	TickType_t wake = *prev + increment;
+	TickType_t now = xTaskGetTickCount();
+
+	*prev = wake;
+	if ((int32_t)(wake - now) <= 0)
+		return pdFALSE;
+	vTaskDelay(wake - now);
+	return pdTRUE;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+	(void)task;
+	return 1;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+	/* Threads have the stack of the host, not measured */
+	(void)task;
+	return 0;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+	return host_current ? host_current->core : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+	struct host_task *t = xTaskGetCurrentTaskHandle();
+	struct timespec end;
+	uint32_t n;
+
+	host_Deadline(wait, &end);
+	pthread_mutex_lock(&t->lock);
+	while (t->notify == 0) {
+		if (wait == portMAX_DELAY)
+			pthread_cond_wait(&t->notified, &t->lock);
+		else if (wait == 0 || pthread_cond_timedwait(&t->notified, &t->lock, &end) == ETIMEDOUT)
+			break;
+	}
+	n = t->notify;
+	if (n)
+		t->notify = clear ? 0 : n - 1;
+	pthread_mutex_unlock(&t->lock);
+	return n;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	pthread_mutex_lock(&task->lock);
+	task->notify++;
+	pthread_cond_signal(&task->notified);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+}
+
+void *pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index)
+{
+	if (task == NULL)
+		task = xTaskGetCurrentTaskHandle();
+	return task->tls[index];
+}
+
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index, void *value)
+{
+	if (task == NULL)
+		task = xTaskGetCurrentTaskHandle();
+	task->tls[index] = value;
+}
+
+/* Mutexes */
+
+static SemaphoreHandle_t host_MutexInit(struct host_mutex *sem, int type)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, type);
+	pthread_mutex_init(&sem->m, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	struct host_mutex *sem = malloc(sizeof(*sem));
+
+	return sem ? host_MutexInit(sem, PTHREAD_MUTEX_NORMAL) : NULL;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buf)
+{
+	return host_MutexInit((struct host_mutex *)buf, PTHREAD_MUTEX_RECURSIVE);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+	/* Static and allocated mutexes are not told apart, the memory is kept */
+	pthread_mutex_destroy(&sem->m);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+	struct timespec end;
+
+	if (wait == portMAX_DELAY)
+		return pthread_mutex_lock(&sem->m) == 0;
+	host_Deadline(wait, &end);
+	return pthread_mutex_timedlock(&sem->m, &end) == 0;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	return pthread_mutex_unlock(&sem->m) == 0;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait)
+{
+	return xSemaphoreTake(sem, wait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+	return xSemaphoreGive(sem);
+}
+
+/* Heap */
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+	(void)caps;
+	return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+	(void)caps;
+	return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+	free(ptr);
+}
+
+/* Errors */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+	switch (code) {
+	case ESP_OK:					return "ESP_OK";
+	case ESP_FAIL:					return "ESP_FAIL";
+	case ESP_ERR_NO_MEM:			return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG:		return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE:		return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE:		return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND:			return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_NOT_SUPPORTED:		return "ESP_ERR_NOT_SUPPORTED";
+	case ESP_ERR_TIMEOUT:			return "ESP_ERR_TIMEOUT";
+	case ESP_ERR_INVALID_VERSION:	return "ESP_ERR_INVALID_VERSION";
+	default:						return "UNKNOWN ERROR";
+	}
+}
+
+void esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *expr)
+{
+	fprintf(stderr, "ESP_ERROR_CHECK failed: %s (0x%x) at %s:%d\n%s\n", esp_err_to_name(rc), rc, file, line, expr);
+	abort();
+}
+
+/* Partitions and console */
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+	(void)type;
+	(void)subtype;
+	(void)label;
+	return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+	(void)part;
+	(void)offset;
+	(void)dst;
+	(void)size;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *part, size_t offset, size_t size,
+		esp_partition_mmap_memory_t memory, const void **out_ptr, esp_partition_mmap_handle_t *out_handle)
+{
+	(void)part;
+	(void)offset;
+	(void)size;
+	(void)memory;
+	(void)out_ptr;
+	(void)out_handle;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+	(void)handle;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+	(void)cmd;
+	return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file    esp_heap_caps.h
+ * @brief   Heap of ESP-IDF on the C library, capabilities are ignored
+ */
+
+#ifndef __ESP_HEAP_CAPS_H
+#define __ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA  (1 << 3)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+
+#endif
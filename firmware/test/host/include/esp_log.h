@@ -0,0 +1,16 @@
+/**
+ * @file    esp_log.h
+ * @brief   Logging of ESP-IDF on stderr, debug messages are dropped
+ */
+
+#ifndef __ESP_LOG_H
+#define __ESP_LOG_H
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { if (0) fprintf(stderr, format, ##__VA_ARGS__); (void)(tag); } while (0)
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file    FreeRTOS.h
+ * @brief   FreeRTOS types of the host build, see host_idf.c
+ */
+
+#ifndef __FREERTOS_H
+#define __FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  0
+#define pdPASS  1
+
+#define configTICK_RATE_HZ  CONFIG_FREERTOS_HZ
+#define portMAX_DELAY       ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS  ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+#define pdTICKS_TO_MS(t)    ((TickType_t)((uint64_t)(t) * 1000 / configTICK_RATE_HZ))
+
+BaseType_t xPortGetCoreID(void);
+
+#endif
@@ -0,0 +1,14 @@
+/**
+ * @file    sdkconfig.h
+ * @brief   Configuration of the host build, as sdkconfig.defaults.linux and
+ *          the defaults of the linux target
+ */
+
+#ifndef __SDKCONFIG_H
+#define __SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS 2
+
+#endif
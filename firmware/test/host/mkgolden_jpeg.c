@@ -0,0 +1,176 @@
+/**
+ * @file    mkgolden_jpeg.c
+ * @brief   Generate the JPEG golden files of test_jpeg with libjpeg
+ * @details Each case is a synthetic picture, smooth gradients for the DC
+ * 		path, hard edges and noise for long AC codes, encoded by libjpeg
+ * 		with the sampling and restart interval of the case. The reference
+ * 		is the same file decoded by libjpeg with the ISLOW IDCT and plain
+ * 		upsampling, then reduced to RGB565 in panel byte order like
+ * 		ST7789_Jpeg_DecodeRow does.
+ *
+ * 		    mkgolden_jpeg data/jpeg
+ *
+ * 		Only needed to change the golden files, the test itself does not
+ * 		depend on libjpeg.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <jpeglib.h>
+
+typedef struct {
+	const char *name;
+	int width;
+	int height;
+	int gray;
+	int h, v;			// Luma sampling factors, chroma is 1x1
+	int restart;		// MCUs between restart markers, 0 for none
+	int quality;
+}golden_case_t;
+
+static const golden_case_t golden_cases[] = {
+	{"gray",    61, 47, 1, 1, 1, 0, 85},
+	{"yuv444",  61, 47, 0, 1, 1, 0, 85},
+	{"yuv422",  61, 47, 0, 2, 1, 0, 85},
+	{"yuv420",  61, 47, 0, 2, 2, 0, 85},
+	{"restart", 77, 53, 0, 2, 2, 3, 95},
+};
+
+static uint32_t golden_seed = 0x5EED;
+
+static uint8_t golden_Rand(void)
+{
+	golden_seed = golden_seed * 1103515245 + 12345;
+	return golden_seed >> 24;
+}
+
+/**
+ * @brief Synthetic RGB picture
+ * @return pixels, 3 bytes each
+ */
+static uint8_t *golden_Picture(int w, int h)
+{
+	uint8_t *rgb = malloc((size_t)w * h * 3);
+
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			uint8_t *p = rgb + ((size_t)y * w + x) * 3;
+			int dx = x - w / 2, dy = y - h / 2;
+
+			p[0] = x * 255 / (w - 1);
+			p[1] = y * 255 / (h - 1);
+			p[2] = (x + y) * 4;
+			if (dx * dx + dy * dy < (h / 4) * (h / 4)) {
+				p[0] = 255 - p[0];		// Disc with a hard edge
+				p[2] = 40;
+			}
+			if (x > w * 3 / 4 && y < h / 3) {
+				uint8_t n = golden_Rand();	// Noise block, large AC coefficients
+				p[0] = p[1] = p[2] = n;
+			}
+			if ((x / 4 + y / 4) % 2 && y > h * 3 / 4)
+				p[0] = p[1] = p[2] = 0;	// Checkerboard along the bottom
+		}
+	}
+	return rgb;
+}
+
+static int golden_Encode(const golden_case_t *c, const char *path)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	uint8_t *rgb = golden_Picture(c->width, c->height);
+	uint8_t *gray = malloc((size_t)c->width * c->height);
+	FILE *f = fopen(path, "wb");
+
+	if (f == NULL)
+		return -1;
+	for (int i = 0; i < c->width * c->height; i++)
+		gray[i] = (rgb[i * 3] * 77 + rgb[i * 3 + 1] * 150 + rgb[i * 3 + 2] * 29) >> 8;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, f);
+	cinfo.image_width = c->width;
+	cinfo.image_height = c->height;
+	cinfo.input_components = c->gray ? 1 : 3;
+	cinfo.in_color_space = c->gray ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, c->quality, TRUE);
+	if (!c->gray) {
+		cinfo.comp_info[0].h_samp_factor = c->h;
+		cinfo.comp_info[0].v_samp_factor = c->v;
+	}
+	cinfo.restart_interval = c->restart;
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = c->gray ? gray + cinfo.next_scanline * c->width
+				: rgb + cinfo.next_scanline * c->width * 3;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	fclose(f);
+	free(gray);
+	free(rgb);
+	return 0;
+}
+
+static int golden_Decode(const char *jpg, const char *path)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	FILE *in = fopen(jpg, "rb");
+	FILE *out = fopen(path, "wb");
+	uint8_t *row;
+
+	if (in == NULL || out == NULL)
+		return -1;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, in);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.out_color_space = JCS_RGB;
+	cinfo.dct_method = JDCT_ISLOW;
+	cinfo.do_fancy_upsampling = FALSE;
+	jpeg_start_decompress(&cinfo);
+	row = malloc(cinfo.output_width * 3);
+	while (cinfo.output_scanline < cinfo.output_height) {
+		jpeg_read_scanlines(&cinfo, &row, 1);
+		for (JDIMENSION x = 0; x < cinfo.output_width; x++) {
+			const uint8_t *p = row + x * 3;
+			uint16_t px = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+			uint8_t be[2] = {px >> 8, px & 0xFF};
+			fwrite(be, 1, 2, out);
+		}
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	free(row);
+	fclose(in);
+	fclose(out);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char jpg[512], ref[512];
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <output dir>\n", argv[0]);
+		return 2;
+	}
+	for (size_t i = 0; i < sizeof(golden_cases) / sizeof(golden_cases[0]); i++) {
+		const golden_case_t *c = &golden_cases[i];
+
+		snprintf(jpg, sizeof(jpg), "%s/%s.jpg", argv[1], c->name);
+		snprintf(ref, sizeof(ref), "%s/%s.rgb565", argv[1], c->name);
+		if (golden_Encode(c, jpg) != 0 || golden_Decode(jpg, ref) != 0) {
+			fprintf(stderr, "%s: cannot write\n", c->name);
+			return 1;
+		}
+		printf("%s %dx%d\n", c->name, c->width, c->height);
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file    test_band.c
+ * @brief   Band renders continue in one address window
+ * @details A display list is rendered with ST7789_Band_Render, on the whole
+ * 		screen and on an area, in each rotation. The strips after the first
+ * 		must continue in the window of the first: at most one CASET, one
+ * 		RASET and one RAMWR per render, whatever the number of strips. The
+ * 		screen must match the same list drawn straight to the panel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_dl.h"
+#include "st7789_emu.h"
+
+#define EMU_SHORT  240  // Panel width in portrait, the height of st7789_config_t
+#define EMU_LONG   320
+
+static const char *rot_name[4] = {"portrait", "landscape", "portrait_180", "landscape_180"};
+
+static uint16_t shot[EMU_SHORT * EMU_LONG];
+
+/**
+ * @brief Read the screen
+ * @param out -> w * h pixels
+ * @param w&h -> size of the screen
+ * @return none
+ */
+static void test_Grab(uint16_t *out, uint16_t w, uint16_t h)
+{
+	ST7789_WaitIdle();
+	for (uint16_t y = 0; y < h; y++)
+		for (uint16_t x = 0; x < w; x++)
+			out[y * w + x] = ST7789_Emu_GetScreenPixel(x, y);
+}
+
+/**
+ * @brief Render a list with the band renderer and check its traffic and pixels
+ * @param what -> pass, for the report
+ * @param dl -> display list
+ * @param area -> area to render, the whole screen for NULL
+ * @param w&h -> size of the screen
+ * @return checks that failed
+ */
+static uint32_t test_Render(const char *what, const st7789_dl_t *dl, const st7789_rect_t *area, uint16_t w, uint16_t h)
+{
+	st7789_rect_t a = area ? *area : (st7789_rect_t){0, 0, w - 1, h - 1};
+	uint32_t size = (uint32_t)(a.x1 - a.x0 + 1) * (a.y1 - a.y0 + 1);
+	st7789_emu_stats_t st;
+	uint32_t bad = 0;
+
+	/* Expected: the list drawn straight, only inside the area */
+	ST7789_Fill_Color(DARKBLUE);
+	ST7789_Fill(a.x0, a.y0, a.x1, a.y1, BLACK);
+	for (uint16_t i = 0; i < dl->count; i++)
+		ST7789_DL_Exec(&dl->ops[i]);
+	test_Grab(shot, w, h);
+	for (uint16_t y = 0; y < h; y++)
+		for (uint16_t x = 0; x < w; x++)
+			if (x < a.x0 || x > a.x1 || y < a.y0 || y > a.y1)
+				shot[y * w + x] = DARKBLUE;
+
+	ST7789_Fill_Color(DARKBLUE);
+	ST7789_WaitIdle();
+	ST7789_Emu_ResetStats();
+	ST7789_Band_Render(dl, area, BLACK);
+	ST7789_WaitIdle();
+	ST7789_Emu_GetStats(&st);
+
+	for (uint16_t y = 0; y < h; y++) {
+		for (uint16_t x = 0; x < w; x++) {
+			uint16_t got = ST7789_Emu_GetScreenPixel(x, y);
+
+			if (got != shot[y * w + x] && bad++ == 0)
+				printf("  %s: first difference at %u,%u: %04x, want %04x\n", what, x, y, got, shot[y * w + x]);
+		}
+	}
+	/* At most CASET, RASET and RAMWR, the window may still be the one of the fill */
+	if (st.windows > 2 || st.commands > 3 || st.pixels != size) {
+		printf("  %s: %lu windows, %lu commands, %lu pixels for %lu\n", what, (unsigned long)st.windows,
+				(unsigned long)st.commands, (unsigned long)st.pixels, (unsigned long)size);
+		bad++;
+	}
+	printf("  %-24s %lu transactions, %lu bytes\n", what, (unsigned long)st.transactions, (unsigned long)st.bytes);
+	return bad;
+}
+
+int main(void)
+{
+	st7789_dl_op_t ops[8];
+	st7789_dl_t dl;
+	uint32_t bad = 0;
+
+	for (uint8_t rot = 0; rot < 4; rot++) {
+		const st7789_config_t cfg = {
+			.cs_pin = -1, .dc_pin = -1, .rst_pin = -1, .bl_pin = -1,
+			.height = EMU_SHORT, .width = EMU_LONG, .rotation = rot,
+		};
+		uint16_t w = rot & 1 ? EMU_LONG : EMU_SHORT;
+		uint16_t h = rot & 1 ? EMU_SHORT : EMU_LONG;
+		st7789_rect_t area = {30, 45, w - 41, 150};
+		st7789_handle_t disp;
+		char what[40];
+
+		if (ST7789_Display_Add(&cfg, &disp) != ESP_OK) {
+			printf("%s: ST7789_Display_Add failed\n", rot_name[rot]);
+			return 1;
+		}
+		ST7789_Display_Use(disp);
+		if (ST7789_Band_Init() != ESP_OK) {
+			printf("%s: ST7789_Band_Init failed\n", rot_name[rot]);
+			return 1;
+		}
+
+		ST7789_DL_Init(&dl, ops, 8);
+		ST7789_DL_FilledCircle(&dl, w / 2, h / 2, 70, BLUE);
+		ST7789_DL_FilledTriangle(&dl, 10, 20, w - 5, 60, 40, h - 10, RED);
+		ST7789_DL_Line(&dl, 0, h - 1, w - 1, 0, WHITE);
+		ST7789_DL_Circle(&dl, 40, 120, 35, YELLOW);
+		ST7789_DL_String(&dl, 20, 50, "12:34", &Font_16x26, WHITE, BLUE);
+
+		printf("%s\n", rot_name[rot]);
+		snprintf(what, sizeof(what), "%s screen", rot_name[rot]);
+		bad += test_Render(what, &dl, NULL, w, h);
+		snprintf(what, sizeof(what), "%s area", rot_name[rot]);
+		bad += test_Render(what, &dl, &area, w, h);
+
+		ST7789_Band_Deinit();
+	}
+	ST7789_Display_Use(NULL);
+	return bad != 0;
+}
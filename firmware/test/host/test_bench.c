@@ -0,0 +1,160 @@
+/**
+ * @file    test_bench.c
+ * @brief   Regression check of the benchmark on the emulated panel
+ * @details Runs ST7789_Bench_Run on a 240x240 panel, the one of main.c, and
+ * 		compares each workload with the committed baseline, the output of
+ * 		ST7789_Bench_Print. Transactions and bytes only depend on the code, a
+ * 		workload fails when either grows by more than BENCH_TOLERANCE
+ * 		percent. Shrinking is reported, the baseline should then be written
+ * 		again. Host times are too noisy to fail on by default; they are
+ * 		printed against the baseline and only checked when a tolerance is
+ * 		given.
+ *
+ * 		    test_bench data/bench/baseline.json
+ * 		    test_bench --time 50 data/bench/baseline.json
+ * 		    test_bench --write data/bench/baseline.json    (new baseline)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_bench.h"
+
+#define BENCH_TOLERANCE  2   // Growth of transactions and bytes allowed, percent
+#define BENCH_MAX        32  // Workloads, at most
+
+/**
+ * Baseline of a workload
+ */
+typedef struct {
+	char name[32];
+	unsigned long count;
+	long long time_us;
+	unsigned long transactions;
+	unsigned long bytes;
+}bench_base_t;
+
+/**
+ * @brief Read the baseline, one ST7789_Bench_Print line per workload
+ * @param path -> baseline file
+ * @param base -> workloads read
+ * @param max -> room in base
+ * @return workloads read, -1 when the file cannot be read
+ */
+static int bench_Load(const char *path, bench_base_t *base, int max)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+	int n = 0;
+
+	if (f == NULL)
+		return -1;
+	while (n < max && fgets(line, sizeof(line), f)) {
+		bench_base_t *b = &base[n];
+		unsigned long cycles;
+
+		if (sscanf(line, "{\"bench\":\"%31[^\"]\",\"n\":%lu,\"us\":%lld,\"cycles\":%lu,\"trans\":%lu,\"bytes\":%lu}",
+				b->name, &b->count, &b->time_us, &cycles, &b->transactions, &b->bytes) == 6)
+			n++;
+	}
+	fclose(f);
+	return n;
+}
+
+/**
+ * @brief Check a counter against its baseline
+ * @param what -> workload, for the report
+ * @param counter -> counter, for the report
+ * @param got -> measured
+ * @param base -> baseline
+ * @param tolerance -> growth allowed, percent
+ * @return 1 when the counter grew past the tolerance, otherwise 0
+ */
+static int bench_Check(const char *what, const char *counter, double got, double base, unsigned tolerance)
+{
+	if (got > base * (100 + tolerance) / 100) {
+		printf("  %s: %s %.0f, baseline %.0f (+%.1f%%)\n", what, counter, got, base, (got - base) * 100 / base);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const st7789_config_t cfg = {
+		.cs_pin = -1, .dc_pin = -1, .rst_pin = -1, .bl_pin = -1,
+		.height = 240, .width = 240, .rotation = ROT_PORTRAIT_180,
+	};
+	st7789_bench_result_t results[BENCH_MAX];
+	bench_base_t base[BENCH_MAX];
+	st7789_handle_t disp;
+	const char *path = argv[argc - 1];
+	int write = argc == 3 && strcmp(argv[1], "--write") == 0;
+	int time_check = argc == 4 && strcmp(argv[1], "--time") == 0;
+	unsigned time_tolerance = time_check ? (unsigned)atoi(argv[2]) : 0;
+	int failed = 0;
+	int nbase = 0;
+	size_t n;
+
+	if (argc != 2 && !write && !time_check) {
+		fprintf(stderr, "usage: %s [--write | --time <percent>] <baseline>\n", argv[0]);
+		return 2;
+	}
+	if (!write) {
+		nbase = bench_Load(path, base, BENCH_MAX);
+		if (nbase <= 0) {
+			printf("cannot read %s\n", path);
+			return 1;
+		}
+	}
+
+	if (ST7789_Display_Add(&cfg, &disp) != ESP_OK) {
+		printf("ST7789_Display_Add failed\n");
+		return 1;
+	}
+	ST7789_Display_Use(disp);
+	n = ST7789_Bench_Run(results, BENCH_MAX);
+	ST7789_Display_Use(NULL);
+	if (n == 0) {
+		printf("ST7789_Bench_Run failed\n");
+		return 1;
+	}
+
+	if (write) {
+		FILE *f = freopen(path, "w", stdout);
+
+		if (f == NULL)
+			return 1;
+		ST7789_Bench_Print(results, n);
+		return 0;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const st7789_bench_result_t *r = &results[i];
+		const bench_base_t *b = NULL;
+
+		for (int j = 0; j < nbase; j++)
+			if (strcmp(base[j].name, r->name) == 0)
+				b = &base[j];
+		if (b == NULL || b->count != r->count) {
+			printf("  %s: not in the baseline, or with another count\n", r->name);
+			failed++;
+			continue;
+		}
+		printf("%-16s trans %6lu bytes %8lu us %6lld (baseline %lld)\n", r->name, (unsigned long)r->transactions,
+				(unsigned long)r->bytes, (long long)r->time_us, b->time_us);
+		failed += bench_Check(r->name, "transactions", r->transactions, b->transactions, BENCH_TOLERANCE);
+		failed += bench_Check(r->name, "bytes", r->bytes, b->bytes, BENCH_TOLERANCE);
+		if (r->transactions < b->transactions || r->bytes < b->bytes)
+			printf("  %s: below the baseline, write it again\n", r->name);
+		if (time_check)
+			failed += bench_Check(r->name, "us", r->time_us, b->time_us, time_tolerance);
+	}
+	if ((size_t)nbase != n) {
+		printf("  baseline has %d workloads, the benchmark %zu\n", nbase, n);
+		failed++;
+	}
+	return failed != 0;
+}
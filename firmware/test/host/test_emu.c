@@ -0,0 +1,168 @@
+/**
+ * @file    test_emu.c
+ * @brief   Golden screen test of the primitives on the emulated panel
+ * @details Draws every primitive, some of them partly off screen, on a
+ * 		panel of each rotation: straight to the panel, then through the
+ * 		framebuffer. Both screens, read back with ST7789_Emu_GetScreenPixel,
+ * 		must match the golden screen of the rotation pixel for pixel. The
+ * 		panel is not square so that width and height cannot be mixed up.
+ *
+ * 		    test_emu data/emu
+ * 		    test_emu --write data/emu    (regenerate the golden screens)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_emu.h"
+
+#define EMU_SHORT  64  // Panel width in portrait, the height of st7789_config_t
+#define EMU_LONG   80
+
+static const char *rot_name[4] = {"portrait", "landscape", "portrait_180", "landscape_180"};
+
+static uint8_t emu_image[12][16][2];	// RGB565 gradient, panel byte order
+
+/**
+ * @brief Draw one of each primitive
+ * @param w&h -> size of the screen in the current rotation
+ * @return none
+ */
+static void test_Scene(int16_t w, int16_t h)
+{
+	ST7789_Fill_Color(DARKBLUE);
+	ST7789_Fill(2, 2, 17, 9, RED);
+	ST7789_DrawPixel(20, 2, WHITE);
+	ST7789_DrawPixel_4px(22, 2, YELLOW);
+
+	ST7789_DrawLine(0, 12, w - 1, 12, GREEN);
+	ST7789_DrawLine(30, 0, 30, h - 1, GREEN);
+	ST7789_DrawLine(-10, -4, w + 9, h / 2, CYAN);		// Shallow, clipped at both ends
+	ST7789_DrawLine(w - 3, 14, w - 12, h + 20, MAGENTA);	// Steep, clipped at the bottom
+	ST7789_DrawRectangle(34, 16, w - 4, 30, WHITE);
+	ST7789_DrawFilledRectangle(w - 8, 20, 20, 6, LIGHTGREEN);	// Past the right edge
+
+	ST7789_DrawCircle(14, 26, 9, YELLOW);
+	ST7789_DrawCircle(-2, h / 2, 8, WHITE);				// Clipped at the left edge
+	ST7789_DrawFilledCircle(w / 2, h - 6, 10, BRRED);	// Clipped at the bottom edge
+	ST7789_DrawTriangle(4, 40, 24, 36, 12, 54, LGRAY);
+	ST7789_DrawFilledTriangle(30, 38, w - 2, 46, 36, 58, BLUE);
+
+	ST7789_WriteString(2, h - 26, "Ag", Font_7x10, WHITE, BLACK);
+	ST7789_WriteChar(20, h - 26, '#', Font_7x10, BLACK, GRAY);
+	ST7789_DrawImage(-6, h - 12, 16, 12, &emu_image[0][0][0]);	// Clipped at the left edge
+	ST7789_DrawImageScaled(w - 20, h - 14, 16, 12, &emu_image[0][0][0], 24, 9, ST7789_FILTER_NEAREST);
+	ST7789_DrawImageRotated(w / 2, h / 2, 16, 12, &emu_image[0][0][0], 8, 6, 300, 256, ST7789_FILTER_NEAREST);
+	ST7789_DrawPixel(w - 1, h - 1, WHITE);
+}
+
+/**
+ * @brief Compare the screen of the current display with a golden screen
+ * @param what -> name of the pass, for the report
+ * @param golden -> w * h pixels, panel byte order
+ * @param w&h -> size of the screen
+ * @return number of pixels that differ
+ */
+static uint32_t test_Compare(const char *what, const uint8_t *golden, uint16_t w, uint16_t h)
+{
+	uint32_t bad = 0;
+
+	for (uint16_t y = 0; y < h; y++) {
+		for (uint16_t x = 0; x < w; x++) {
+			const uint8_t *g = golden + ((size_t)y * w + x) * 2;
+			uint16_t want = (g[0] << 8) | g[1];
+			uint16_t got = ST7789_Emu_GetScreenPixel(x, y);
+
+			if (got != want && bad++ == 0)
+				printf("  %s: first difference at %u,%u: %04x, want %04x\n", what, x, y, got, want);
+		}
+	}
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	int write = argc == 3 && strcmp(argv[1], "--write") == 0;
+	const char *dir = argv[argc - 1];
+	uint32_t failed = 0;
+
+	if (argc != 2 && !write) {
+		fprintf(stderr, "usage: %s [--write] <golden dir>\n", argv[0]);
+		return 2;
+	}
+	for (uint8_t y = 0; y < 12; y++) {
+		for (uint8_t x = 0; x < 16; x++) {
+			uint16_t c = ((x * 2) << 11) | ((y * 5) << 5) | (31 - x * 2);
+			emu_image[y][x][0] = c >> 8;
+			emu_image[y][x][1] = c;
+		}
+	}
+
+	for (uint8_t rot = 0; rot < 4; rot++) {
+		const st7789_config_t cfg = {
+			.cs_pin = -1, .dc_pin = -1, .rst_pin = -1, .bl_pin = -1,
+			.height = EMU_SHORT, .width = EMU_LONG, .rotation = rot,
+		};
+		uint16_t w = rot & 1 ? EMU_LONG : EMU_SHORT;
+		uint16_t h = rot & 1 ? EMU_SHORT : EMU_LONG;
+		size_t size = (size_t)w * h * 2;
+		uint8_t *golden = malloc(size);
+		st7789_handle_t disp;
+		char path[256];
+		FILE *f;
+
+		if (ST7789_Display_Add(&cfg, &disp) != ESP_OK) {
+			printf("%s: ST7789_Display_Add failed\n", rot_name[rot]);
+			return 1;
+		}
+		ST7789_Display_Use(disp);
+		snprintf(path, sizeof(path), "%s/%s.rgb565", dir, rot_name[rot]);
+
+		test_Scene(w, h);
+		ST7789_WaitIdle();
+		if (write) {
+			for (uint16_t y = 0; y < h; y++) {
+				for (uint16_t x = 0; x < w; x++) {
+					uint16_t c = ST7789_Emu_GetScreenPixel(x, y);
+					golden[((size_t)y * w + x) * 2] = c >> 8;
+					golden[((size_t)y * w + x) * 2 + 1] = c;
+				}
+			}
+			f = fopen(path, "wb");
+			if (f == NULL || fwrite(golden, 1, size, f) != size) {
+				printf("cannot write %s\n", path);
+				return 1;
+			}
+			fclose(f);
+		} else {
+			f = fopen(path, "rb");
+			if (f == NULL || fread(golden, 1, size, f) != size) {
+				printf("cannot read %s\n", path);
+				return 1;
+			}
+			fclose(f);
+		}
+
+		uint32_t direct = test_Compare("direct", golden, w, h);
+
+		ST7789_Fill_Color(BLACK);
+		if (ST7789_FB_Enable() != ESP_OK) {
+			printf("%s: ST7789_FB_Enable failed\n", rot_name[rot]);
+			return 1;
+		}
+		test_Scene(w, h);
+		ST7789_Flush();
+		ST7789_FB_Disable();
+		ST7789_WaitIdle();
+		uint32_t fb = test_Compare("framebuffer", golden, w, h);
+
+		printf("%-13s %ux%u direct %lu framebuffer %lu pixels differ\n", rot_name[rot], w, h,
+				(unsigned long)direct, (unsigned long)fb);
+		failed += direct + fb;
+		free(golden);
+	}
+	ST7789_Display_Use(NULL);
+	return failed != 0;
+}
@@ -0,0 +1,412 @@
+/**
+ * @file    test_image.c
+ * @brief   Round trip of tools/mkimage.py and the image decoder
+ * @details Each case is a pixel pattern made here, written as raw RGB565 for
+ * 		mkimage.py to encode at build time; the test then reads the image
+ * 		back and checks that:
+ * 		- ST7789_Image_Decode gives the pattern again, in chunks of any size
+ * 		- ST7789_Image_Draw draws it, clipped on every side, straight to the
+ * 		  emulated panel and through the framebuffer; indexed images again
+ * 		  with another palette
+ * 		- every truncation of the file is refused by ST7789_Image_Open
+ * 		- a header size short of the pixel data decodes a correct prefix and
+ * 		  ST7789_Image_Draw reports it, after drawing the complete rows
+ *
+ * 		    test_image --source <case> <file.rgb565>
+ * 		    test_image <case> <file.img>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_emu.h"
+#include "st7789_image.h"
+
+#define EMU_SHORT  64  // Panel width in portrait, the height of st7789_config_t
+#define EMU_LONG   80
+#define EMU_BACK   0x39E7	// Screen color around the images
+
+/**
+ * Test image
+ */
+typedef struct {
+	const char *name;
+	uint16_t width;
+	uint16_t height;
+	uint8_t format;		// st7789_image_format_t mkimage.py must pick
+	uint16_t colors;	// Colors of indexed images, 0 for a full color pattern
+}test_case_t;
+
+/* Odd widths, the rows of indexes are padded to a byte */
+static const test_case_t test_cases[] = {
+	{"qoi",          37, 23, ST7789_IMAGE_QOI565,   0},		// Every op of the encoder
+	{"qoi_runs",     101, 7, ST7789_IMAGE_QOI565,   0},		// Runs longer than one op
+	{"indexed1",     13, 7,  ST7789_IMAGE_INDEXED1, 2},
+	{"indexed2",     11, 9,  ST7789_IMAGE_INDEXED2, 4},
+	{"indexed4",     9, 5,   ST7789_IMAGE_INDEXED4, 16},
+	{"indexed8",     33, 17, ST7789_IMAGE_INDEXED8, 256},
+	{"indexed8_few", 7, 3,   ST7789_IMAGE_INDEXED8, 3},		// Palette smaller than the indexes
+};
+
+static uint32_t test_seed;
+
+/**
+ * @brief Next pseudo random number of the patterns
+ * @return 15 bits
+ */
+static uint16_t test_Rand(void)
+{
+	test_seed = test_seed * 1103515245 + 12345;
+	return (test_seed >> 16) & 0x7FFF;
+}
+
+/**
+ * @brief Pixels of a case
+ * @param tc -> case
+ * @param px -> width * height RGB565 colors
+ * @return none
+ */
+static void test_Pattern(const test_case_t *tc, uint16_t *px)
+{
+	static const uint16_t few[] = {RED, GREEN, BLUE, WHITE, BLACK, YELLOW};
+	uint16_t w = tc->width, h = tc->height;
+
+	test_seed = 0x1A6E;
+	if (tc->colors) {
+		/* Every color once, then at random; 40503 is odd, so the colors differ */
+		for (uint32_t i = 0; i < (uint32_t)w * h; i++)
+			px[i] = ((i < tc->colors ? i : test_Rand() % tc->colors) * 40503 + 0x1234) & 0xFFFF;
+		return;
+	}
+	for (uint16_t y = 0; y < h; y++) {
+		for (uint16_t x = 0; x < w; x++) {
+			uint16_t *p = &px[y * w + x];
+			uint8_t band = y * 4 / h;
+
+			if (band == 0)			// Gradient, small and luma differences
+				*p = ((x * 31 / w) << 11) | (((x + y * 3) & 0x3F) << 5) | ((y * 2) & 0x1F);
+			else if (band == 1)		// Flat, runs across rows
+				*p = x < w / 3 ? DARKBLUE : BRRED;
+			else if (band == 2)		// A few colors, index hits
+				*p = few[test_Rand() % 6];
+			else					// Noise, literals
+				*p = test_Rand() << 1 | (test_Rand() & 1);
+		}
+	}
+}
+
+/**
+ * @brief Read a file
+ * @param path -> file
+ * @param size -> bytes read
+ * @return contents to free, NULL when the file cannot be read
+ */
+static uint8_t *test_Load(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data = NULL;
+	long n;
+
+	if (f == NULL)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+		data = malloc(n);
+		if (data && fread(data, 1, n, f) != (size_t)n) {
+			free(data);
+			data = NULL;
+		}
+		*size = n;
+	}
+	fclose(f);
+	return data;
+}
+
+/**
+ * @brief Decode the image in chunks of some pixels
+ * @param data&size -> image file
+ * @param chunk -> pixels per ST7789_Image_Decode call
+ * @param out -> decoded pixels, RGB565
+ * @param max -> room in out
+ * @return pixels decoded, -1 when ST7789_Image_Open fails
+ */
+static long test_Decode(const uint8_t *data, size_t size, uint32_t chunk, uint16_t *out, uint32_t max)
+{
+	st7789_image_dec_t dec;
+	uint16_t buf[64];
+	uint32_t n = 0, k;
+
+	if (ST7789_Image_Open(&dec, data, size) != ESP_OK)
+		return -1;
+	while ((k = ST7789_Image_Decode(&dec, buf, chunk)) != 0) {
+		for (uint32_t i = 0; i < k && n < max; i++, n++)
+			out[n] = (buf[i] >> 8) | (buf[i] << 8);
+		if (k < chunk)
+			break;
+	}
+	return n;
+}
+
+/**
+ * @brief Put image pixels on an expected screen, clipped
+ * @param screen -> w * h pixels
+ * @param w&h -> size of the screen
+ * @param x&y -> top left corner of the image
+ * @param px -> pixels of the image
+ * @param iw&ih -> size of the image
+ * @param rows -> rows of the image drawn
+ * @return none
+ */
+static void test_Put(uint16_t *screen, int16_t w, int16_t h, int16_t x, int16_t y,
+		const uint16_t *px, int16_t iw, int16_t rows)
+{
+	for (int16_t j = 0; j < rows; j++)
+		for (int16_t i = 0; i < iw; i++)
+			if (x + i >= 0 && x + i < w && y + j >= 0 && y + j < h)
+				screen[(y + j) * w + x + i] = px[j * iw + i];
+}
+
+/**
+ * @brief Compare the emulated screen with the expected one
+ * @param what -> pass, for the report
+ * @param screen -> w * h pixels
+ * @param w&h -> size of the screen
+ * @return pixels that differ
+ */
+static uint32_t test_Compare(const char *what, const uint16_t *screen, uint16_t w, uint16_t h)
+{
+	uint32_t bad = 0;
+
+	ST7789_WaitIdle();
+	for (uint16_t y = 0; y < h; y++) {
+		for (uint16_t x = 0; x < w; x++) {
+			uint16_t got = ST7789_Emu_GetScreenPixel(x, y);
+
+			if (got != screen[y * w + x] && bad++ == 0)
+				printf("  %s: first difference at %u,%u: %04x, want %04x\n", what, x, y, got, screen[y * w + x]);
+		}
+	}
+	return bad;
+}
+
+/**
+ * @brief Draw the image clipped on each side and in the middle
+ * @param what -> pass, for the report
+ * @param data&size -> image file
+ * @param palette -> colors for ST7789_Image_DrawPalette, NULL for ST7789_Image_Draw
+ * @param px -> expected pixels of the image
+ * @param iw&ih -> size of the image
+ * @param screen -> expected screen, w * h pixels
+ * @param w&h -> size of the screen
+ * @return pixels or calls that were wrong
+ */
+static uint32_t test_Draw(const char *what, const uint8_t *data, size_t size, const uint16_t *palette,
+		const uint16_t *px, int16_t iw, int16_t ih, uint16_t *screen, int16_t w, int16_t h)
+{
+	const int16_t pos[][2] = {{-5, -3}, {w - iw + 4, h - ih + 2}, {w / 2 - iw / 2, h / 2 - ih / 2}, {w + 1, 0}};
+	uint32_t bad = 0;
+
+	for (uint8_t fb = 0; fb < 2; fb++) {
+		char pass[64];
+
+		for (int32_t i = 0; i < w * h; i++)
+			screen[i] = EMU_BACK;
+		if (fb && ST7789_FB_Enable() != ESP_OK) {
+			printf("  ST7789_FB_Enable failed\n");
+			return 1;
+		}
+		ST7789_Fill_Color(EMU_BACK);
+		for (uint8_t p = 0; p < sizeof(pos) / sizeof(pos[0]); p++) {
+			if (ST7789_Image_DrawPalette(pos[p][0], pos[p][1], data, size, palette) != ESP_OK)
+				bad++;
+			test_Put(screen, w, h, pos[p][0], pos[p][1], px, iw, ih);
+		}
+		if (fb) {
+			ST7789_Flush();
+			ST7789_FB_Disable();
+		}
+		snprintf(pass, sizeof(pass), "%s %s", what, fb ? "framebuffer" : "direct");
+		bad += test_Compare(pass, screen, w, h);
+	}
+	return bad;
+}
+
+/**
+ * @brief Check that truncated files are refused and short pixel data is
+ *        decoded and drawn up to where it ends
+ * @note  The image must fit the height of the screen
+ * @param data&size -> image file
+ * @param px -> expected pixels of the image
+ * @param screen -> scratch expected screen, w * h pixels
+ * @param w&h -> size of the screen
+ * @return checks that failed
+ */
+static uint32_t test_Truncated(const uint8_t *data, size_t size, const uint16_t *px, uint16_t *screen, int16_t w, int16_t h)
+{
+	const st7789_image_header_t *hdr = (const st7789_image_header_t *)data;
+	uint32_t total = (uint32_t)hdr->width * hdr->height;
+	uint16_t *out = malloc(total * 2);
+	uint32_t bad = 0;
+	/* Pixels up to the last visible one when drawn at 1,1, the image is not taller than the screen */
+	uint32_t needed = total - hdr->width + (hdr->width < w - 1 ? hdr->width : w - 1);
+
+	/* Files cut anywhere, each in a buffer of its size for the sanitizers */
+	for (size_t cut = 0; cut < size; cut++) {
+		uint8_t *part = malloc(cut ? cut : 1);
+		st7789_image_dec_t dec;
+
+		memcpy(part, data, cut);
+		if (ST7789_Image_Open(&dec, part, cut) == ESP_OK || ST7789_Image_Draw(0, 0, part, cut) == ESP_OK) {
+			if (bad++ == 0)
+				printf("  file cut to %zu bytes was accepted\n", cut);
+		}
+		free(part);
+	}
+
+	/* Whole files, the header claiming less pixel data */
+	for (uint32_t len = 0; len < hdr->size; len++) {
+		size_t n = sizeof(*hdr) + len;
+		uint8_t *part = malloc(n);
+		st7789_image_header_t *h2 = (st7789_image_header_t *)part;
+		long got;
+
+		memcpy(part, data, n);
+		h2->size = len;
+		got = test_Decode(part, n, 13, out, total);
+		if ((got < 0) != (hdr->format != ST7789_IMAGE_QOI565)) {
+			/* Formats of fixed size know they are short, QOI565 only finds out decoding */
+			if (bad++ == 0)
+				printf("  %lu bytes of pixel data were %s\n", (unsigned long)len, got < 0 ? "refused" : "accepted");
+			free(part);
+			continue;
+		}
+		if (got < 0) {
+			free(part);
+			continue;
+		}
+		if ((uint32_t)got >= total || memcmp(out, px, got * 2) != 0) {
+			if (bad++ == 0)
+				printf("  %lu bytes of pixel data decoded %ld pixels\n", (unsigned long)len, got);
+			free(part);
+			continue;
+		}
+
+		/* Decoding stops after the last visible pixel, data missing after it is not noticed */
+		esp_err_t want = (uint32_t)got >= needed ? ESP_OK : ESP_ERR_INVALID_SIZE;
+
+		for (int32_t i = 0; i < w * h; i++)
+			screen[i] = EMU_BACK;
+		ST7789_Fill_Color(EMU_BACK);
+		if (ST7789_Image_Draw(1, 1, part, n) != want) {
+			if (bad++ == 0)
+				printf("  %lu bytes of pixel data, ST7789_Image_Draw did not give %s\n", (unsigned long)len,
+						esp_err_to_name(want));
+		}
+		test_Put(screen, w, h, 1, 1, px, hdr->width, want == ESP_OK ? hdr->height : got / hdr->width);
+		if (test_Compare("short data", screen, w, h) && bad++ == 0)
+			printf("  %lu bytes of pixel data, rows before the end are wrong\n", (unsigned long)len);
+		free(part);
+	}
+	free(out);
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	const st7789_config_t cfg = {
+		.cs_pin = -1, .dc_pin = -1, .rst_pin = -1, .bl_pin = -1,
+		.height = EMU_SHORT, .width = EMU_LONG, .rotation = ROT_PORTRAIT,
+	};
+	const test_case_t *tc = NULL;
+	const st7789_image_header_t *hdr;
+	uint16_t *px, *out, *screen;
+	st7789_handle_t disp;
+	uint32_t total, bad = 0;
+	uint8_t *data;
+	size_t size;
+
+	if (argc == 4 && strcmp(argv[1], "--source") == 0)
+		argv++;
+	else if (argc != 3) {
+		fprintf(stderr, "usage: %s [--source] <case> <file>\n", argv[0]);
+		return 2;
+	}
+	for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++)
+		if (strcmp(test_cases[i].name, argv[1]) == 0)
+			tc = &test_cases[i];
+	if (tc == NULL) {
+		printf("no case %s\n", argv[1]);
+		return 2;
+	}
+	total = (uint32_t)tc->width * tc->height;
+	px = malloc(total * 2);
+	test_Pattern(tc, px);
+
+	if (argc == 4) {
+		FILE *f = fopen(argv[2], "wb");
+
+		for (uint32_t i = 0; f && i < total; i++) {
+			fputc(px[i] >> 8, f);
+			fputc(px[i] & 0xFF, f);
+		}
+		free(px);
+		if (f == NULL || fclose(f) != 0) {
+			printf("cannot write %s\n", argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+
+	data = test_Load(argv[2], &size);
+	if (data == NULL || size < sizeof(*hdr)) {
+		printf("cannot read %s\n", argv[2]);
+		return 1;
+	}
+	hdr = (const st7789_image_header_t *)data;
+	if (hdr->format != tc->format || hdr->width != tc->width || hdr->height != tc->height) {
+		printf("%s: format %u %ux%u, want format %u %ux%u\n", tc->name, hdr->format, hdr->width, hdr->height,
+				tc->format, tc->width, tc->height);
+		return 1;
+	}
+
+	/* Chunks of one pixel, of an odd size and of the whole scratch buffer */
+	out = malloc(total * 2);
+	for (uint8_t i = 0; i < 3; i++) {
+		static const uint32_t chunks[3] = {1, 13, 64};
+		uint32_t chunk = chunks[i];
+
+		if (test_Decode(data, size, chunk, out, total) != (long)total || memcmp(out, px, total * 2) != 0) {
+			printf("  decoding in chunks of %lu pixels differs\n", (unsigned long)chunk);
+			bad++;
+		}
+	}
+
+	if (ST7789_Display_Add(&cfg, &disp) != ESP_OK) {
+		printf("ST7789_Display_Add failed\n");
+		return 1;
+	}
+	ST7789_Display_Use(disp);
+	screen = malloc(EMU_SHORT * EMU_LONG * 2);
+	bad += test_Draw("draw", data, size, NULL, px, tc->width, tc->height, screen, EMU_SHORT, EMU_LONG);
+	if (tc->colors) {
+		/* Another palette, each color inverted, the image's is sorted */
+		uint16_t palette[256];
+
+		for (uint16_t i = 0; i < hdr->colors; i++)
+			palette[i] = ~((data[sizeof(*hdr) + i * 2] << 8) | data[sizeof(*hdr) + i * 2 + 1]);
+		for (uint32_t i = 0; i < total; i++)
+			out[i] = ~px[i];
+		bad += test_Draw("palette", data, size, palette, out, tc->width, tc->height, screen, EMU_SHORT, EMU_LONG);
+	}
+	bad += test_Truncated(data, size, px, screen, EMU_SHORT, EMU_LONG);
+	ST7789_Display_Use(NULL);
+
+	printf("%-10s %ux%u format %u, %zu bytes: %lu errors\n", tc->name, tc->width, tc->height, hdr->format, size,
+			(unsigned long)bad);
+	free(screen);
+	free(out);
+	free(px);
+	free(data);
+	return bad != 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file    test_jpeg.c
+ * @brief   Golden image test of the baseline JPEG decoder
+ * @details Decodes a JPEG with ST7789_Jpeg_DecodeRow and compares every
+ * 		pixel with the RGB565 reference written by mkgolden_jpeg from libjpeg.
+ * 		Each channel may differ by 1 LSB, the rounding of the two IDCTs.
+ * 		The file is then decoded again truncated, which must fail or end
+ * 		without reading past the data.
+ *
+ * 		    test_jpeg data/jpeg/yuv420.jpg data/jpeg/yuv420.rgb565
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789_jpeg.h"
+
+#define JPEG_TOLERANCE  1  // LSBs each RGB565 channel may differ by
+
+static uint8_t *test_Read(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *data;
+	long len;
+
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(len > 0 ? len : 1);
+	if (data && fread(data, 1, len, f) != (size_t)len) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	*size = len;
+	return data;
+}
+
+/**
+ * @brief Decode a whole JPEG
+ * @param data&size -> file contents
+ * @param jpeg -> decoder, holds the size on return
+ * @param pixels -> filled with width * height pixels, panel byte order
+ * @return ESP_OK or the first error of the decoder
+ */
+static esp_err_t test_Decode(const uint8_t *data, size_t size, st7789_jpeg_t *jpeg, uint16_t **pixels)
+{
+	esp_err_t err = ST7789_Jpeg_Open(jpeg, data, size);
+	uint16_t *row;
+
+	*pixels = NULL;
+	if (err != ESP_OK)
+		return err;
+	*pixels = calloc((size_t)jpeg->width * jpeg->height, 2);
+	row = malloc((size_t)jpeg->width * jpeg->mcu_height * 2);
+	for (uint32_t y = 0; y < jpeg->height && err == ESP_OK; y += jpeg->mcu_height) {
+		uint32_t h = jpeg->height - y < jpeg->mcu_height ? jpeg->height - y : jpeg->mcu_height;
+
+		err = ST7789_Jpeg_DecodeRow(jpeg, row);
+		if (err == ESP_OK)
+			memcpy(*pixels + y * jpeg->width, row, (size_t)h * jpeg->width * 2);
+	}
+	free(row);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	st7789_jpeg_t *jpeg = malloc(sizeof(*jpeg));
+	size_t size, ref_size;
+	uint8_t *data, *ref;
+	uint16_t *pixels;
+	int maxd[3] = {0, 0, 0};
+	esp_err_t err;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <file.jpg> <file.rgb565>\n", argv[0]);
+		return 2;
+	}
+	data = test_Read(argv[1], &size);
+	ref = test_Read(argv[2], &ref_size);
+	if (data == NULL || ref == NULL) {
+		fprintf(stderr, "cannot read %s or %s\n", argv[1], argv[2]);
+		return 1;
+	}
+
+	err = test_Decode(data, size, jpeg, &pixels);
+	if (err != ESP_OK) {
+		fprintf(stderr, "%s: decoder error 0x%x\n", argv[1], err);
+		return 1;
+	}
+	if (ref_size != (size_t)jpeg->width * jpeg->height * 2) {
+		fprintf(stderr, "%s: %ux%u does not match the reference\n", argv[1], jpeg->width, jpeg->height);
+		return 1;
+	}
+
+	for (size_t i = 0; i < ref_size / 2; i++) {
+		const uint8_t *got = (const uint8_t *)&pixels[i];	// Panel byte order, big endian
+		uint16_t a = (got[0] << 8) | got[1];
+		uint16_t b = (ref[i * 2] << 8) | ref[i * 2 + 1];
+		int d[3] = {
+			abs((a >> 11) - (b >> 11)),
+			abs(((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)),
+			abs((a & 0x1F) - (b & 0x1F)),
+		};
+
+		for (int c = 0; c < 3; c++)
+			if (d[c] > maxd[c])
+				maxd[c] = d[c];
+	}
+	printf("%s: %ux%u, MCU %ux%u, max difference R %d G %d B %d\n", argv[1],
+			jpeg->width, jpeg->height, jpeg->mcu_width, jpeg->mcu_height, maxd[0], maxd[1], maxd[2]);
+	free(pixels);
+
+	/* A truncated file must not be read past its end */
+	test_Decode(data, size / 2, jpeg, &pixels);
+	free(pixels);
+
+	free(data);
+	free(ref);
+	free(jpeg);
+	return maxd[0] > JPEG_TOLERANCE || maxd[1] > JPEG_TOLERANCE || maxd[2] > JPEG_TOLERANCE;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file    test_multi.c
+ * @brief   Two panels on one bus, drawn by two tasks at once
+ * @details Two emulated panels of different sizes share the emulated bus.
+ * 		Each gets a workload of filled triangles, lines and text, first one
+ * 		panel after the other, then from two tasks at the same time. The
+ * 		screens of the concurrent runs must match those of the sequential
+ * 		one: the displays must not share span tables, windows or render
+ * 		state, and the bus must carry the transactions of both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "st7789.h"
+#include "st7789_emu.h"
+
+#define MULTI_ROUNDS  3    // Concurrent runs
+#define MULTI_SHAPES  300  // Filled triangles per workload
+
+/**
+ * Panel and its task
+ */
+typedef struct {
+	const char *name;
+	st7789_config_t cfg;
+	uint16_t w, h;			// Size in the rotation of cfg
+	uint32_t seed;			// Of the workload
+	st7789_handle_t disp;
+	TaskHandle_t waiter;	// Notified when the workload is drawn
+	uint16_t *ref;			// Screen of the sequential run
+}multi_panel_t;
+
+static multi_panel_t panels[2] = {
+	{.name = "240x240", .w = 240, .h = 240, .seed = 1, .cfg = {.cs_pin = -1, .dc_pin = -1, .rst_pin = -1,
+			.bl_pin = -1, .height = 240, .width = 240, .rotation = ROT_PORTRAIT_180}},
+	{.name = "320x240", .w = 320, .h = 240, .seed = 2, .cfg = {.cs_pin = -1, .dc_pin = -1, .rst_pin = -1,
+			.bl_pin = -1, .height = 240, .width = 320, .rotation = ROT_LANDSCAPE}},
+};
+
+/**
+ * @brief Draw the workload of a panel on the display of the calling task
+ * @param p -> panel
+ * @return none
+ */
+static void multi_Draw(const multi_panel_t *p)
+{
+	uint32_t seed = p->seed;
+
+	ST7789_Fill_Color(BLACK);
+	for (int i = 0; i < MULTI_SHAPES; i++) {
+		int16_t v[6];
+
+		for (int k = 0; k < 6; k++) {
+			seed = seed * 1103515245 + 12345;
+			v[k] = (seed >> 16) % (k & 1 ? p->h : p->w);
+		}
+		ST7789_DrawFilledTriangle(v[0], v[1], v[2], v[3], v[4], v[5], (seed >> 8) & 0xFFFF);
+		if (i % 16 == 0) {
+			ST7789_DrawLine(v[0], v[1], v[4], v[5], WHITE);
+			ST7789_WriteString(v[2] % (p->w - 70), v[3] % (p->h - 10), p->name, Font_7x10, WHITE, BLACK);
+		}
+	}
+	ST7789_WaitIdle();
+}
+
+/**
+ * @brief Read the screen of the display of the calling task
+ * @param p -> panel
+ * @param out -> w * h pixels
+ * @return none
+ */
+static void multi_Grab(const multi_panel_t *p, uint16_t *out)
+{
+	for (uint16_t y = 0; y < p->h; y++)
+		for (uint16_t x = 0; x < p->w; x++)
+			out[y * p->w + x] = ST7789_Emu_GetScreenPixel(x, y);
+}
+
+/**
+ * @brief Task drawing the workload of one panel
+ * @param arg -> panel
+ * @return none
+ */
+static void multi_Task(void *arg)
+{
+	multi_panel_t *p = arg;
+
+	ST7789_Display_Use(p->disp);
+	multi_Draw(p);
+	xTaskNotifyGive(p->waiter);
+	vTaskDelete(NULL);
+}
+
+int main(void)
+{
+	uint32_t bad = 0;
+
+	for (int i = 0; i < 2; i++) {
+		multi_panel_t *p = &panels[i];
+
+		if (ST7789_Display_Add(&p->cfg, &p->disp) != ESP_OK) {
+			printf("%s: ST7789_Display_Add failed\n", p->name);
+			return 1;
+		}
+		p->ref = malloc((size_t)p->w * p->h * 2);
+		p->waiter = xTaskGetCurrentTaskHandle();
+		ST7789_Display_Use(p->disp);
+		multi_Draw(p);
+		multi_Grab(p, p->ref);
+	}
+
+	for (int round = 0; round < MULTI_ROUNDS; round++) {
+		for (int i = 0; i < 2; i++) {
+			ST7789_Display_Use(panels[i].disp);
+			ST7789_Fill_Color(DARKBLUE);
+			ST7789_WaitIdle();
+		}
+		for (int i = 0; i < 2; i++) {
+			if (xTaskCreate(multi_Task, "multi", 4096, &panels[i], 5, NULL) != pdPASS) {
+				printf("xTaskCreate failed\n");
+				return 1;
+			}
+		}
+		ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+		ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+		for (int i = 0; i < 2; i++) {
+			multi_panel_t *p = &panels[i];
+			uint16_t *shot = malloc((size_t)p->w * p->h * 2);
+			uint32_t diff = 0;
+
+			ST7789_Display_Use(p->disp);
+			multi_Grab(p, shot);
+			for (uint32_t k = 0; k < (uint32_t)p->w * p->h; k++)
+				diff += shot[k] != p->ref[k];
+			printf("round %d %s: %lu pixels differ from the sequential run\n", round, p->name, (unsigned long)diff);
+			bad += diff != 0;
+			free(shot);
+		}
+	}
+	ST7789_Display_Use(NULL);
+	return bad != 0;
+}
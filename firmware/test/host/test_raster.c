@@ -0,0 +1,416 @@
+/**
+ * @file    test_raster.c
+ * @brief   Rasterized shapes against their per-pixel references
+ * @details The references are the per-pixel versions the span and run
+ * 		rasterizers replaced, drawing with ST7789_DrawPixel on the same
+ * 		emulated panel. Both are read back with ST7789_Emu_GetScreenPixel and
+ * 		must set the same pixels; ST7789_Emu_GetStats gives what each cost on
+ * 		the wire.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7789_emu.h"
+
+#define EMU_W  240
+#define EMU_H  320
+
+static uint16_t shot[2][EMU_W * EMU_H];	// Reference and rasterized screens
+static uint32_t test_seed = 0x7E57;
+
+/**
+ * @brief Next pseudo random number of the shapes
+ * @param n -> range
+ * @return number from 0 to n - 1
+ */
+static int16_t test_Rand(int16_t n)
+{
+	test_seed = test_seed * 1103515245 + 12345;
+	return (test_seed >> 16) % n;
+}
+
+/**
+ * @brief Clear the screen and the counters before drawing a shape
+ * @return none
+ */
+static void test_Begin(void)
+{
+	ST7789_Fill_Color(BLACK);
+	ST7789_WaitIdle();
+	ST7789_Emu_ResetStats();
+}
+
+/**
+ * @brief Read the screen after drawing a shape
+ * @param out -> screen
+ * @param stats -> traffic of the shape, NULL if not needed
+ * @return none
+ */
+static void test_End(uint16_t *out, st7789_emu_stats_t *stats)
+{
+	ST7789_WaitIdle();
+	if (stats)
+		ST7789_Emu_GetStats(stats);
+	for (uint16_t y = 0; y < EMU_H; y++)
+		for (uint16_t x = 0; x < EMU_W; x++)
+			out[y * EMU_W + x] = ST7789_Emu_GetScreenPixel(x, y);
+}
+
+/**
+ * @brief Count the pixels of a color
+ * @param screen -> screen
+ * @param color -> color
+ * @return pixels
+ */
+static uint32_t test_Count(const uint16_t *screen, uint16_t color)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < EMU_W * EMU_H; i++)
+		n += screen[i] == color;
+	return n;
+}
+
+/**
+ * @brief Compare the reference and rasterized screens
+ * @param what -> shape, for the report
+ * @return 1 when they differ, otherwise 0
+ */
+static uint32_t test_Same(const char *what)
+{
+	for (uint32_t i = 0; i < EMU_W * EMU_H; i++) {
+		if (shot[0][i] != shot[1][i]) {
+			printf("  %s: first difference at %lu,%lu: %04x, reference %04x\n", what, (unsigned long)(i % EMU_W),
+					(unsigned long)(i / EMU_W), shot[1][i], shot[0][i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Per-pixel line, Bresenham
+ * @param x0&y0 -> start, x1&y1 -> end
+ * @param color -> color
+ * @return none
+ */
+static void ref_Line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+	int16_t steep = abs(y1 - y0) > abs(x1 - x0);
+	int16_t swap;
+
+	if (steep) {
+		swap = x0; x0 = y0; y0 = swap;
+		swap = x1; x1 = y1; y1 = swap;
+	}
+	if (x0 > x1) {
+		swap = x0; x0 = x1; x1 = swap;
+		swap = y0; y0 = y1; y1 = swap;
+	}
+
+	int16_t dx = x1 - x0;
+	int16_t dy = abs(y1 - y0);
+	int16_t err = dx / 2;
+	int16_t ystep = y0 < y1 ? 1 : -1;
+
+	for (; x0 <= x1; x0++) {
+		if (steep)
+			ST7789_DrawPixel(y0, x0, color);
+		else
+			ST7789_DrawPixel(x0, y0, color);
+		err -= dy;
+		if (err < 0) {
+			y0 += ystep;
+			err += dx;
+		}
+	}
+}
+
+/**
+ * @brief Per-pixel circle outline, eight points per midpoint step
+ * @param x0&y0 -> center, r -> radius
+ * @param color -> color
+ * @return none
+ */
+static void ref_Circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+	int16_t f = 1 - r;
+	int16_t ddF_x = 1;
+	int16_t ddF_y = -2 * r;
+	int16_t x = 0;
+	int16_t y = r;
+
+	ST7789_DrawPixel(x0, y0 + r, color);
+	ST7789_DrawPixel(x0, y0 - r, color);
+	ST7789_DrawPixel(x0 + r, y0, color);
+	ST7789_DrawPixel(x0 - r, y0, color);
+
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+
+		ST7789_DrawPixel(x0 + x, y0 + y, color);
+		ST7789_DrawPixel(x0 - x, y0 + y, color);
+		ST7789_DrawPixel(x0 + x, y0 - y, color);
+		ST7789_DrawPixel(x0 - x, y0 - y, color);
+		ST7789_DrawPixel(x0 + y, y0 + x, color);
+		ST7789_DrawPixel(x0 - y, y0 + x, color);
+		ST7789_DrawPixel(x0 + y, y0 - x, color);
+		ST7789_DrawPixel(x0 - y, y0 - x, color);
+	}
+}
+
+/**
+ * @brief Per-pixel filled circle, four lines per midpoint step
+ * @param x0&y0 -> center, r -> radius
+ * @param color -> color
+ * @return none
+ */
+static void ref_FilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+	int16_t f = 1 - r;
+	int16_t ddF_x = 1;
+	int16_t ddF_y = -2 * r;
+	int16_t x = 0;
+	int16_t y = r;
+
+	ST7789_DrawPixel(x0, y0 + r, color);
+	ST7789_DrawPixel(x0, y0 - r, color);
+	for (int16_t i = -r; i <= r; i++)
+		ST7789_DrawPixel(x0 + i, y0, color);
+
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+
+		for (int16_t i = -x; i <= x; i++) {
+			ST7789_DrawPixel(x0 + i, y0 + y, color);
+			ST7789_DrawPixel(x0 + i, y0 - y, color);
+		}
+		for (int16_t i = -y; i <= y; i++) {
+			ST7789_DrawPixel(x0 + i, y0 + x, color);
+			ST7789_DrawPixel(x0 + i, y0 - x, color);
+		}
+	}
+}
+
+/**
+ * @brief Filled circles of radius 0 to 59 match the per-pixel version
+ * @return shapes that failed
+ */
+static uint32_t test_FilledCircles(void)
+{
+	uint32_t bad = 0, trans[2] = {0};
+
+	for (int16_t r = 0; r < 60; r++) {
+		st7789_emu_stats_t st[2];
+		char what[32];
+
+		test_Begin();
+		ref_FilledCircle(EMU_W / 2, EMU_H / 2, r, YELLOW);
+		test_End(shot[0], &st[0]);
+		test_Begin();
+		ST7789_DrawFilledCircle(EMU_W / 2, EMU_H / 2, r, YELLOW);
+		test_End(shot[1], &st[1]);
+
+		snprintf(what, sizeof(what), "filled circle r %d", r);
+		bad += test_Same(what);
+		/* Spans do not overlap, each pixel is sent once */
+		if (st[1].pixels != test_Count(shot[1], YELLOW) && bad++ == 0)
+			printf("  %s: %lu pixels sent for %lu\n", what, (unsigned long)st[1].pixels,
+					(unsigned long)test_Count(shot[1], YELLOW));
+		trans[0] += st[0].transactions;
+		trans[1] += st[1].transactions;
+	}
+	printf("filled circles   %lu transactions, per pixel %lu\n", (unsigned long)trans[1], (unsigned long)trans[0]);
+	return bad;
+}
+
+/**
+ * @brief Random lines match the per-pixel version with far fewer transactions
+ * @return shapes that failed
+ */
+static uint32_t test_Lines(void)
+{
+	uint32_t bad = 0, trans[2] = {0};
+
+	for (int i = 0; i < 300; i++) {
+		int16_t x0 = test_Rand(EMU_W), y0 = test_Rand(EMU_H), x1 = test_Rand(EMU_W), y1 = test_Rand(EMU_H);
+		st7789_emu_stats_t st[2];
+		char what[48];
+
+		/* Some axis aligned and diagonal */
+		if (i % 10 == 1)
+			y1 = y0;
+		else if (i % 10 == 2)
+			x1 = x0;
+		else if (i % 10 == 3)
+			y1 = y0 + (x1 - x0) * (y1 < EMU_H / 2 ? 1 : -1) / 2;
+		test_Begin();
+		ref_Line(x0, y0, x1, y1, WHITE);
+		test_End(shot[0], &st[0]);
+		test_Begin();
+		ST7789_DrawLine(x0, y0, x1, y1, WHITE);
+		test_End(shot[1], &st[1]);
+
+		snprintf(what, sizeof(what), "line %d,%d %d,%d", x0, y0, x1, y1);
+		bad += test_Same(what);
+		trans[0] += st[0].transactions;
+		trans[1] += st[1].transactions;
+	}
+	printf("lines            %lu transactions, per pixel %lu\n", (unsigned long)trans[1], (unsigned long)trans[0]);
+	if (trans[1] * 2 > trans[0]) {
+		printf("  lines: not half the transactions of the per-pixel version\n");
+		bad++;
+	}
+	return bad;
+}
+
+/**
+ * @brief Circle outlines of radius 0 to 99 match the per-pixel version with
+ *        far fewer transactions
+ * @return shapes that failed
+ */
+static uint32_t test_Circles(void)
+{
+	uint32_t bad = 0, trans[2] = {0};
+
+	for (int16_t r = 0; r < 100; r++) {
+		st7789_emu_stats_t st[2];
+		char what[32];
+
+		test_Begin();
+		ref_Circle(EMU_W / 2, EMU_H / 2, r, MAGENTA);
+		test_End(shot[0], &st[0]);
+		test_Begin();
+		ST7789_DrawCircle(EMU_W / 2, EMU_H / 2, r, MAGENTA);
+		test_End(shot[1], &st[1]);
+
+		snprintf(what, sizeof(what), "circle r %d", r);
+		bad += test_Same(what);
+		trans[0] += st[0].transactions;
+		trans[1] += st[1].transactions;
+	}
+	printf("circles          %lu transactions, per pixel %lu\n", (unsigned long)trans[1], (unsigned long)trans[0]);
+	if (trans[1] * 2 > trans[0]) {
+		printf("  circles: not half the transactions of the per-pixel version\n");
+		bad++;
+	}
+	return bad;
+}
+
+/**
+ * @brief Filled triangles cover their outline with one span per row
+ * @return shapes that failed
+ */
+static uint32_t test_FilledTriangles(void)
+{
+	uint32_t bad = 0;
+
+	for (int i = 0; i < 100; i++) {
+		int16_t x1 = test_Rand(EMU_W), y1 = test_Rand(EMU_H), x2 = test_Rand(EMU_W);
+		int16_t y2 = test_Rand(EMU_H), x3 = test_Rand(EMU_W), y3 = test_Rand(EMU_H);
+		int16_t top = y1 < y2 ? (y1 < y3 ? y1 : y3) : (y2 < y3 ? y2 : y3);
+		int16_t bottom = y1 > y2 ? (y1 > y3 ? y1 : y3) : (y2 > y3 ? y2 : y3);
+		st7789_emu_stats_t st;
+
+		/* Outline first, the fill must leave none of it */
+		test_Begin();
+		ST7789_DrawTriangle(x1, y1, x2, y2, x3, y3, RED);
+		ST7789_WaitIdle();
+		ST7789_Emu_ResetStats();
+		ST7789_DrawFilledTriangle(x1, y1, x2, y2, x3, y3, GREEN);
+		test_End(shot[1], &st);
+
+		for (int16_t y = 0; y < EMU_H; y++) {
+			const uint16_t *row = &shot[1][y * EMU_W];
+			int16_t spans = 0;
+
+			for (int16_t x = 0; x < EMU_W; x++) {
+				if (row[x] == RED || (row[x] == GREEN && (y < top || y > bottom)))
+					spans = 2;
+				else if (row[x] == GREEN && (x == 0 || row[x - 1] != GREEN))
+					spans++;
+			}
+			if (spans > 1 || (spans == 0 && y >= top && y <= bottom)) {
+				if (bad++ == 0)
+					printf("  triangle %d,%d %d,%d %d,%d: row %d is not one span over the outline\n",
+							x1, y1, x2, y2, x3, y3, y);
+				break;
+			}
+		}
+		if (st.pixels != test_Count(shot[1], GREEN) && bad++ == 0)
+			printf("  triangle %d,%d %d,%d %d,%d: %lu pixels sent for %lu\n", x1, y1, x2, y2, x3, y3,
+					(unsigned long)st.pixels, (unsigned long)test_Count(shot[1], GREEN));
+	}
+	return bad;
+}
+
+/**
+ * @brief Filled rectangles cover w + 1 by h + 1 pixels in one window
+ * @return shapes that failed
+ */
+static uint32_t test_FilledRectangles(void)
+{
+	uint32_t bad = 0;
+
+	for (int i = 0; i < 20; i++) {
+		int16_t x = test_Rand(EMU_W - 50), y = test_Rand(EMU_H - 50), w = test_Rand(50), h = test_Rand(50);
+		st7789_emu_stats_t st;
+
+		test_Begin();
+		for (int16_t j = 0; j <= h; j++)
+			for (int16_t k = 0; k <= w; k++)
+				ST7789_DrawPixel(x + k, y + j, CYAN);
+		test_End(shot[0], NULL);
+		test_Begin();
+		ST7789_DrawFilledRectangle(x, y, w, h, CYAN);
+		test_End(shot[1], &st);
+
+		bad += test_Same("filled rectangle");
+		if ((st.windows > 2 || st.pixels != test_Count(shot[1], CYAN)) && bad++ == 0)
+			printf("  filled rectangle: %lu windows, %lu pixels sent\n", (unsigned long)st.windows,
+					(unsigned long)st.pixels);
+	}
+	return bad;
+}
+
+int main(void)
+{
+	const st7789_config_t cfg = {
+		.cs_pin = -1, .dc_pin = -1, .rst_pin = -1, .bl_pin = -1,
+		.height = EMU_W, .width = EMU_H, .rotation = ROT_PORTRAIT,
+	};
+	st7789_handle_t disp;
+	uint32_t bad = 0;
+
+	if (ST7789_Display_Add(&cfg, &disp) != ESP_OK) {
+		printf("ST7789_Display_Add failed\n");
+		return 1;
+	}
+	ST7789_Display_Use(disp);
+	bad += test_Lines();
+	bad += test_Circles();
+	bad += test_FilledCircles();
+	bad += test_FilledTriangles();
+	bad += test_FilledRectangles();
+	ST7789_Display_Use(NULL);
+
+	printf("%lu shapes failed\n", (unsigned long)bad);
+	return bad != 0;
+}
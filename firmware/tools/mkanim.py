@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Encode frames to the ST7789 delta animation format.
+
+The layout is described in main/ST7789/st7789_anim.h. Frames are image files,
+an animated GIF/PNG, or raw RGB565 files (big endian) with --raw. Each changed
+rectangle is stored in whichever image format of mkimage.py is the smallest.
+
+    mkanim.py idle.gif idle.anm
+    mkanim.py --period 50 frame*.png spinner.anm
+    mkanim.py --raw 64x64 f0.rgb565 f1.rgb565 f2.rgb565 dots.anm
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import mkimage  # noqa: E402
+
+MAGIC = b"S7AN"
+VERSION = 1
+HEADER = struct.Struct("<4sBxHHHHxxI")
+FRAME = struct.Struct("<HxxI")
+RECT = struct.Struct("<hh")
+GAP = 32  # Unchanged pixels worth sending to save one rectangle
+
+
+def pad(data):
+    return data + bytes(-len(data) % 4)
+
+
+def encode_image(width, height, pixels):
+    """Smallest of the raw, QOI565 and indexed encodings, padded."""
+    raw = struct.pack(">%dH" % len(pixels), *pixels)
+    choices = [(mkimage.FORMAT_RAW, 0, raw), (mkimage.FORMAT_QOI565, 0, mkimage.encode_qoi565(pixels))]
+    if len(set(pixels)) <= 256:
+        bpp, colors, data = mkimage.encode_indexed(width, height, pixels, 0)
+        choices.append((mkimage.FORMAT_INDEXED[bpp], colors, data))
+    fmt, colors, data = min(choices, key=lambda c: len(c[2]))
+    return pad(mkimage.HEADER.pack(mkimage.MAGIC, mkimage.VERSION, fmt, width, height, colors, len(data)) + data)
+
+
+def changed_rects(width, height, prev, cur):
+    """Rectangles covering the pixels that differ, bands of rows merged when close."""
+    bands = []
+    for y in range(height):
+        row = range(y * width, (y + 1) * width)
+        cols = [i - y * width for i in row if prev[i] != cur[i]]
+        if not cols:
+            continue
+        x0, x1 = cols[0], cols[-1]
+        if bands:
+            bx0, by0, bx1, by1 = bands[-1]
+            gap = (y - by1 - 1) * (max(bx1, x1) - min(bx0, x0) + 1)
+            if gap <= GAP:
+                bands[-1] = (min(bx0, x0), by0, max(bx1, x1), y)
+                continue
+        bands.append((x0, y, x1, y))
+    return bands
+
+
+def encode_delta(width, height, prev, cur):
+    rects = bytearray()
+    bands = changed_rects(width, height, prev, cur)
+    for x0, y0, x1, y1 in bands:
+        w = x1 - x0 + 1
+        pixels = [cur[y * width + x] for y in range(y0, y1 + 1) for x in range(x0, x1 + 1)]
+        rects += RECT.pack(x0, y0) + encode_image(w, y1 - y0 + 1, pixels)
+    return FRAME.pack(len(bands), len(rects)) + rects, len(bands)
+
+
+def load_frames(args):
+    if args.raw:
+        width, height = (int(v) for v in args.raw.lower().split("x"))
+        frames = []
+        for path in args.inputs:
+            data = open(path, "rb").read()
+            if len(data) != width * height * 2:
+                sys.exit("%s: expected %d bytes" % (path, width * height * 2))
+            frames.append(list(struct.unpack(">%dH" % (width * height), data)))
+        return width, height, frames
+
+    from PIL import Image, ImageSequence
+    frames = []
+    size = None
+    for path in args.inputs:
+        for frame in ImageSequence.Iterator(Image.open(path)):
+            img = frame.convert("RGB")
+            if size and img.size != size:
+                sys.exit("%s: frames must all be %dx%d" % (path, size[0], size[1]))
+            size = img.size
+            frames.append([((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3) for r, g, b in img.getdata()])
+    return size[0], size[1], frames
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="+", metavar="input", help="frames, in order")
+    parser.add_argument("output", help="animation file to write")
+    parser.add_argument("--raw", metavar="WxH", help="inputs are raw big endian RGB565 of this size")
+    parser.add_argument("--period", type=int, default=100, help="milliseconds between frames (default 100)")
+    parser.add_argument("--c-array", metavar="NAME", help="write a C array instead of a binary")
+    args = parser.parse_args()
+
+    width, height, frames = load_frames(args)
+    if not frames or len(frames) > 0xFFFF:
+        sys.exit("need 1 to 65535 frames")
+    if width > 0x7FFF or height > 0x7FFF:
+        sys.exit("frames are too large for the format")
+
+    body = bytearray(encode_image(width, height, frames[0]))
+    rects = 0
+    # Deltas to frames 1..n-1, then back to frame 0
+    for i in range(1, len(frames) + 1):
+        delta, n = encode_delta(width, height, frames[i - 1], frames[i % len(frames)])
+        body += delta
+        rects += n
+    blob = HEADER.pack(MAGIC, VERSION, len(frames), width, height, args.period, len(body)) + body
+
+    if args.c_array:
+        mkimage.write_c_array(args.output, args.c_array, blob, "animation")
+    else:
+        with open(args.output, "wb") as f:
+            f.write(blob)
+
+    full = width * height * 2 * len(frames)
+    print("%s: %d frames of %dx%d, %d rectangles, %d bytes (%.1f%% of raw)" % (
+        args.output, len(frames), width, height, rects, len(blob), 100.0 * len(blob) / full))
+
+
+if __name__ == "__main__":
+    main()
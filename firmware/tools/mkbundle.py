@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Pack assets into an ST7789 asset bundle.
+
+The layout is described in main/ST7789/st7789_asset.h. Assets are named after
+their file name without extension, or NAME=PATH to choose the name.
+
+    mkbundle.py assets.bin build/cat.img build/digits.fnt logo=build/logo_v2.img
+    parttool.py write_partition --partition-name assets --input assets.bin
+
+The build does this from firmware/assets with st7789_create_asset_bundle()
+of tools/st7789_assets.cmake, flashed by `idf.py flash` or `idf.py assets-flash`.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"S7AB"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xIII")
+ENTRY = struct.Struct("<IIII")
+ALIGN = 4
+
+
+def fnv1a(name):
+    h = 2166136261
+    for b in name.encode():
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h or 1
+
+
+def align(n):
+    return (n + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def build(assets):
+    """Bundle bytes from a list of (name, data)."""
+    buckets = 1
+    while buckets < 2 * len(assets):
+        buckets *= 2
+
+    names = bytearray()
+    name_offsets = []
+    names_start = HEADER.size + buckets * ENTRY.size
+    for name, _ in assets:
+        name_offsets.append(names_start + len(names))
+        names += name.encode() + b"\0"
+
+    data = bytearray()
+    data_start = align(names_start + len(names))
+    index = [None] * buckets
+    for (name, blob), name_offset in zip(assets, name_offsets):
+        h = fnv1a(name)
+        slot = h & (buckets - 1)
+        while index[slot] is not None:
+            slot = (slot + 1) & (buckets - 1)
+        index[slot] = ENTRY.pack(h, name_offset, data_start + len(data), len(blob))
+        data += blob
+        data += bytes(align(len(data)) - len(data))
+
+    size = data_start + len(data)
+    out = bytearray(HEADER.pack(MAGIC, VERSION, buckets, len(assets), size))
+    out += b"".join(e or ENTRY.pack(0, 0, 0, 0) for e in index)
+    out += names
+    out += bytes(data_start - len(out))
+    out += data
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="bundle to write")
+    parser.add_argument("assets", nargs="*", metavar="[NAME=]PATH", help="files to pack")
+    parser.add_argument("--max-size", type=lambda v: int(v, 0),
+                        help="fail if the bundle is larger, e.g. the partition size")
+    args = parser.parse_args()
+
+    assets = []
+    seen = set()
+    for spec in args.assets:
+        name, sep, path = spec.partition("=")
+        if not sep:
+            path = spec
+            name = os.path.splitext(os.path.basename(spec))[0]
+        if name in seen:
+            sys.exit("duplicate asset name %r" % name)
+        seen.add(name)
+        with open(path, "rb") as f:
+            assets.append((name, f.read()))
+
+    bundle = build(assets)
+    if args.max_size is not None and len(bundle) > args.max_size:
+        sys.exit("bundle is %d bytes, more than %d" % (len(bundle), args.max_size))
+
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+    print("%s: %d assets, %d bytes" % (args.output, len(assets), len(bundle)))
+
+
+if __name__ == "__main__":
+    main()
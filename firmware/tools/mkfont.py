@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Convert a TTF/OTF font to the ST7789 anti-aliased font format.
+
+The layout is described in main/ST7789/st7789_font.h. Needs Pillow built with
+FreeType.
+
+    mkfont.py DejaVuSans-Bold.ttf 48 digits.fnt --bpp 4 --chars "0123456789:"
+"""
+
+import argparse
+import struct
+import sys
+
+from PIL import Image, ImageDraw, ImageFont
+
+MAGIC = b"S7FN"
+VERSION = 1
+HEADER = struct.Struct("<4sBBBBHHHHI")
+GLYPH = struct.Struct("<IBBBbb3x")
+KERN = struct.Struct("<HHh")
+
+
+def parse_chars(spec):
+    """Code points from a "first-last" range or a literal set of chars."""
+    if spec is None:
+        return list(range(32, 127))
+    if "-" in spec and len(spec) > 1 and all(p.isdigit() for p in spec.split("-")):
+        first, last = (int(p) for p in spec.split("-"))
+        return list(range(first, last + 1))
+    return sorted({ord(c) for c in spec})
+
+
+def pack_bits(values, bpp):
+    """Pack coverage values MSB first, without padding between rows."""
+    out = bytearray()
+    acc = 0
+    nbits = 0
+    for v in values:
+        acc = (acc << bpp) | v
+        nbits += bpp
+        if nbits == 8:
+            out.append(acc)
+            acc = 0
+            nbits = 0
+    if nbits:
+        out.append(acc << (8 - nbits))
+    return bytes(out)
+
+
+def render_glyph(font, ch, ascent, bpp):
+    """Bitmap cropped to the ink of ch, with its metrics."""
+    advance = round(font.getlength(ch))
+    left, top, right, bottom = font.getbbox(ch, anchor="ls")
+    width, height = right - left, bottom - top
+    if width <= 0 or height <= 0:
+        return b"", 0, 0, advance, 0, 0
+
+    img = Image.new("L", (width, height), 0)
+    ImageDraw.Draw(img).text((-left, -top), ch, font=font, fill=255, anchor="ls")
+    levels = (1 << bpp) - 1
+    values = [(p * levels + 127) // 255 for p in img.getdata()]
+    return pack_bits(values, bpp), width, height, advance, left, ascent + top
+
+
+def add_glyph(font, code, ascent, bpp, bitmaps):
+    """Render code, append its bitmap and return its packed table entry."""
+    bits, width, height, advance, left, top = render_glyph(font, chr(code), ascent, bpp)
+    if (width > 255 or height > 255 or not 0 <= advance <= 255
+            or not -128 <= left <= 127 or not -128 <= top <= 127):
+        sys.exit("glyph %r is too large for the format" % chr(code))
+    entry = GLYPH.pack(len(bitmaps), width, height, advance, left, top)
+    bitmaps += bits
+    return entry
+
+
+def kerning(font, codes):
+    """Pairs whose advance differs from the sum of the single advances."""
+    single = {c: font.getlength(chr(c)) for c in codes}
+    pairs = []
+    for a in codes:
+        for b in codes:
+            adjust = round(font.getlength(chr(a) + chr(b)) - single[a] - single[b])
+            if adjust:
+                pairs.append((a, b, adjust))
+    return pairs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("ttf", help="TTF or OTF source font")
+    parser.add_argument("size", type=int, help="pixel size")
+    parser.add_argument("output", help="binary font to write")
+    parser.add_argument("--bpp", type=int, choices=(1, 2, 4), default=4,
+                        help="coverage bits per pixel (default 4)")
+    parser.add_argument("--chars", help='chars to include, "32-126" or a literal set')
+    parser.add_argument("--no-kerning", action="store_true", help="skip kerning pairs")
+    args = parser.parse_args()
+
+    font = ImageFont.truetype(args.ttf, args.size)
+    ascent, descent = font.getmetrics()
+    codes = parse_chars(args.chars)
+    first, last = codes[0], codes[-1]
+    if last > 0xFFFF or last - first + 1 > 0xFFFF:
+        sys.exit("code points must fit in 16 bits")
+
+    glyphs = []
+    bitmaps = bytearray()
+    missing = None
+    if len(codes) < last - first + 1:
+        # Gaps in the range show the '?' glyph, like code points out of it
+        missing = add_glyph(font, ord("?"), ascent, args.bpp, bitmaps)
+    for code in range(first, last + 1):
+        if code not in codes:
+            glyphs.append(missing)
+        elif code == ord("?") and missing is not None:
+            glyphs.append(missing)
+        else:
+            glyphs.append(add_glyph(font, code, ascent, args.bpp, bitmaps))
+
+    kerns = [] if args.no_kerning else kerning(font, codes)
+    kerns.sort(key=lambda k: (k[0] << 16) | k[1])
+
+    height = ascent + descent
+    if height > 255:
+        sys.exit("font size is too large for the format")
+    header = HEADER.pack(MAGIC, VERSION, args.bpp, height, ascent,
+                         first, len(glyphs), len(kerns), 0, len(bitmaps))
+    with open(args.output, "wb") as f:
+        f.write(header)
+        f.writelines(glyphs)
+        f.writelines(KERN.pack(*k) for k in kerns)
+        f.write(bitmaps)
+
+    print("%s: %d glyphs, %d kerning pairs, %d bytes" % (
+        args.output, len(glyphs), len(kerns),
+        HEADER.size + GLYPH.size * len(glyphs) + KERN.size * len(kerns) + len(bitmaps)))
+
+
+if __name__ == "__main__":
+    main()
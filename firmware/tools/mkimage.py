@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Compress an image to the ST7789 image format.
+
+The layout is described in main/ST7789/st7789_image.h. PNG/BMP sources need
+Pillow; raw RGB565 sources (big endian, as sent to the panel) do not.
+
+    mkimage.py cat.png cat.img
+    mkimage.py --raw 320x240 cat.rgb565 cat.img
+    mkimage.py cat.png cat.c --c-array cat
+    mkimage.py --indexed icon.png icon.img
+    mkimage.py --bpp 4 icon.png icon.img
+    mkimage.py --alpha badge.png badge.img
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"S7IM"
+VERSION = 1
+FORMAT_RAW = 0
+FORMAT_QOI565 = 1
+FORMAT_INDEXED = {1: 2, 2: 3, 4: 4, 8: 5}
+FORMAT_RGB565A8 = 6
+HEADER = struct.Struct("<4sBBHHHI")
+
+OP_INDEX = 0x00
+OP_DIFF = 0x40
+OP_LUMA = 0x80
+OP_RUN = 0xC0
+OP_RGB = 0xFE
+RUN_MAX = 62
+
+
+def split(px):
+    return px >> 11, (px >> 5) & 0x3F, px & 0x1F
+
+
+def index_hash(px):
+    r, g, b = split(px)
+    return (r * 3 + g * 5 + b * 7) & 63
+
+
+def wrap(d, bits):
+    """Difference wrapped to a signed value of the channel width."""
+    half = 1 << (bits - 1)
+    return (d + half) % (1 << bits) - half
+
+
+def encode_qoi565(pixels):
+    """QOI adapted to RGB565: index, small diff, luma, run and literal ops."""
+    out = bytearray()
+    index = [0] * 64
+    prev = 0
+    run = 0
+
+    for px in pixels:
+        if px == prev:
+            run += 1
+            if run == RUN_MAX:
+                out.append(OP_RUN | (run - 1))
+                run = 0
+            continue
+        if run:
+            out.append(OP_RUN | (run - 1))
+            run = 0
+
+        h = index_hash(px)
+        if index[h] == px:
+            out.append(OP_INDEX | h)
+        else:
+            index[h] = px
+            r, g, b = split(px)
+            pr, pg, pb = split(prev)
+            dr, dg, db = wrap(r - pr, 5), wrap(g - pg, 6), wrap(b - pb, 5)
+            half = int(dg / 2)
+            if -2 <= dr <= 1 and -2 <= dg <= 1 and -2 <= db <= 1:
+                out.append(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2))
+            elif -32 <= dg <= 31 and -8 <= dr - half <= 7 and -8 <= db - half <= 7:
+                out.append(OP_LUMA | (dg + 32))
+                out.append((dr - half + 8) << 4 | (db - half + 8))
+            else:
+                out.append(OP_RGB)
+                out += struct.pack(">H", px)
+        prev = px
+
+    if run:
+        out.append(OP_RUN | (run - 1))
+    return bytes(out)
+
+
+def encode_indexed(width, height, pixels, bpp):
+    """Palette of big endian RGB565 colors, then rows of packed indexes."""
+    palette = sorted(set(pixels))
+    if not bpp:
+        bpp = next((b for b in sorted(FORMAT_INDEXED) if len(palette) <= 1 << b), None)
+    if bpp is None or len(palette) > 1 << bpp:
+        sys.exit("%d colors do not fit a %s bit palette, reduce them first" % (len(palette), bpp or 8))
+    lookup = {px: i for i, px in enumerate(palette)}
+
+    out = bytearray(struct.pack(">%dH" % len(palette), *palette))
+    for y in range(height):
+        acc = bits = 0
+        for px in pixels[y * width:(y + 1) * width]:
+            acc = acc << bpp | lookup[px]
+            bits += bpp
+            if bits == 8:
+                out.append(acc)
+                acc = bits = 0
+        if bits:
+            out.append(acc << (8 - bits))
+    return bpp, len(palette), bytes(out)
+
+
+def load_pixels(args):
+    if args.raw:
+        width, height = (int(v) for v in args.raw.lower().split("x"))
+        data = open(args.input, "rb").read()
+        if len(data) != width * height * 2:
+            sys.exit("%s: expected %d bytes" % (args.input, width * height * 2))
+        return width, height, list(struct.unpack(">%dH" % (width * height), data)), None
+
+    from PIL import Image
+    img = Image.open(args.input).convert("RGBA")
+    pixels = [((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3) for r, g, b, _ in img.getdata()]
+    alpha = bytes(a for _, _, _, a in img.getdata())
+    return img.width, img.height, pixels, alpha
+
+
+def write_c_array(path, name, blob, kind="image"):
+    with open(path, "w") as f:
+        f.write("#include <stdint.h>\n\n")
+        f.write("/* %d bytes, ST7789 %s format */\n" % (len(blob), kind))
+        f.write("const uint8_t %s[%d] __attribute__((aligned(4))) = {\n" % (name, len(blob)))
+        for i in range(0, len(blob), 16):
+            f.write("  " + ", ".join("0x%02x" % b for b in blob[i:i + 16]) + ",\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="PNG/BMP image, or raw RGB565 with --raw")
+    parser.add_argument("output", help="image file to write")
+    parser.add_argument("--raw", metavar="WxH", help="input is raw big endian RGB565 of this size")
+    parser.add_argument("--store", action="store_true", help="store the pixels uncompressed")
+    parser.add_argument("--indexed", action="store_true", help="store palette indexes of the fewest bits that fit")
+    parser.add_argument("--bpp", type=int, choices=sorted(FORMAT_INDEXED),
+                        help="store palette indexes of this many bits")
+    parser.add_argument("--alpha", action="store_true", help="keep the alpha channel, for sprites")
+    parser.add_argument("--c-array", metavar="NAME", help="write a C array instead of a binary")
+    args = parser.parse_args()
+    if args.alpha and args.raw:
+        parser.error("--alpha needs an image with an alpha channel, not --raw")
+
+    width, height, pixels, alpha = load_pixels(args)
+    if width > 0xFFFF or height > 0xFFFF:
+        sys.exit("image is too large for the format")
+
+    colors = 0
+    if args.alpha:
+        fmt, data = FORMAT_RGB565A8, struct.pack(">%dH" % len(pixels), *pixels) + alpha
+    elif args.indexed or args.bpp:
+        bpp, colors, data = encode_indexed(width, height, pixels, args.bpp)
+        fmt = FORMAT_INDEXED[bpp]
+    elif args.store:
+        fmt, data = FORMAT_RAW, struct.pack(">%dH" % len(pixels), *pixels)
+    else:
+        fmt, data = FORMAT_QOI565, encode_qoi565(pixels)
+    blob = HEADER.pack(MAGIC, VERSION, fmt, width, height, colors, len(data)) + data
+
+    if args.c_array:
+        write_c_array(args.output, args.c_array, blob)
+    else:
+        with open(args.output, "wb") as f:
+            f.write(blob)
+
+    print("%s: %dx%d, %d bytes (%.1f%% of raw)" % (
+        args.output, width, height, len(blob), 100.0 * len(blob) / (width * height * 2)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+# Build an ST7789 asset bundle from the sources of a directory.
+#
+#   st7789_create_asset_bundle(<partition> <base_dir> [FLASH_IN_PROJECT] [DEPENDS dep...])
+#
+# Every file of base_dir becomes one asset, named after the file name up to
+# its first dot. Options between the name and the extension are passed to the
+# converter:
+#
+#   name[.alpha|.indexed|.bppN|.store].png/.bmp   mkimage.py, QOI565 by default
+#   name.SIZE[.bppN].ttf/.otf                     mkfont.py at SIZE pixels
+#   name.img/.fnt/.anm/.jpg                       packed as is
+#
+# Each source is converted by its own build rule, so editing one file only
+# converts that file again before packing the bundle. The bundle is checked
+# against the partition size, and written by `idf.py <partition>-flash`, or by
+# `idf.py flash` with FLASH_IN_PROJECT, like spiffs_create_partition_image.
+
+set(ST7789_TOOLS_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+function(st7789_create_asset_bundle partition base_dir)
+    set(options FLASH_IN_PROJECT)
+    set(multi DEPENDS)
+    cmake_parse_arguments(arg "${options}" "" "${multi}" "${ARGN}")
+
+    idf_build_get_property(python PYTHON)
+    get_filename_component(base_dir_full_path ${base_dir} ABSOLUTE)
+    set(out_dir ${CMAKE_BINARY_DIR}/${partition}_assets)
+    set(target st7789_${partition}_bin)
+
+    partition_table_get_partition_info(size "--partition-name ${partition}" "size")
+    partition_table_get_partition_info(offset "--partition-name ${partition}" "offset")
+    if(NOT "${size}" OR NOT "${offset}")
+        set(message "Failed to create the asset bundle for partition '${partition}'. "
+                    "Check project configuration if using the correct partition table file.")
+        fail_at_build_time(${target} "${message}")
+        return()
+    endif()
+
+    file(GLOB sources CONFIGURE_DEPENDS ${base_dir_full_path}/*)
+    list(SORT sources)
+    set(assets)
+    set(outputs)
+    foreach(src ${sources})
+        get_filename_component(file ${src} NAME)
+        string(REPLACE "." ";" parts ${file})
+        list(LENGTH parts count)
+        if(count LESS 2 OR file MATCHES "^\\.")
+            continue()
+        endif()
+        list(GET parts 0 name)
+        math(EXPR last "${count} - 1")
+        list(GET parts ${last} ext)
+        string(TOLOWER ${ext} ext)
+        list(REMOVE_AT parts 0 ${last})
+
+        set(args)
+        if(ext STREQUAL "png" OR ext STREQUAL "bmp")
+            foreach(opt ${parts})
+                if(opt MATCHES "^(alpha|indexed|store)$")
+                    list(APPEND args --${opt})
+                elseif(opt MATCHES "^bpp([1248])$")
+                    list(APPEND args --bpp ${CMAKE_MATCH_1})
+                else()
+                    message(FATAL_ERROR "${src}: unknown image option '${opt}'")
+                endif()
+            endforeach()
+            set(out ${out_dir}/${name}.img)
+            add_custom_command(OUTPUT ${out}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${out_dir}
+                COMMAND ${python} ${ST7789_TOOLS_DIR}/mkimage.py ${args} ${src} ${out}
+                DEPENDS ${src} ${ST7789_TOOLS_DIR}/mkimage.py
+                COMMENT "Converting image ${file}"
+                VERBATIM)
+        elseif(ext STREQUAL "ttf" OR ext STREQUAL "otf")
+            set(font_size)
+            foreach(opt ${parts})
+                if(opt MATCHES "^[0-9]+$")
+                    set(font_size ${opt})
+                elseif(opt MATCHES "^bpp([124])$")
+                    list(APPEND args --bpp ${CMAKE_MATCH_1})
+                else()
+                    message(FATAL_ERROR "${src}: unknown font option '${opt}'")
+                endif()
+            endforeach()
+            if(NOT font_size)
+                message(FATAL_ERROR "${src}: name the font NAME.SIZE.${ext}")
+            endif()
+            set(out ${out_dir}/${name}.fnt)
+            add_custom_command(OUTPUT ${out}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${out_dir}
+                COMMAND ${python} ${ST7789_TOOLS_DIR}/mkfont.py ${src} ${font_size} ${out} ${args}
+                DEPENDS ${src} ${ST7789_TOOLS_DIR}/mkfont.py
+                COMMENT "Converting font ${file}"
+                VERBATIM)
+        elseif(ext MATCHES "^(img|fnt|anm|jpg|jpeg)$")
+            set(out ${src})
+        else()
+            message(WARNING "${src}: not an asset, skipped")
+            continue()
+        endif()
+
+        list(APPEND assets ${name}=${out})
+        list(APPEND outputs ${out})
+    endforeach()
+
+    set(image_file ${CMAKE_BINARY_DIR}/${partition}.bin)
+    add_custom_command(OUTPUT ${image_file}
+        COMMAND ${python} ${ST7789_TOOLS_DIR}/mkbundle.py ${image_file} ${assets} --max-size ${size}
+        DEPENDS ${outputs} ${ST7789_TOOLS_DIR}/mkbundle.py ${arg_DEPENDS}
+        COMMENT "Packing asset bundle ${partition}.bin"
+        VERBATIM)
+    add_custom_target(${target} ALL DEPENDS ${image_file})
+
+    set_property(DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}" APPEND PROPERTY
+        ADDITIONAL_CLEAN_FILES ${image_file} ${out_dir})
+
+    idf_component_get_property(main_args esptool_py FLASH_ARGS)
+    idf_component_get_property(sub_args esptool_py FLASH_SUB_ARGS)
+    esptool_py_flash_target(${partition}-flash "${main_args}" "${sub_args}" ALWAYS_PLAINTEXT)
+    esptool_py_flash_to_partition(${partition}-flash "${partition}" "${image_file}")
+    add_dependencies(${partition}-flash ${target})
+
+    if(arg_FLASH_IN_PROJECT)
+        esptool_py_flash_to_partition(flash "${partition}" "${image_file}")
+        add_dependencies(flash ${target})
+    endif()
+endfunction()